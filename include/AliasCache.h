@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#ifndef INCLUDE_ALIASCACHE_H_
+#define INCLUDE_ALIASCACHE_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/Value.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "include/ValueMap.h"
+
+// Memoizes the points-to intersection alias() does per pair of values.
+//   Values are first mapped to a class, one per unique set of solver
+//   representatives, and then each (class, class) pair is checked once.
+//
+// The cache is only valid for one solution, the owner must clear() it
+//   whenever the points-to solution changes
+class AliasCache {
+  //{{{
+ public:
+  typedef int32_t ClassId;
+
+  // Caps the number of memoized pairs, 0 disables memoization
+  explicit AliasCache(size_t max_pairs) : maxPairs_(max_pairs) { }
+
+  AliasCache(const AliasCache &) = delete;
+  AliasCache &operator=(const AliasCache &) = delete;
+
+  bool enabled() const {
+    return maxPairs_ != 0;
+  }
+
+  // The class of |val|, |get_reps| gives its (sorted) solver representatives
+  //   on a miss
+  template <typename GetReps>
+  ClassId getClass(const llvm::Value *val, GetReps get_reps) {
+    std::lock_guard<std::mutex> lock(classLock_);
+    auto it = valClass_.find(val);
+    if (it != std::end(valClass_)) {
+      classHits_++;
+      return it->second;
+    }
+
+    classMisses_++;
+    auto rc = classIds_.emplace(get_reps(val), classIds_.size());
+    valClass_.emplace(val, rc.first->second);
+    return rc.first->second;
+  }
+
+  // Sets |intersects| and returns true if the pair has been memoized
+  bool lookup(ClassId lhs, ClassId rhs, bool &intersects);
+
+  void insert(ClassId lhs, ClassId rhs, bool intersects);
+
+  void clear();
+
+  void printStats(llvm::raw_ostream &o) const;
+
+ private:
+  static const size_t NumShards = 16;
+
+  // Pairs are unordered, keyed with the lower class first
+  static uint64_t key(ClassId lhs, ClassId rhs) {
+    if (rhs < lhs) {
+      std::swap(lhs, rhs);
+    }
+    return (static_cast<uint64_t>(lhs) << 32) | static_cast<uint32_t>(rhs);
+  }
+
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<uint64_t, bool> pairs;
+  };
+
+  Shard &getShard(uint64_t key) {
+    return shards_[(key ^ (key >> 29)) % NumShards];
+  }
+
+  size_t maxPairs_;
+
+  std::mutex classLock_;
+  std::unordered_map<const llvm::Value *, ClassId> valClass_;
+  std::map<std::vector<ValueMap::Id>, ClassId> classIds_;
+
+  std::array<Shard, NumShards> shards_;
+
+  std::atomic<size_t> classHits_{0};
+  std::atomic<size_t> classMisses_{0};
+  std::atomic<size_t> pairHits_{0};
+  std::atomic<size_t> pairMisses_{0};
+  std::atomic<size_t> evictions_{0};
+  //}}}
+};
+
+#endif  // INCLUDE_ALIASCACHE_H_
@@ -6,9 +6,11 @@
 #define INCLUDE_ASSUMPTIONS_H_
 
 #include <algorithm>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "include/util.h"
@@ -34,30 +36,31 @@ typedef std::unordered_multimap<ValueMap::Id, llvm::Value *>
 
 class SetCache {  //{{{
  public:
+  // A set, as its ids in sorted order with no duplicates
+  typedef std::vector<ValueMap::Id> canon_set;
+
+  struct canon_set_hasher {
+    size_t operator()(const canon_set &set) const {
+      size_t ret = set.size();
+      for (auto id : set) {
+        ret ^= std::hash<ValueMap::Id>()(id) + 0x9e3779b9 +
+          (ret << 6) + (ret >> 2);
+      }
+      return ret;
+    }
+  };
+
   SetCache() = default;
 
-  // Dedups some ids
-  int32_t getID(const std::set<ValueMap::Id> &pts_set) {
-    /*
-    llvm::dbgs() << "Doing find on mappings!\n";
-    llvm::dbgs() << "  mappings.size() is: " << mappings_.size() << "\n";
-    llvm::dbgs() << "  pts_set is:";
-    for (auto obj_id : pts_set) {
-      llvm::dbgs() << " " << obj_id;
-    }
-    llvm::dbgs() << "\n";
-    */
-
-    auto it = mappings_.find(pts_set);
-    if (it == std::end(mappings_)) {
-      auto ret = mappings_.emplace(pts_set, curID_);
-      assert(ret.second);
+  // Hash-conses sets, each unique |canon| gets one id, and so one global
+  int32_t getID(const canon_set &canon) {
+    assert(std::is_sorted(std::begin(canon), std::end(canon)));
+    auto rc = mappings_.emplace(canon, curID_);
+    if (rc.second) {
       curID_++;
-
-      it = ret.first;
     }
 
-    return it->second;
+    return rc.first->second;
   }
 
   void addGVUse(ValueMap::Id gv) {
@@ -70,20 +73,21 @@ class SetCache {  //{{{
 
   // Iterator... {{{
   class const_iterator :
-    public std::map<std::set<ValueMap::Id>, int32_t>::const_iterator {
+    public std::unordered_map<canon_set, int32_t,
+        canon_set_hasher>::const_iterator {
    public:
-     typedef std::map<std::set<ValueMap::Id>, int32_t>::const_iterator
-       base_iter;
+     typedef std::unordered_map<canon_set, int32_t,
+       canon_set_hasher>::const_iterator base_iter;
 
      const_iterator() = default;
      explicit const_iterator(base_iter s) :
        base_iter(s) { }
 
-     const std::set<ValueMap::Id> *operator->() {
+     const canon_set *operator->() {
        return &(base_iter::operator->()->first);
      }
 
-     const std::set<ValueMap::Id> &operator*() {
+     const canon_set &operator*() {
        return base_iter::operator*().first;
      }
   };
@@ -105,7 +109,7 @@ class SetCache {  //{{{
   }
 
   const_iterator end() const {
-    return const_iterator(std::begin(mappings_));
+    return const_iterator(std::end(mappings_));
   }
 
   const_gv_iterator gv_begin() const {
@@ -119,7 +123,7 @@ class SetCache {  //{{{
  private:
   std::set<llvm::Function *> retFcns_;
   std::set<ValueMap::Id> gvUse_;
-  std::map<std::set<ValueMap::Id>, int32_t> mappings_;
+  std::unordered_map<canon_set, int32_t, canon_set_hasher> mappings_;
   int32_t curID_ = 0;
 };
 //}}}
@@ -357,8 +361,11 @@ class SetCheckInst : public InstrumentationSite {  //{{{
         SetCache &set_cache, llvm::Instruction *site) :
       InstrumentationSite(InstrumentationSite::Kind::SetCheckInst),
       assignInst_(const_cast<llvm::Value *>(assign_inst)),
-      checkSet_(std::begin(check_set), std::end(check_set)),
-      setCache_(set_cache), site_(site) { }
+      checkSet_(check_set), setCache_(set_cache), site_(site) {
+      std::sort(std::begin(checkSet_), std::end(checkSet_));
+      checkSet_.erase(std::unique(std::begin(checkSet_), std::end(checkSet_)),
+          std::end(checkSet_));
+    }
 
     bool operator<(const InstrumentationSite &is) const override {
       if (getKind() != is.getKind()) {
@@ -398,7 +405,12 @@ class SetCheckInst : public InstrumentationSite {  //{{{
       return is->getKind() == InstrumentationSite::Kind::SetCheckInst;
     }
 
+    // The check runs at its site, if it has one
     llvm::BasicBlock *getBB() const override {
+      if (site_ != nullptr) {
+        return site_->getParent();
+      }
+
       if (auto arg = dyn_cast<llvm::Argument>(assignInst_)) {
         return &arg->getParent()->getEntryBlock();
       }
@@ -408,7 +420,7 @@ class SetCheckInst : public InstrumentationSite {  //{{{
 
  private:
     llvm::Value *assignInst_;
-    std::set<ValueMap::Id> checkSet_;
+    SetCache::canon_set checkSet_;
 
     SetCache &setCache_;
     llvm::Instruction *site_;
@@ -504,6 +516,12 @@ class Assumption {  //{{{
       return approxDependencies(omap, m);
     }
 
+    // A rough measure of how much precision the analysis gains by making
+    //   this assumption, used to weigh it against its check cost
+    int64_t getApproxBenefit() const {
+      return approxBenefit();
+    }
+
  private:
     Assumption::Kind kind_;
 
@@ -516,6 +534,8 @@ class Assumption {  //{{{
       approxDependencies(
         ValueMap &omap, const llvm::Module &m) const = 0;
 
+    virtual int64_t approxBenefit() const = 0;
+
     // For some forms of instrumentation we'll need to know the ptsto set to
     //   calc the true dependencies
     virtual std::vector<std::unique_ptr<InstrumentationSite>> calcDependencies(
@@ -543,6 +563,10 @@ class PtstoAssumption : public Assumption {  //{{{
     // no more remap
     void remap(const util::ObjectRemap<ValueMap::Id> &) override { }
 
+    const llvm::Instruction *site() const {
+      return site_;
+    }
+
  protected:
     std::vector<std::unique_ptr<InstrumentationSite>>
       calcDependencies(
@@ -556,6 +580,9 @@ class PtstoAssumption : public Assumption {  //{{{
       approxDependencies(
         ValueMap &omap, const llvm::Module &m) const override;
 
+    // Each use of the pointer sees the narrowed set
+    int64_t approxBenefit() const override;
+
  private:
     // ValueMap::Id objID_;
     const llvm::Instruction *site_;
@@ -577,6 +604,10 @@ class DeadCodeAssumption : public Assumption {  //{{{
       return new DeadCodeAssumption(*this);
     }
 
+    llvm::BasicBlock *bb() const {
+      return bb_;
+    }
+
  private:
     llvm::BasicBlock *bb_;
 
@@ -590,6 +621,9 @@ class DeadCodeAssumption : public Assumption {  //{{{
     // Approx dependencies == calcDependencies in this instance
     std::vector<std::unique_ptr<InstrumentationSite>> approxDependencies(
         ValueMap &obj, const llvm::Module &m) const override;
+
+    // The constraint generating instructions we skip by not analyzing bb_
+    int64_t approxBenefit() const override;
 };
 //}}}
 //}}}
@@ -652,6 +686,14 @@ class AssumptionSet {
     assumptions_.emplace_back(std::move(a));
   }
 
+  // Moves all of rhs's assumptions (in order) to the end of this set,
+  //   leaving rhs empty
+  void merge(AssumptionSet &rhs) {
+    std::move(std::begin(rhs.assumptions_), std::end(rhs.assumptions_),
+        std::back_inserter(assumptions_));
+    rhs.assumptions_.clear();
+  }
+
   void updateObjIDs(const util::ObjectRemap<ValueMap::Id> &remap) {
     for (auto &pasm : assumptions_) {
       pasm->remap(remap);
@@ -672,6 +714,10 @@ llvm::Function *getCallFunction(llvm::Module &m);
 llvm::Function *getFreeFunction(llvm::Module &m);
 llvm::Function *getAssignFunction(llvm::Module &m);
 llvm::Function *getVisitFunction(llvm::Module &m);
+
+// Hoists, merges, and batches the set checks instrumentation inserted into
+//   |m|.  Returns true if |m| changed
+bool optimizeSetChecks(llvm::Module &m);
 //}}}
 
 #endif  // INCLUDE_ASSUMPTIONS_H_
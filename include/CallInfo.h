@@ -5,6 +5,7 @@
 #ifndef INCLUDE_CALLINFO_H_
 #define INCLUDE_CALLINFO_H_
 
+#include <utility>
 #include <vector>
 
 #include "llvm/IR/CallSite.h"
@@ -54,6 +55,13 @@ class CallInfo {
   void updateReps(const ValueMap &map);
 
  private:
+  friend class CgDiskCache;
+
+  // Used when loading cached Cgs
+  CallInfo(std::vector<Id> args, Id ret, Id var_arg,
+      const llvm::Instruction *ci) :
+    args_(std::move(args)), ret_(ret), varArg_(var_arg), ci_(ci) { }
+
   std::vector<Id> args_;
   Id ret_;
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#ifndef INCLUDE_CALLSTACK_H_
+#define INCLUDE_CALLSTACK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+// The per-thread call stack SpecSFSCheckLib keeps for callstack checks.
+//   SpecSFSInstrumenter pushes, pops, and probes it with inline IR, so the
+//   IR types it builds must match this layout
+struct CallStackFrame {
+  int32_t id;
+  uint64_t hash;
+};
+
+// Fixed, so the stack can live in static TLS
+static const int64_t CallStackMaxDepth = 1 << 16;
+
+// The hash of the stack holding only main.  It's 0 so the stack can be zero
+//   initialized, and live in .tbss rather than being copied into each thread
+static const uint64_t CallStackInitHash = 0;
+
+// Each check site gets a minimal perfect hash table of the hashes of the
+//   stacks it forbids.  A stack hash picks a bucket, and that bucket's
+//   displacement picks its slot.  The instrumenter builds the tables, and
+//   emits this same arithmetic inline
+struct StackHashTable {
+  static const uint64_t SlotMul = 0xff51afd7ed558ccdULL;
+
+  static uint64_t bucket(uint64_t hash, uint64_t num_buckets) {
+    return (hash >> 32) % num_buckets;
+  }
+
+  static uint64_t slot(uint64_t hash, uint64_t disp, uint64_t num_slots) {
+    uint64_t x = (hash ^ disp) * SlotMul;
+    return (x ^ (x >> 33)) % num_slots;
+  }
+
+  // Builds a minimal perfect hash of |keys| (which must be distinct) by hash
+  //   and displace: buckets are placed largest first, each trying
+  //   displacements until all of its keys land in free slots.  Fills in the
+  //   displacement of each bucket and the slot of each key.  If some bucket
+  //   can't be placed the table grows by a slot, so it is only minimal in the
+  //   (overwhelmingly) common case
+  static void build(const std::vector<uint64_t> &keys, uint64_t num_buckets,
+      uint64_t *num_slots, std::vector<uint64_t> *disps,
+      std::vector<uint64_t> *slots) {
+    static const uint64_t MaxDispTries = 1 << 16;
+    static const uint64_t DispStep = 0x9E3779B97F4A7C15ULL;
+
+    std::vector<std::vector<size_t>> buckets(num_buckets);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      buckets[bucket(keys[i], num_buckets)].push_back(i);
+    }
+
+    std::vector<size_t> order(num_buckets);
+    std::iota(std::begin(order), std::end(order), 0);
+    std::stable_sort(std::begin(order), std::end(order),
+        [&buckets] (size_t lhs, size_t rhs) {
+          return buckets[lhs].size() > buckets[rhs].size();
+        });
+
+    *num_slots = keys.size();
+    std::vector<uint64_t> cur;
+    while (true) {
+      std::vector<bool> taken(*num_slots, false);
+      disps->assign(num_buckets, 0);
+      slots->assign(keys.size(), 0);
+
+      bool placed = true;
+      for (auto bucket_idx : order) {
+        auto &bucket = buckets[bucket_idx];
+
+        placed = false;
+        for (uint64_t i = 0; i < MaxDispTries && !placed; ++i) {
+          auto disp = i * DispStep;
+          cur.clear();
+          placed = true;
+          for (auto key_idx : bucket) {
+            auto key_slot = slot(keys[key_idx], disp, *num_slots);
+            if (taken[key_slot] ||
+                std::find(std::begin(cur), std::end(cur), key_slot) !=
+                  std::end(cur)) {
+              placed = false;
+              break;
+            }
+            cur.push_back(key_slot);
+          }
+
+          if (placed) {
+            (*disps)[bucket_idx] = disp;
+            for (size_t j = 0; j < bucket.size(); ++j) {
+              taken[cur[j]] = true;
+              (*slots)[bucket[j]] = cur[j];
+            }
+          }
+        }
+
+        if (!placed) {
+          break;
+        }
+      }
+
+      if (placed) {
+        return;
+      }
+
+      ++*num_slots;
+    }
+  }
+};
+
+#endif  // INCLUDE_CALLSTACK_H_
@@ -11,6 +11,7 @@
 #include <map>
 #include <set>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -104,7 +105,7 @@ class Constraint {
         static size_t cnt = 0;
         cnt++;
         */
-        llvm::dbgs() << "Have src of UniveralVal in cons: " << *this << "\n";
+        dbg << "Have src of UniveralVal in cons: " << *this << "\n";
         // assert(cnt != 2);
       }
 
@@ -267,6 +268,16 @@ class Cg {
       ExtLibInfo &ext_info,
       CsCFG &cs_cfg);
 
+  // As above, but the assumptions made while scanning |fcn| are recorded in
+  //   |scan_as| instead of |as|, so Cgs may be built concurrently
+  Cg(const llvm::Function *fcn,
+      const DynamicInfo &dyn_info,
+      AssumptionSet &as,
+      AssumptionSet &scan_as,
+      ModInfo &mod_info,
+      ExtLibInfo &ext_info,
+      CsCFG &cs_cfg);
+
   Cg(const Cg &) = default;
   Cg(Cg &&) = default;
 
@@ -276,6 +287,7 @@ class Cg {
   Cg clone(std::vector<std::vector<CsCFG::Id>> cur_stacks) const {
     Cg ret(*this);
     ret.curStacks_ = std::move(cur_stacks);
+    ret.curStackNodes_.clear();
     return ret;
   }
   //}}}
@@ -391,8 +403,16 @@ class Cg {
 
  private:
   friend class CgCache;
+  friend class CgDiskCache;
   friend class CallInfo;
 
+  // An empty Cg, filled in by CgDiskCache when loading a cached SCC
+  Cg(const DynamicInfo &dyn_info,
+      AssumptionSet &as,
+      ModInfo &mod_info,
+      ExtLibInfo &ext_info,
+      CsCFG &cs_cfg);
+
 
   typedef std::tuple<llvm::ImmutableCallSite, const llvm::Function *, CallInfo *> call_tuple;  // NOLINT
   // Private helpers {{{
@@ -475,10 +495,12 @@ class Cg {
   void HRU(size_t min_removed);
   void HR(size_t min_removed);
   size_t HVN();
-  size_t HU();
+  size_t HU(HUState &state);
   void HCD();
   size_t updateConstraints(OptGraph &);
   size_t updateHCDConstraints(HCDGraph &);
+  size_t dedupConstraints();
+  std::vector<size_t> clusterAllocs();
   //}}}
 
   // Private variables {{{
@@ -496,6 +518,8 @@ class Cg {
   // The current call stack...
   CsCFG &csCFG_;
   std::vector<std::vector<CsCFG::Id>> curStacks_;
+  // The CallContextLoader trie nodes of curStacks_, filled in lazily
+  std::vector<CallContextLoader::NodeId> curStackNodes_;
   std::set<std::vector<CsCFG::Id>> invalidStacks_;
 
   // For speculative assumptions
@@ -559,9 +583,101 @@ class CgCache {
     assert(rc.second);
   }
 
+  // Context-sensitive callee summaries {{{
+  // A callee's resolved Cg only depends on its entry stacks through the
+  //   shape of their call-string trie nodes, and their top frame (the call
+  //   site, which the callee's own calls are compared against), so call
+  //   sites whose stacks have the same shapes and top share one resolved
+  //   clone
+  struct SummaryKey {
+    SummaryKey(const llvm::Function *f, CsCFG::Id t,
+        std::vector<CallContextLoader::ShapeId> s) :
+      fcn(f), top(t), shapes(std::move(s)) { }
+
+    bool operator==(const SummaryKey &rhs) const {
+      return fcn == rhs.fcn && top == rhs.top && shapes == rhs.shapes;
+    }
+
+    struct hasher {
+      size_t operator()(const SummaryKey &key) const {
+        size_t ret = std::hash<const llvm::Function *>()(key.fcn);
+        ret = ret * 31 + std::hash<int32_t>()(key.top.val());
+        for (auto shape : key.shapes) {
+          ret = ret * 31 + std::hash<int32_t>()(shape.val());
+        }
+        return ret;
+      }
+    };
+
+    const llvm::Function *fcn;
+    // The top frame of every entry stack
+    CsCFG::Id top;
+    // One per entry stack, sorted
+    std::vector<CallContextLoader::ShapeId> shapes;
+  };
+
+  struct Summary {
+    Summary(Cg c,
+        std::vector<std::pair<size_t, std::vector<CsCFG::Id>>> suffixes) :
+      cg(std::move(c)), invalidSuffixes(std::move(suffixes)) { }
+
+    // The resolved callee, with no invalid stacks of its own
+    Cg cg;
+    // The invalid stacks found while resolving cg, each as the index of the
+    //   entry stack it extends, and the frames pushed past that stack
+    std::vector<std::pair<size_t, std::vector<CsCFG::Id>>> invalidSuffixes;
+  };
+
+  const Summary *tryGetSummary(const SummaryKey &key) {
+    auto it = summaries_.find(key);
+    if (it != std::end(summaries_)) {
+      summaryHits_++;
+      return &it->second;
+    }
+    summaryMisses_++;
+    return nullptr;
+  }
+
+  const Summary &addSummary(SummaryKey key, Summary summary) {
+    summaryOrder_.push_back(key);
+    auto rc = summaries_.emplace(std::move(key), std::move(summary));
+    assert(rc.second);
+    summariesAdded_++;
+    return rc.first->second;
+  }
+
+  // The number of live summaries, a mark for releaseSummaries()
+  size_t numSummaries() const {
+    return summaryOrder_.size();
+  }
+
+  // Frees every summary added after the first |keep|.  Once a caller has
+  //   been resolved (and summarized itself) its callees' summaries are only
+  //   reached through its own, so they needn't stay live
+  void releaseSummaries(size_t keep) {
+    while (summaryOrder_.size() > keep) {
+      summaries_.erase(summaryOrder_.back());
+      summaryOrder_.pop_back();
+    }
+  }
+
+  void printSummaryStats(llvm::raw_ostream &o) const {
+    o << "CgCache summaries: " << summariesAdded_ << " stored (" <<
+      summaries_.size() << " live), " << summaryHits_ << " hits, " <<
+      summaryMisses_ << " misses\n";
+  }
+  //}}}
+
  private:
   std::map<BasicFcnCFG::Id, Cg> map_;
   BasicFcnCFG cfg_;
+
+  std::unordered_map<SummaryKey, Summary, SummaryKey::hasher> summaries_;
+  // Keys of the live summaries, in the order they were added
+  std::vector<SummaryKey> summaryOrder_;
+  size_t summariesAdded_ = 0;
+  size_t summaryHits_ = 0;
+  size_t summaryMisses_ = 0;
   //}}}
 };
 
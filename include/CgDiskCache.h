@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#ifndef INCLUDE_CGDISKCACHE_H_
+#define INCLUDE_CGDISKCACHE_H_
+
+#include <atomic>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "include/Cg.h"
+#include "include/DynamicInfo.h"
+
+class AssumptionSet;
+
+// A persistent on-disk cache of the local (pre call-resolution) Cg of each
+//   call-graph SCC, so re-analyzing a module only rebuilds the SCCs which
+//   changed.
+//
+// Entries are keyed by a SHA1 of:
+//   - The IR of each fcn in the SCC, including which of its BBs are used
+//   - The signatures of everything the SCC calls
+//   - Which of those callees are used
+//   - The layouts of the struct types the SCC's IR reaches, literal structs
+//     included
+//   - Module-wide state constraint generation depends on (the largest
+//     struct, speculation settings, the main call context)
+class CgDiskCache {
+  //{{{
+ public:
+  // Bump whenever constraint generation changes what it produces for the
+  //   same IR, this invalidates all existing entries
+  static const int32_t Version = 1;
+
+  // An empty |dir| disables the cache
+  CgDiskCache(const llvm::Module &m, const DynamicInfo &dyn_info,
+      const ModInfo &mod_info, std::string dir);
+
+  CgDiskCache(const CgDiskCache &) = delete;
+  CgDiskCache &operator=(const CgDiskCache &) = delete;
+
+  bool enabled() const {
+    return !dir_.empty();
+  }
+
+  // The cache key of the SCC made up of |fcns|
+  std::string getKey(const std::vector<const llvm::Function *> &fcns) const;
+
+  // Returns the cached Cg for the SCC |fcns|, or nullptr on a miss.  Any
+  //   assumptions the Cg's construction made are added to |scan_as|
+  std::unique_ptr<Cg> load(const std::string &key,
+      const std::vector<const llvm::Function *> &fcns,
+      AssumptionSet &as, AssumptionSet &scan_as,
+      ModInfo &mod_info, ExtLibInfo &ext_info, CsCFG &cs_cfg);
+
+  // Caches |cg|, freshly built from |fcns|.  |scan_as| holds the assumptions
+  //   made while building it
+  void store(const std::string &key,
+      const std::vector<const llvm::Function *> &fcns,
+      const Cg &cg, const AssumptionSet &scan_as);
+
+  void printStats(llvm::raw_ostream &o) const;
+
+ private:
+  // Maps the values a Cg refers to onto references which are stable across
+  //   runs: globals by name, everything local to the SCC by position
+  class ValueRefs;
+
+  std::string getPath(const std::string &key) const;
+
+  // (De)serialization helpers, false if something can't be represented or
+  //   read back {{{
+  bool writeCallInfo(std::ostream &o, const CallInfo &ci,
+      ValueRefs &refs) const;
+  bool readCallInfo(std::istream &in, std::unique_ptr<CallInfo> &ci,
+      ValueRefs &refs) const;
+
+  bool writeVals(std::ostream &o, const ValueMap &vals,
+      ValueRefs &refs) const;
+  bool readVals(std::istream &in, ValueMap &vals, ValueRefs &refs) const;
+
+  bool writeCg(std::ostream &o, const Cg &cg, ValueRefs &refs) const;
+  bool readCg(std::istream &in, Cg &cg, ValueRefs &refs) const;
+  //}}}
+
+  const llvm::Module &m_;
+  const DynamicInfo &dynInfo_;
+  std::string dir_;
+
+  // Hashed into every key
+  std::string envKey_;
+
+  // Unnamed globals are referred to by their position in the module
+  std::vector<const llvm::GlobalValue *> unnamedGlobals_;
+  std::unordered_map<const llvm::GlobalValue *, size_t> unnamedIdx_;
+
+  std::atomic<size_t> hits_{0};
+  std::atomic<size_t> misses_{0};
+  std::atomic<size_t> stale_{0};
+  std::atomic<size_t> stores_{0};
+  std::atomic<size_t> uncacheable_{0};
+  //}}}
+};
+
+#endif  // INCLUDE_CGDISKCACHE_H_
@@ -5,6 +5,10 @@
 #ifndef INCLUDE_CGOPT_H_
 #define INCLUDE_CGOPT_H_
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
 #include <algorithm>
 #include <map>
 #include <set>
@@ -13,6 +17,8 @@
 #include <utility>
 #include <vector>
 
+#include "llvm/Support/raw_ostream.h"
+
 #include "include/util.h"
 
 template<typename id_type>
@@ -266,4 +272,130 @@ typedef HCDNodeBase<CRTP_Graph::Id> HCDNode;
 typedef Graph<HCDNode> HCDGraph;
 typedef HCDGraph::Id HCDGraphId;
 
+// What HU keeps between HRU rounds, so a round only relabels the SCCs whose
+//   inputs changed in the last one.
+//
+// OptGraph ids of ref nodes change every round, so nodes are named by a key
+//   instead: 2 * id for the node of id, 2 * id + 1 for id's ref node.  PEs
+//   are handed out per key (and per GEP), so an SCC given the same inputs as
+//   last round gets the same label
+class HUState {
+  //{{{
+ public:
+  typedef util::SparseBitmap<int32_t> Label;
+  typedef std::unordered_multimap<size_t, size_t>::const_iterator
+    label_iterator;
+
+  // An SCC rep's inputs last round, and the label they gave it
+  struct Rep {
+    bool live = false;
+    bool indirect = false;
+    Label own;
+    std::vector<size_t> preds;
+
+    Label label;
+    // If label is in labels_, under hash
+    bool inTable = false;
+    size_t hash = 0;
+  };
+
+  static size_t nodeKey(GraphId id) {
+    return 2 * static_cast<size_t>(id);
+  }
+
+  static size_t refKey(GraphId id) {
+    return 2 * static_cast<size_t>(id) + 1;
+  }
+
+  size_t numKeys() const {
+    return reps_.size();
+  }
+
+  Rep &getRep(size_t key) {
+    if (key >= reps_.size()) {
+      reps_.resize(key + 1);
+    }
+    return reps_[key];
+  }
+
+  int32_t getIndirectPE(size_t key) {
+    auto rc = indirectPE_.emplace(key, nextPE_);
+    if (rc.second) {
+      nextPE_++;
+    }
+    return rc.first->second;
+  }
+
+  int32_t getGEPPE(GraphId node_id, int32_t offs) {
+    auto rc = gepPE_.emplace(std::make_pair(node_id, offs), nextPE_);
+    if (rc.second) {
+      nextPE_++;
+    }
+    return rc.first->second;
+  }
+
+  // The keys of the reps whose labels hash to |hash|
+  std::pair<label_iterator, label_iterator> findLabel(size_t hash) const {
+    return labels_.equal_range(hash);
+  }
+
+  void addLabel(size_t key, size_t hash) {
+    auto &rep = getRep(key);
+    assert(!rep.inTable);
+    labels_.emplace(hash, key);
+    rep.inTable = true;
+    rep.hash = hash;
+  }
+
+  void removeLabel(size_t key) {
+    auto &rep = getRep(key);
+    assert(rep.inTable);
+    auto range = labels_.equal_range(rep.hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == key) {
+        labels_.erase(it);
+        break;
+      }
+    }
+    rep.inTable = false;
+  }
+
+  size_t numLabels() const {
+    return labels_.size();
+  }
+
+  struct Stats {
+    size_t numSccs = 0;
+    size_t numLevels = 0;
+    size_t numRelabeled = 0;
+    size_t numParallel = 0;
+    size_t numChanged = 0;
+    size_t numMerges = 0;
+  };
+
+  // Labels the nodes of |graph| (named by |node_key|) and merges the nodes
+  //   with equal labels, reusing the labels of SCCs whose inputs didn't change
+  //   since the last round.  Leaves the labels in the nodes' ptsto sets
+  Stats label(OptGraph &graph, const std::vector<size_t> &node_key,
+      size_t num_threads);
+
+  // Moves the labels left in |graph| by label() into the state for the next
+  //   round
+  void saveLabels(OptGraph &graph, const std::vector<size_t> &node_key);
+
+ private:
+  // 0 is non-ptr
+  int32_t nextPE_ = 1;
+  std::unordered_map<size_t, int32_t> indirectPE_;
+  std::map<std::pair<GraphId, int32_t>, int32_t> gepPE_;
+
+  std::vector<Rep> reps_;
+  // The keys of the reps with pointer labels, by label hash
+  std::unordered_multimap<size_t, size_t> labels_;
+
+  // The SCC reps of the last label()
+  std::vector<GraphId> sccReps_;
+  //}}}
+};
+
 #endif  // INCLUDE_CGOPT_H_
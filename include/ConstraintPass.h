@@ -9,6 +9,7 @@
 #include "include/Cg.h"
 #include "include/ExtInfo.h"
 #include "include/ModInfo.h"
+#include "include/lib/EdgeCountPass.h"
 #include "include/lib/UnusedFunctions.h"
 #include "include/lib/IndirFcnTarget.h"
 
@@ -49,6 +50,16 @@ class ConstraintPass : public llvm::ModulePass {
   }
 
  private:
+  // Builds the whole program Cg, and the assumptions it relies on
+  void buildCg(llvm::Module &m, const DynamicInfo &dyn_info,
+      const BasicFcnCFG &fcn_cfg, CsCFG &cs_cfg);
+
+  // Weighs the profiled check cost of each assumption against its benefit,
+  //   and stops making the most expensive ones until the total cost fits in
+  //   the overhead budget.  Returns true if the Cg must be rebuilt
+  bool selectAssumptions(const llvm::Module &m, const DynEdgeLoader &dyn_edges,
+      IndirFunctionInfo &indir_info);
+
   Cg *mainCg_;
   std::unique_ptr<CgCache> cgCache_;
   std::unique_ptr<CgCache> callCgCache_;
@@ -42,10 +42,6 @@ class ContextInfo : public llvm::ModulePass {
   struct stack_id_tag {};
   struct store_bdd_tag { };
   struct bb_bdd_tag { };
-  struct stack_set_tag { };
-
-  class StackCache;
-
 
  public:
   // FIXME: Technically not part of the external interface...
@@ -65,48 +61,65 @@ class ContextInfo : public llvm::ModulePass {
 
   typedef BddSet<StoreNumber::Id, store_bdd_tag> StoreBddSet;
   typedef BddSet<BBNumber::Id, bb_bdd_tag> BBBddSet;
-  typedef BddSet<CsCFG::Id, stack_set_tag> StackSet;
 
+  // A node in the interned call-string trie: the stack is its parent's stack
+  //   with |frame()| pushed on top
   class StackInfo {
     //{{{
    public:
-    static StackInfo EmptyStack() {
-      return emptyStack_;
-    }
-
     static StackId NonCons() {
       return StackId(0);
     }
 
+    // The root of the trie
+    static StackId Empty() {
+      return StackId(1);
+    }
+
     StackInfo() = delete;
-    StackInfo(std::vector<CsCFG::Id> stack, StackSet set,
-        StackId id) : stack_(std::move(stack)), set_(set), id_(id) { }
+    StackInfo(StackId parent, CsCFG::Id frame, uint32_t depth,
+        StackId id, CallContextLoader::NodeId dyn_node) :
+        parentId_(parent), frame_(frame), depth_(depth), id_(id),
+        dynNode_(dyn_node) { }
+
+    // The top frame of the stack, invalid for the empty stack
+    CsCFG::Id frame() const {
+      return frame_;
+    }
 
-    const std::vector<CsCFG::Id> &stack() const {
-      return stack_;
+    // The empty stack is its own parent
+    StackId parentId() const {
+      return parentId_;
+    }
+
+    uint32_t depth() const {
+      return depth_;
+    }
+
+    bool empty() const {
+      return depth_ == 0;
     }
 
     StackId id() const {
       return id_;
     }
 
-    StackId parentId(StackCache &cache) const;
+    // This stack's node in the CallContextLoader trie, invalid if the stack
+    //   was interned without dynamic call data
+    CallContextLoader::NodeId dynNode() const {
+      return dynNode_;
+    }
 
     bool operator==(const StackInfo &rhs) const {
       return (id() == rhs.id());
     }
 
    private:
-    std::vector<CsCFG::Id> stack_;
-
-    StackSet set_;
-
-    // Cache of ParentId?
-    mutable StackId parentId_;
-    // StackId?
+    StackId parentId_;
+    CsCFG::Id frame_;
+    uint32_t depth_;
     StackId id_;
-
-    static StackInfo emptyStack_;
+    CallContextLoader::NodeId dynNode_;
     //}}}
   };
 
@@ -245,14 +258,22 @@ class ContextInfo : public llvm::ModulePass {
   const Context &getContext(ContextId id) const {
     return cache_.getContext(id);
   }
+
+  size_t numContexts() const {
+    return cache_.size();
+  }
+
+  size_t numStacks() const {
+    return stackCache_.size();
+  }
+
+  void printStats(llvm::raw_ostream &o) const;
   //}}}
 
  private:
   class ContextCache {
     //{{{
    public:
-    static const size_t MaxContexts = 50000000;
-
     explicit ContextCache(ExternalInfo &info);
 
     ContextId find(const llvm::Value *, StackId, const ContextInfo &info);
@@ -262,10 +283,17 @@ class ContextInfo : public llvm::ModulePass {
     }
 
     const Context &getContext(ContextId id) const {
-      assert(static_cast<size_t>(id) < contextSize_);
       return contexts_[static_cast<size_t>(id)];
     }
 
+    size_t size() const {
+      return contexts_.size();
+    }
+
+    size_t memUsage() const {
+      return contexts_.memUsage();
+    }
+
    private:
     struct ContextKey {
       struct hasher {
@@ -293,9 +321,9 @@ class ContextInfo : public llvm::ModulePass {
     ExternalInfo &info_;
 
     std::unordered_map<ContextKey, size_t, ContextKey::hasher> cache_;
-    size_t contextSize_ = 0;
-    std::unique_ptr<int8_t[]> contextMem_;
-    Context *contexts_;
+    // Contexts hold references to each other (through ContextInfo), so we
+    //   need stable addresses as the cache grows
+    util::SegmentedArray<Context> contexts_;
 
     ContextId noContext_;
     //}}}
@@ -304,40 +332,64 @@ class ContextInfo : public llvm::ModulePass {
   class StackCache {
     //{{{
    public:
-    static const size_t MaxStacks = 50000000;
+    // StackId 0 is reserved for StackInfo::NonCons(), which has no entry
+    static const size_t NumReservedStacks = 1;
+
+    explicit StackCache(ExternalInfo &info) : info_(info) {
+      stacks_.emplace_back(StackInfo::Empty(), CsCFG::Id::invalid(), 0,
+          StackInfo::Empty(), CallContextLoader::root());
+    }
 
-    StackCache() :
-      stackMem_(new int8_t[sizeof(StackInfo) * MaxStacks]),
-      stacks_(reinterpret_cast<StackInfo *>(stackMem_.get())) { }
+    // Interns the stack |parent| with |frame| pushed on top -- O(1)
+    StackId push(StackId parent, CsCFG::Id frame);
 
+    // Interns a full stack (bottom frame first) by walking down the trie
     StackId find(const std::vector<CsCFG::Id> &stack);
 
+    // Rebuilds the frames of a stack, bottom frame first
+    std::vector<CsCFG::Id> getFrames(StackId id) const;
+
     const StackInfo &getStack(StackId id) const {
-      assert(static_cast<size_t>(id) < stackSize_);
-      return stacks_[static_cast<size_t>(id)];
+      assert(static_cast<size_t>(id) >= NumReservedStacks);
+      return stacks_[static_cast<size_t>(id) - NumReservedStacks];
     }
 
-   private:
-    static size_t stackHashCombine(size_t hash, CsCFG::Id frame) {
-      return hash ^ (hash >> 11) ^ CsCFG::Id::hasher()(frame);
+    size_t size() const {
+      return stacks_.size();
     }
 
-    struct StackHasher {
-      size_t operator()(const std::vector<CsCFG::Id> &stack)
-            const {
-        size_t hash = 0;
-        for (CsCFG::Id frame : stack) {
-          hash = stackHashCombine(hash, frame);
+    size_t memUsage() const {
+      return stacks_.memUsage();
+    }
+
+   private:
+    // The child edges of every trie node, hashed on (parent, frame)
+    struct StackKey {
+      struct hasher {
+        size_t operator()(const StackKey &k1) const {
+          auto ret = StackId::hasher()(k1.parent);
+
+          ret ^= ret << 11;
+          ret ^= CsCFG::Id::hasher()(k1.frame);
+
+          return ret;
         }
-        return hash;
+      };
+
+      StackKey(StackId p, CsCFG::Id f) : parent(p), frame(f) { }
+
+      bool operator==(const StackKey &rhs) const {
+        return parent == rhs.parent && frame == rhs.frame;
       }
+
+      StackId parent;
+      CsCFG::Id frame;
     };
 
-    std::unordered_map<int, size_t> cache_;  // NOLINT
-    // std::vector<StackInfo> stacks_;
-    size_t stackSize_ = 1;
-    std::unique_ptr<int8_t[]> stackMem_;
-    StackInfo *stacks_;
+    ExternalInfo &info_;
+
+    std::unordered_map<StackKey, StackId, StackKey::hasher> children_;
+    util::SegmentedArray<StackInfo> stacks_;
     //}}}
   };
 
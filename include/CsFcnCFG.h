@@ -95,6 +95,16 @@ class CsFcnCFG {
     return nodes_[static_cast<size_t>(id)];
   }
 
+  const FcnNode &getNode(Id id) const {
+    assert(id != Id::invalid());
+    assert(static_cast<size_t>(id) < nodes_.size());
+    return nodes_[static_cast<size_t>(id)];
+  }
+
+  size_t size() const {
+    return nodes_.size();
+  }
+
   std::unordered_multimap<const llvm::Function *, Id> findDirectPreds(Id start,
       const std::unordered_set<const llvm::Function *> &candidates);
 
@@ -73,7 +73,7 @@ const target_type *dyn_cast(const base_type *b) {
 #  define if_unit_test(X)
 #  define if_unit_test_else(X, Y) Y
 #  define if_not_unit_test(X) X
-#  define dbg llvm::dbgs()
+#  define dbg debug_stream()
 #  define dbg_type llvm::raw_ostream
 #  define dbg_ostream llvm::raw_os_ostream
 #  define unreachable(X) llvm_unreachable(X)
@@ -86,6 +86,37 @@ const target_type *dyn_cast(const base_type *b) {
 using llvm::dyn_cast;
 using llvm::cast;
 using llvm::dyn_cast_or_null;
+
+// Where dbg output from this thread goes, nullptr for llvm::dbgs()
+inline llvm::raw_ostream *&debug_stream_override() {
+  static thread_local llvm::raw_ostream *stream = nullptr;
+  return stream;
+}
+
+inline llvm::raw_ostream &debug_stream() {
+  auto stream = debug_stream_override();
+  return (stream != nullptr) ? *stream : llvm::dbgs();
+}
+
+// Sends this thread's dbg output to |o| for the life of the object, so
+//   worker threads can buffer their output for the main thread to print
+class ScopedDebugStream {
+ public:
+  explicit ScopedDebugStream(llvm::raw_ostream &o) :
+      prev_(debug_stream_override()) {
+    debug_stream_override() = &o;
+  }
+
+  ~ScopedDebugStream() {
+    debug_stream_override() = prev_;
+  }
+
+  ScopedDebugStream(const ScopedDebugStream &) = delete;
+  ScopedDebugStream &operator=(const ScopedDebugStream &) = delete;
+
+ private:
+  llvm::raw_ostream *prev_;
+};
 #endif
 
 [[ gnu::unused ]]
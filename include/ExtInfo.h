@@ -6,6 +6,11 @@
 #ifndef INCLUDE_EXTINFO_H_
 #define INCLUDE_EXTINFO_H_
 
+#include <cstdint>
+
+#include <limits>
+#include <map>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <unordered_map>
@@ -108,10 +113,11 @@ class UnknownExtInfo : public ExtInfo {
 
 class ExtLibInfo {
  public:
-  ExtLibInfo(ExtLibInfo &&) = default;
+  // Not movable, UnknownFunction and the matcher are referred to by address
+  ExtLibInfo(ExtLibInfo &&) = delete;
   ExtLibInfo(const ExtLibInfo &) = delete;
 
-  ExtLibInfo &operator=(ExtLibInfo &&) = default;
+  ExtLibInfo &operator=(ExtLibInfo &&) = delete;
   ExtLibInfo &operator=(const ExtLibInfo &) = delete;
 
   explicit ExtLibInfo(ModInfo &info);
@@ -130,10 +136,17 @@ class ExtLibInfo {
       return UnknownFunction;
     }
 
-    auto &ret = getInfo(fcn->getName());
+    std::lock_guard<std::mutex> lock(fcnLock_);
+    auto it = fcnInfo_.find(fcn);
+    if (it != std::end(fcnInfo_)) {
+      return *it->second;
+    }
+
+    auto &ret = matcher_.match(fcn->getName(), UnknownFunction);
     if (isUnknownFunction(ret) && fcn->isDeclaration()) {
       llvm::dbgs() << "!!! Unknown external call: " << fcn->getName() << "\n";
     }
+    fcnInfo_.emplace(fcn, &ret);
     return ret;
   }
 
@@ -153,29 +166,55 @@ class ExtLibInfo {
   }
 
  private:
-  const ExtInfo &getInfo(const std::string &fcn) const {
-    auto it = info_.find(fcn);
-
-    // If we don't know
-    if (it != std::end(info_)) {
-      return *it->second;
-    }
-
-    // We don't have it in info_, still check partial matches
-    for (auto &pr : matchInfo_) {
-      if (fcn.find(pr.first) != std::string::npos) {
-        llvm::dbgs() << "  have match on: " << pr.first << "\n";
-        return *pr.second;
-      }
-    }
-
-    return UnknownFunction;
-  }
+  // An Aho-Corasick automaton over the names in info_ and the partial
+  //   patterns in matchInfo_, so a name is resolved in one pass over its
+  //   characters
+  class NameMatcher {
+    //{{{
+   public:
+    NameMatcher() : nodes_(1) { }
+
+    void addExact(const std::string &name, const ExtInfo *info);
+    void addPartial(const std::string &pattern, const ExtInfo *info);
+
+    // Call once every name has been added
+    void build();
+
+    // An exact match wins, then the earliest added partial pattern found
+    //   anywhere in |name|
+    const ExtInfo &match(llvm::StringRef name,
+        const ExtInfo &unknown) const;
+
+   private:
+    static constexpr uint32_t NoPartial =
+      std::numeric_limits<uint32_t>::max();
+
+    struct Node {
+      std::map<char, uint32_t> next;
+      uint32_t fail = 0;
+      const ExtInfo *exact = nullptr;
+      // Lowest partial pattern ending here, or at any node on our fail chain
+      uint32_t partial = NoPartial;
+    };
+
+    uint32_t insert(const std::string &str);
+
+    std::vector<Node> nodes_;
+    std::vector<std::pair<std::string, const ExtInfo *>> partials_;
+    //}}}
+  };
 
   std::unordered_map<std::string, std::unique_ptr<ExtInfo>> info_;
   // Partial matches
   std::vector<std::pair<std::string, std::unique_ptr<ExtInfo>>> matchInfo_;
 
+  NameMatcher matcher_;
+
+  // Lookups are resolved once per function
+  mutable std::mutex fcnLock_;
+  mutable std::unordered_map<const llvm::Function *, const ExtInfo *>
+    fcnInfo_;
+
   ModInfo &modInfo_;
 };
 
@@ -5,14 +5,17 @@
 #ifndef INCLUDE_MODINFO_H_
 #define INCLUDE_MODINFO_H_
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include "llvm/IR/Function.h"
+#include "llvm/IR/TypeFinder.h"
 
 #include "include/util.h"
 #include "include/ValueMap.h"
 
-#include <map>
-#include <vector>
-
 class ModInfo {
  public:
   class StructInfo {
@@ -200,6 +203,19 @@ class ModInfo {
     }
   }
 
+  // Adds every struct |m| uses, literal structs included.  Called before
+  //   Cgs are built concurrently, so the largest struct is settled before
+  //   any worker asks for it, rather than depending on which literal structs
+  //   other workers have looked up so far
+  void addModuleStructs(const llvm::Module &m) {
+    std::lock_guard<std::recursive_mutex> lock(structLock_);
+    llvm::TypeFinder types;
+    types.run(m, false);
+    for (auto type : types) {
+      addStructInfo(type);
+    }
+  }
+
   ModInfo(const ModInfo &) = delete;
   ModInfo(ModInfo &&) = delete;
 
@@ -208,7 +224,12 @@ class ModInfo {
 
   // Handle structure infos
 
+  // Literal structs are added lazily, and Cgs may be built concurrently, so
+  //   lookups are locked.  Recursive, as StructInfo's constructor looks up
+  //   its sub-structs.  std::map nodes are stable, so the returned reference
+  //   remains valid after we unlock.
   const StructInfo &getStructInfo(const llvm::StructType *type) {
+    std::lock_guard<std::recursive_mutex> lock(structLock_);
     auto st_type = cast<llvm::StructType>(type);
 
     auto struct_info_it = structInfo_.find(st_type);
@@ -224,6 +245,7 @@ class ModInfo {
   }
 
   const StructInfo &getMaxStructInfo() const {
+    std::lock_guard<std::recursive_mutex> lock(structLock_);
     assert(maxStructInfo_ != nullptr);
     return *maxStructInfo_;
   }
@@ -243,6 +265,34 @@ class ModInfo {
   }
 
  private:
+  static bool isLarger(const StructInfo &lhs, const StructInfo &rhs) {
+    if (lhs.size() != rhs.size()) {
+      return lhs.size() > rhs.size();
+    }
+
+    // Identified structs are all added up front, in module order.  Literal
+    //   structs are added lazily (possibly concurrently), so ties between
+    //   them are broken on layout rather than on the order we saw them
+    if (!lhs.type()->isLiteral() || !rhs.type()->isLiteral()) {
+      return false;
+    }
+
+    auto lhs_sizes = lhs.sizes();
+    auto rhs_sizes = rhs.sizes();
+    if (!std::equal(std::begin(lhs_sizes), std::end(lhs_sizes),
+          std::begin(rhs_sizes))) {
+      return std::lexicographical_compare(
+          std::begin(lhs_sizes), std::end(lhs_sizes),
+          std::begin(rhs_sizes), std::end(rhs_sizes));
+    }
+
+    auto lhs_strongs = lhs.strongs();
+    auto rhs_strongs = rhs.strongs();
+    return std::lexicographical_compare(
+        std::begin(lhs_strongs), std::end(lhs_strongs),
+        std::begin(rhs_strongs), std::end(rhs_strongs));
+  }
+
   bool addStructInfo(const llvm::StructType *type) {
     bool ret = true;
     auto it = structInfo_.find(type);
@@ -259,7 +309,7 @@ class ModInfo {
 
       auto &info = it->second;
       if (maxStructInfo_ == nullptr ||
-          info.size() > maxStructInfo_->size()) {
+          isLarger(info, *maxStructInfo_)) {
         maxStructInfo_ = &info;
       }
     }
@@ -270,6 +320,8 @@ class ModInfo {
 
   std::map<const llvm::StructType *, StructInfo> structInfo_;
   const StructInfo *maxStructInfo_ = nullptr;
+
+  mutable std::recursive_mutex structLock_;
 };
 
 #endif // INCLUDE_MODINFO_H_
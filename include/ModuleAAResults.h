@@ -5,9 +5,140 @@
 #ifndef INCLUDE_MODULEAARESULTS_H_
 #define INCLUDE_MODULEAARESULTS_H_
 
+#include <utility>
+#include <vector>
+
 #include "include/SpecAnders.h"
 #include "include/SpecAndersCS.h"
 
+// The results of a batch of alias queries, one row per location of the first
+//   list and one column per location of the second.  Locations are grouped
+//   into classes sharing one points-to set, so only a result per pair of
+//   classes is stored
+class AliasMatrix {
+  //{{{
+ public:
+  AliasMatrix() = default;
+  AliasMatrix(std::vector<size_t> row_class, size_t num_row_classes,
+      std::vector<size_t> col_class, size_t num_col_classes) :
+    rowClass_(std::move(row_class)), colClass_(std::move(col_class)),
+    numColClasses_(num_col_classes),
+    results_(num_row_classes * num_col_classes,
+        llvm::AliasResult::MayAlias) { }
+
+  size_t rows() const {
+    return rowClass_.size();
+  }
+
+  size_t cols() const {
+    return colClass_.size();
+  }
+
+  llvm::AliasResult get(size_t row, size_t col) const {
+    return classResult(rowClass_[row], colClass_[col]);
+  }
+
+  // The number of (row, col) pairs with result |res|
+  size_t count(llvm::AliasResult res) const;
+
+  // Iterates the (row, col) pairs which may alias {{{
+  class const_iterator {
+   public:
+    typedef std::pair<size_t, size_t> value_type;
+
+    const_iterator(const AliasMatrix &mat, size_t row, size_t col) :
+        mat_(&mat), row_(row), col_(col) {
+      skipNoAlias();
+    }
+
+    bool operator==(const const_iterator &it) const {
+      return row_ == it.row_ && col_ == it.col_;
+    }
+
+    bool operator!=(const const_iterator &it) const {
+      return !operator==(it);
+    }
+
+    value_type operator*() const {
+      return std::make_pair(row_, col_);
+    }
+
+    const_iterator &operator++() {
+      advance();
+      skipNoAlias();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp(*this);
+      ++(*this);
+      return tmp;
+    }
+
+   private:
+    void advance() {
+      ++col_;
+      if (col_ == mat_->cols()) {
+        col_ = 0;
+        ++row_;
+      }
+    }
+
+    void skipNoAlias() {
+      if (mat_->cols() == 0) {
+        row_ = mat_->rows();
+      }
+
+      while (row_ < mat_->rows() &&
+          mat_->get(row_, col_) == llvm::AliasResult::NoAlias) {
+        advance();
+      }
+    }
+
+    const AliasMatrix *mat_;
+    size_t row_;
+    size_t col_;
+  };
+
+  const_iterator begin() const {
+    return const_iterator(*this, 0, 0);
+  }
+
+  const_iterator end() const {
+    return const_iterator(*this, rows(), 0);
+  }
+  //}}}
+
+ private:
+  friend class ModuleAAResults;
+
+  llvm::AliasResult classResult(size_t row_class, size_t col_class) const {
+    return results_[row_class * numColClasses_ + col_class];
+  }
+
+  void setClassResult(size_t row_class, size_t col_class,
+      llvm::AliasResult res) {
+    results_[row_class * numColClasses_ + col_class] = res;
+  }
+
+  std::vector<size_t> rowClass_;
+  std::vector<size_t> colClass_;
+  size_t numColClasses_ = 0;
+  std::vector<llvm::AliasResult> results_;
+  //}}}
+};
+
+// How many unordered pairs of distinct locations gave each result
+struct AliasPairCounts {
+  size_t pairs = 0;
+  size_t mayAlias = 0;
+  size_t mustAlias = 0;
+  size_t noAlias = 0;
+
+  void add(llvm::AliasResult res, size_t cnt);
+  void merge(const AliasPairCounts &rhs);
+};
+
 class ModuleAAResults : public llvm::ModulePass {
  public:
   static char ID;
@@ -23,6 +154,20 @@ class ModuleAAResults : public llvm::ModulePass {
   llvm::AliasResult alias(const llvm::MemoryLocation &LocA,
       const llvm::MemoryLocation &LocB);
 
+  // Answers alias() for every pair of |locs_a| x |locs_b|, with one points-to
+  //   set intersection per pair of solver representative classes.  Classes
+  //   are intersected on |num_threads| threads, 0 uses one per core
+  AliasMatrix aliasMatrix(const std::vector<llvm::MemoryLocation> &locs_a,
+      const std::vector<llvm::MemoryLocation> &locs_b,
+      size_t num_threads = 1);
+
+  // Counts the results of alias() over every pair of distinct locations in
+  //   |locs|.  Unlike aliasMatrix(locs, locs), each pair of classes is only
+  //   intersected once and no per pair results are kept
+  AliasPairCounts aliasPairCounts(
+      const std::vector<llvm::MemoryLocation> &locs,
+      size_t num_threads = 1);
+
  private:
   SpecAndersWrapperPass *anders_;
   SpecAndersCS *andersCS_;
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#ifndef INCLUDE_REVPTSTOINDEX_H_
+#define INCLUDE_REVPTSTOINDEX_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "include/ValueMap.h"
+
+class AndersGraph;
+
+// The solved points-to relation transposed: for each object, the rep nodes
+//   whose points-to sets contain it.
+//
+// Stored in CSR form, the reps pointing to object |o| are
+//   reps_[offsets_[o], offsets_[o+1]), in increasing order
+class RevPtstoIndex {
+  //{{{
+ public:
+  typedef ValueMap::Id Id;
+  typedef std::vector<Id>::const_iterator const_iterator;
+
+  RevPtstoIndex() = default;
+
+  // Transposes the points-to sets of |graph|'s reps, on |num_threads|
+  //   threads (0 uses one per core)
+  void build(AndersGraph &graph, size_t num_threads);
+
+  // Transposes a relation given in CSR form: rep fwd_reps[i] points to
+  //   fwd_objs[fwd_offsets[i], fwd_offsets[i+1]), in increasing order
+  void build(const std::vector<Id> &fwd_reps,
+      const std::vector<size_t> &fwd_offsets, const std::vector<Id> &fwd_objs,
+      size_t num_threads);
+
+  bool built() const {
+    return !offsets_.empty();
+  }
+
+  // The reps which may point to |obj|
+  std::pair<const_iterator, const_iterator> pointedToBy(Id obj) const {
+    auto idx = static_cast<size_t>(obj.val());
+    if (idx + 1 >= offsets_.size()) {
+      return std::make_pair(std::end(reps_), std::end(reps_));
+    }
+
+    return std::make_pair(std::begin(reps_) + offsets_[idx],
+        std::begin(reps_) + offsets_[idx + 1]);
+  }
+
+  size_t numPointedToBy(Id obj) const {
+    auto pr = pointedToBy(obj);
+    return std::distance(pr.first, pr.second);
+  }
+
+  void printStats(llvm::raw_ostream &o) const;
+
+ private:
+  std::vector<uint32_t> offsets_;
+  std::vector<Id> reps_;
+  //}}}
+};
+
+#endif  // INCLUDE_REVPTSTOINDEX_H_
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#ifndef INCLUDE_SETCHECK_H_
+#define INCLUDE_SETCHECK_H_
+
+#include <cstdint>
+
+#include <algorithm>
+
+// How the object set of a set check is laid out in its int32_t array.
+//   SetCheckInst picks a layout per unique set, and passes the kind along
+//   with the array so SpecSFSCheckLib knows how to probe it
+struct SetEncoding {
+  enum Kind : int32_t {
+    // The sorted object ids, size is the number of ids
+    Sorted = 0,
+    // The lowest id, followed by a bitmap of ids from that base on, size is
+    //   the number of bitmap words
+    Bitset = 1,
+  };
+
+  static const int32_t BitsPerWord = 32;
+
+  static int32_t numWords(int32_t min_id, int32_t max_id) {
+    return (max_id - min_id) / BitsPerWord + 1;
+  }
+
+  // Dense sets are cheaper as bitsets, both to store and to probe
+  static Kind choose(int32_t num_ids, int32_t min_id, int32_t max_id) {
+    if (numWords(min_id, max_id) + 1 <= num_ids) {
+      return Bitset;
+    }
+
+    return Sorted;
+  }
+
+  static bool contains(int32_t kind, const int32_t *set, int32_t size,
+      int32_t id) {
+    if (kind == Bitset) {
+      int64_t bit = static_cast<int64_t>(id) - set[0];
+      if (bit < 0 || bit >= static_cast<int64_t>(size) * BitsPerWord) {
+        return false;
+      }
+
+      auto word = static_cast<uint32_t>(set[1 + bit / BitsPerWord]);
+      return (word >> (bit % BitsPerWord)) & 1;
+    }
+
+    return std::binary_search(set, set + size, id);
+  }
+};
+
+#endif  // INCLUDE_SETCHECK_H_
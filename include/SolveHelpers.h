@@ -11,9 +11,11 @@
 
 #include <algorithm>
 #include <limits>
+#include <list>
 #include <map>
 #include <queue>
 #include <set>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -21,6 +23,7 @@
 
 #include "include/util.h"
 #include "include/Cg.h"
+#include "include/lib/BddSet.h"
 
 // Bitmap used in many places (and by Andersen's) to represent ptsto
 // typedef llvm::SparseBitVector<> Bitmap;
@@ -197,6 +200,17 @@ class BddPtstoSet {
     }
   }
 
+  static void printBddStats(llvm::raw_ostream &o) {
+    bdd_print_stats(o);
+    o << "GEP offset cache: " << gepHits_ << " hits, " << gepMisses_ <<
+      " misses, " << gepEvictions_ << " evictions, " << gepNodes_ <<
+      " nodes pinned\n";
+    telemetry::stat("bdd.gep_cache_hits", gepHits_);
+    telemetry::stat("bdd.gep_cache_misses", gepMisses_);
+    telemetry::stat("bdd.gep_cache_evictions", gepEvictions_);
+    telemetry::stat("bdd.gep_cache_nodes", gepNodes_);
+  }
+
   bool set(ValueMap::Id id) {
     auto init = ptsto_;
     ptsto_ |= getFddVar(id);
@@ -303,8 +317,7 @@ class BddPtstoSet {
     bdd init = ptsto_;
 
     // Do an or offs
-    ptsto_ |= bdd_replace(bdd_relprod(rhs.ptsto_, geps_[offs], ptsDom_),
-        gepToPts_);
+    ptsto_ |= applyOffs(rhs.ptsto_, offs);
 
     if (init != ptsto_) {
       clearDynPtsto();
@@ -440,6 +453,9 @@ class BddPtstoSet {
   static void updateConstraints(const Cg &cg);
 
  private:
+  // Returns |src| with every object moved |offs| fields along, memoized
+  static bdd applyOffs(const bdd &src, int32_t offs);
+
   std::unique_ptr<bdd> bitmapToBdd(const Bitmap &bm) {
     auto ret = std::unique_ptr<bdd>(new bdd(bddfalse));
 
@@ -627,6 +643,26 @@ class BddPtstoSet {
 
   static std::vector<ValueMap::Id> uglyBddVec_;
 
+  // LRU cache of applyOffs() results, keyed on (src node, offs).  Entries
+  //   hold a reference to src, so its node id can't be reused while cached.
+  //   The cache is capped by the nodes its entries pin (gepNodes_)
+  struct GepCacheEntry {
+    GepCacheEntry(bdd s, int32_t o, bdd r, size_t n) :
+      src(std::move(s)), offs(o), result(std::move(r)), nodes(n) { }
+
+    bdd src;
+    int32_t offs;
+    bdd result;
+    size_t nodes;
+  };
+  static std::list<GepCacheEntry> gepLRU_;
+  static std::unordered_map<uint64_t, std::list<GepCacheEntry>::iterator>
+    gepCache_;
+  static size_t gepHits_;
+  static size_t gepMisses_;
+  static size_t gepEvictions_;
+  static size_t gepNodes_;
+
   // Cache:  id -> pair<clock, ptsto>
   static const size_t MaxVecCacheSize = 50000;
   static std::map<uint32_t, std::pair<bool,
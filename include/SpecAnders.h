@@ -9,11 +9,13 @@
 #include <memory>
 #include <vector>
 
+#include "include/AliasCache.h"
 #include "include/AndersGraph.h"
 #include "include/Assumptions.h"
 #include "include/Cg.h"
 #include "include/ValueMap.h"
 #include "include/ConstraintPass.h"
+#include "include/RevPtstoIndex.h"
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Function.h"
@@ -69,6 +71,19 @@ class SpecAndersAnalysis {
     return graph_.getNode(rep_id).ptsto();
   }
 
+  // nullptr if |val| was never given an id, so we have no points-to set for
+  //   it
+  const PtstoSet *getPointsTo(const llvm::Value *val) {
+    if (graph_.cg().vals().getIds(val).empty()) {
+      return nullptr;
+    }
+    return ptsCacheGet(val);
+  }
+
+  // The sorted solver representatives whose points-to sets make up |val|'s.
+  //   Values with the same representatives have the same points-to set
+  std::vector<ValueMap::Id> getRepClass(const llvm::Value *val);
+
   ConstraintPass &getConstraintPass() {
     return *cp_;
   }
@@ -76,6 +91,15 @@ class SpecAndersAnalysis {
     return *cp_;
   }
 
+  // The objects -> pointers transpose of the solution, built on first use
+  const RevPtstoIndex &getRevPtsto();
+
+  void printAliasCacheStats(llvm::raw_ostream &o) const {
+    if (aliasCache_ != nullptr) {
+      aliasCache_->printStats(o);
+    }
+  }
+
  private:
   friend SpecAndersAAResult;
   // Takes dynamic pointsto information, as well as hot/cold basic block
@@ -118,6 +142,10 @@ class SpecAndersAnalysis {
 
   std::unordered_map<const llvm::Value *, PtstoSet> ptsCache_;
 
+  // Rebuilt with each solution
+  std::unique_ptr<AliasCache> aliasCache_;
+  RevPtstoIndex revPtsto_;
+
   // std::map<ObjectMap::ObjID, ObjectMap::ObjID> hcdPairs_;
   //}}}
 };
@@ -148,6 +176,8 @@ class SpecAndersWrapperPass : public llvm::ModulePass {
 
   void getAnalysisUsage(llvm::AnalysisUsage &usage) const;
 
+  void releaseMemory() override;
+
   llvm::StringRef getPassName() const override {
     return "SpecAnders";
   }
@@ -156,6 +186,7 @@ class SpecAndersWrapperPass : public llvm::ModulePass {
   const SpecAndersAAResult &getResult() const { return *result_; }
 
   const SpecAndersAnalysis &anders() const { return anders_; }
+  SpecAndersAnalysis &anders() { return anders_; }
 
  private:
   SpecAndersAnalysis anders_;
@@ -10,9 +10,11 @@
 #include <set>
 #include <vector>
 
+#include "include/AliasCache.h"
 #include "include/AndersGraph.h"
 #include "include/Assumptions.h"
 #include "include/ConstraintPass.h"
+#include "include/RevPtstoIndex.h"
 #include "include/lib/UnusedFunctions.h"
 #include "include/lib/IndirFcnTarget.h"
 
@@ -37,6 +39,8 @@ class SpecAndersCS : public llvm::ModulePass,
 
   void getAnalysisUsage(llvm::AnalysisUsage &usage) const;
 
+  void releaseMemory() override;
+
   /*
   virtual void *getAdjustedAnalysisPointer(llvm::AnalysisID PI) {
     if (PI == &AliasAnalysis::ID) {
@@ -113,6 +117,22 @@ class SpecAndersCS : public llvm::ModulePass,
     return graph_.getNode(rep_id).ptsto();
   }
 
+  // nullptr if |val| was never given an id, so we have no points-to set for
+  //   it
+  const PtstoSet *getPointsTo(const llvm::Value *val) {
+    if (graph_.cg().vals().getIds(val).empty()) {
+      return nullptr;
+    }
+    return ptsCacheGet(val);
+  }
+
+  // The sorted solver representatives whose points-to sets make up |val|'s.
+  //   Values with the same representatives have the same points-to set
+  std::vector<ValueMap::Id> getRepClass(const llvm::Value *val);
+
+  // The objects -> pointers transpose of the solution, built on first use
+  const RevPtstoIndex &getRevPtsto();
+
   ConstraintPass &getConstraintPass() {
     return *consPass_;
   }
@@ -157,6 +177,10 @@ class SpecAndersCS : public llvm::ModulePass,
 
   std::unordered_map<const llvm::Value *, PtstoSet> ptsCache_;
 
+  // Rebuilt with each solution
+  std::unique_ptr<AliasCache> aliasCache_;
+  RevPtstoIndex revPtsto_;
+
   // DynPtstoLoader *dynPts_;
   //}}}
 };
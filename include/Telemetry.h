@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#ifndef INCLUDE_TELEMETRY_H_
+#define INCLUDE_TELEMETRY_H_
+
+#include <cstdint>
+#include <string>
+
+// Structured performance telemetry for the analysis: nested phase timers
+//   (wall time, cpu time, peak rss), named counters, histograms and stats.
+//   Everything is written as JSON or CSV at exit, to the file given with
+//   -anders-telemetry.
+//
+// With no -anders-telemetry every entry point is an inlined test of one
+//   string, so call sites need no guards of their own
+namespace telemetry {
+
+namespace detail {
+// Storage for -anders-telemetry and -anders-profile-phase
+extern std::string Path;
+extern std::string ProfilePhase;
+
+void beginPhase(const std::string &name);
+void endPhase();
+void addCount(const char *name, int64_t delta);
+void addSample(const char *name, int64_t value);
+void setStat(const char *name, double value);
+}  // namespace detail
+
+inline bool enabled() {
+  return !detail::Path.empty();
+}
+
+inline void count(const char *name, int64_t delta = 1) {
+  if (enabled()) {
+    detail::addCount(name, delta);
+  }
+}
+
+// Adds |value| to the power-of-two bucketed histogram |name|
+inline void sample(const char *name, int64_t value) {
+  if (enabled()) {
+    detail::addSample(name, value);
+  }
+}
+
+// A one-off value, such as a final cache size
+inline void stat(const char *name, double value) {
+  if (enabled()) {
+    detail::setStat(name, value);
+  }
+}
+
+// Times the scope it lives in, as a child of the innermost enclosing Phase
+//   of the same thread.  -anders-profile-phase also runs the gperftools
+//   profiler over the phase of that name
+class Phase {
+  //{{{
+ public:
+  explicit Phase(const std::string &name) :
+      active_(enabled() || !detail::ProfilePhase.empty()) {
+    if (active_) {
+      detail::beginPhase(name);
+    }
+  }
+
+  ~Phase() {
+    if (active_) {
+      detail::endPhase();
+    }
+  }
+
+  Phase(const Phase &) = delete;
+  Phase &operator=(const Phase &) = delete;
+
+ private:
+  bool active_;
+  //}}}
+};
+
+// Writes everything recorded so far, this happens automatically at exit
+void write();
+
+}  // namespace telemetry
+
+#endif  // INCLUDE_TELEMETRY_H_
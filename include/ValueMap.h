@@ -7,6 +7,8 @@
 
 #include <cassert>
 
+#include <algorithm>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -118,15 +120,32 @@ class ValueMap {
   // Used when reading the function, if val does not exist, will create val, if
   //   it does exist will return the only id of val, if val has multiple ids
   //   will error in debug mode.
+  //
+  // Once other maps have been layered in, val must already be mapped (here or
+  //   in a layer), new ids are only handed out while populating
   Id getDef(const llvm::Value *val) {
+    if (!revLayers_.empty()) {
+      auto &index = getRevIndex();
+      auto layer_it = std::lower_bound(std::begin(index), std::end(index),
+          std::make_pair(val, Id(0)));
+      if (layer_it != std::end(index) && layer_it->first == val) {
+        assert(revMap_->count(val) == 0);
+        assert(std::next(layer_it) == std::end(index) ||
+            std::next(layer_it)->first != val);
+        return layer_it->second;
+      }
+    }
+
+    auto &rev_map = ownRevMap();
     // lb will be end when revMap is emtpy...
-    auto it = revMap_.find(val);
-    if (it == std::end(revMap_)) {
+    auto it = rev_map.find(val);
+    if (it == std::end(rev_map)) {
+      assert(revLayers_.empty());
       auto id = createMapping(val);
-      it = revMap_.emplace(val, id);
+      it = rev_map.emplace(val, id);
     }
 
-    assert(revMap_.count(val) == 1);
+    assert(rev_map.count(val) == 1);
 
     return it->second;
   }
@@ -153,12 +172,21 @@ class ValueMap {
       }
       ret.emplace(it->second);
     } else {
-      auto pr = revMap_.equal_range(val);
+      auto pr = revMap_->equal_range(val);
       for (auto it = pr.first, en=pr.second;
           it != en; ++it) {
         auto rep_id = getRep(it->second);
         ret.emplace(rep_id);
       }
+
+      if (!revLayers_.empty()) {
+        auto &index = getRevIndex();
+        auto it = std::lower_bound(std::begin(index), std::end(index),
+            std::make_pair(val, Id(0)));
+        for (; it != std::end(index) && it->first == val; ++it) {
+          ret.emplace(getRep(it->second));
+        }
+      }
     }
 
     return ret;
@@ -185,6 +213,14 @@ class ValueMap {
 
   util::ObjectRemap<Id> import(const ValueMap &rhs);
   util::ObjectRemap<Id> lowerAllocs();
+
+  // lowerAllocs() numbers allocations in allocSizes() order.  Each allocation
+  //   is a block of consecutive entries there (one per field), this permutes
+  //   whole blocks, |order| lists the blocks by their current position
+  void reorderAllocs(const std::vector<size_t> &order);
+
+  // The allocation blocks, as (first entry in allocSizes(), field count)
+  std::vector<std::pair<size_t, size_t>> allocBlocks() const;
   //}}}
 
   // Misc {{{
@@ -249,11 +285,32 @@ class ValueMap {
   //}}}
 
  private:
+  typedef std::unordered_multimap<const llvm::Value *, Id> RevMap;
+
+  // Reverse mappings brought in by import() are shared with the map they came
+  //   from instead of copied.  Each layer is another map's own entries, plus
+  //   the remap of that map's ids into ours
+  struct RevLayer {
+    std::shared_ptr<const RevMap> rev;
+    std::shared_ptr<const std::vector<Id>> remap;
+  };
+
   // Private helpers {{{
   Id nextId() const {
     return Id(map_.size());
   }
 
+  // Our own reverse mappings may be shared with copies of this map, or
+  //   layers of other maps, so unshare them before writing
+  RevMap &ownRevMap() {
+    if (revMap_.use_count() > 1) {
+      revMap_ = std::make_shared<RevMap>(*revMap_);
+    }
+    return *revMap_;
+  }
+
+  const std::vector<std::pair<const llvm::Value *, Id>> &getRevIndex() const;
+
   Id createMapping(const llvm::Value *val) {
     auto next_id = nextId();
     map_.emplace_back(val);
@@ -266,6 +323,8 @@ class ValueMap {
   }
   //}}}
 
+  friend class CgDiskCache;
+
   // Global values are noted
   std::unordered_map<std::string, Id> named_;
 
@@ -275,7 +334,11 @@ class ValueMap {
   Id maxReserveAllocId_;
 
   std::unordered_map<const llvm::Constant *, Id> constMap_;
-  std::unordered_multimap<const llvm::Value *, Id> revMap_;
+  std::shared_ptr<RevMap> revMap_ = std::make_shared<RevMap>();
+  std::vector<RevLayer> revLayers_;
+  // Sorted (value, id) pairs over every layer, built on first use by getIds()
+  mutable std::vector<std::pair<const llvm::Value *, Id>> revIndex_;
+  mutable bool revIndexValid_ = false;
   std::unordered_map<const llvm::Value *, std::vector<Id>> allocRevMap_;
   std::vector<const llvm::Value *> map_;
 
@@ -41,6 +41,15 @@ class BBNumber : public llvm::ModulePass {
     return ret_id;
   }
 
+  // Id::invalid() if |bb| was never numbered
+  Id findId(const llvm::BasicBlock *bb) const {
+    auto it = revMapping_.find(bb);
+    if (it == std::end(revMapping_)) {
+      return Id::invalid();
+    }
+    return it->second;
+  }
+
   const llvm::BasicBlock *getBB(Id id) const {
     assert(static_cast<size_t>(id) < mapping_.size());
     return mapping_[static_cast<size_t>(id)];
@@ -18,11 +18,19 @@
 #include <utility>
 #include <vector>
 
+namespace llvm {
+class raw_ostream;
+}  // namespace llvm
+
 class default_bdd_tag { };
 
 // in lib/BddSet.cpp
 extern int32_t g_num_doms;
-void bdd_init_once(int num_doms);
+// |size_hint| is roughly how many elements and constraints the sets will
+//   hold, it sizes the node table on the first call
+void bdd_init_once(int num_doms, size_t size_hint = 0);
+// Node table, GC and resize stats
+void bdd_print_stats(llvm::raw_ostream &o);
 
 // Okay, what do I need to know to setup the bdd domain
 template <typename id_type, typename tag = default_bdd_tag>
@@ -498,7 +506,7 @@ template <typename id_type, typename tag>
 void BddSet<id_type, tag>::Setup(int32_t domain_size) {
   assert(bddDom_ == -1);
   // add one dom
-  bdd_init_once(1);
+  bdd_init_once(1, static_cast<size_t>(domain_size));
   bddInitd_ = true;
   domainSize_ = domain_size;
   // Do extdomain...
@@ -23,7 +23,19 @@
 #include "llvm/Support/Debug.h"
 
 class CallContextLoader : public llvm::ModulePass {
+ private:
+  struct node_id_tag {};
+  struct shape_id_tag {};
+
  public:
+  // Handle to a node in the prefix trie of the loaded call stacks
+  //   A node represents every loaded stack starting with its call-string
+  typedef util::ID<node_id_tag, int32_t, -1> NodeId;
+
+  // Trie nodes with the same shape have isomorphic subtrees: any sequence of
+  //   frames valid below one node is valid below the other
+  typedef util::ID<shape_id_tag, int32_t, -1> ShapeId;
+
   static char ID;
   CallContextLoader();
 
@@ -39,33 +51,61 @@ class CallContextLoader : public llvm::ModulePass {
     return loaded_ && enabled_;
   }
 
-  bool isValid(const std::vector<CsCFG::Id> &check) const {
-    assert(hasDynData());
-    auto it = std::lower_bound(std::begin(callsites_), std::end(callsites_),
-        check);
+  // Prefix trie queries {{{
+  // The node of the empty stack
+  static NodeId root() {
+    return NodeId(0);
+  }
 
-    if (it == std::end(callsites_)) {
-      return false;
+  // Returns the node of |parent| with |frame| pushed on top, or
+  //   NodeId::invalid() if no loaded stack starts with that call-string
+  //   O(1), invalid parents stay invalid
+  NodeId extend(NodeId parent, CsCFG::Id frame) const {
+    assert(hasDynData());
+    if (parent == NodeId::invalid()) {
+      return NodeId::invalid();
     }
 
-    auto &dyn_check = *it;
-    if (dyn_check.size() < check.size()) {
-      return false;
+    auto it = edges_.find(TrieKey(parent, frame));
+    if (it == std::end(edges_)) {
+      return NodeId::invalid();
     }
 
-    auto dyn_it = std::begin(dyn_check);
-    for (auto elm : check) {
-      auto dyn_elm = *dyn_it;
+    return it->second;
+  }
 
-      if (elm != dyn_elm) {
-        return false;
+  // O(depth) walk from the root
+  NodeId find(const std::vector<CsCFG::Id> &stack) const {
+    auto ret = root();
+    for (auto frame : stack) {
+      ret = extend(ret, frame);
+      if (ret == NodeId::invalid()) {
+        break;
       }
+    }
 
-      ++dyn_it;
+    return ret;
+  }
+
+  bool isValid(NodeId node) const {
+    assert(hasDynData());
+    return node != NodeId::invalid();
+  }
+
+  // A stack is valid if it is a (non-strict) prefix of a loaded stack
+  bool isValid(const std::vector<CsCFG::Id> &check) const {
+    return isValid(find(check));
+  }
+
+  // Invalid nodes have no shape
+  ShapeId getShape(NodeId node) const {
+    if (node == NodeId::invalid()) {
+      return ShapeId::invalid();
     }
 
-    return true;
+    return shapes_[static_cast<size_t>(node)];
   }
+  //}}}
 
   CsCFG::Id getMainContext() const {
     return CsCFG::Id(0);
@@ -76,20 +116,26 @@ class CallContextLoader : public llvm::ModulePass {
     return index_.at(id);
   }
 
+  // Returns all loaded stacks beginning with |prefix|
   std::vector<const std::vector<CsCFG::Id> *>
   getAllContexts(const std::vector<CsCFG::Id> &prefix) const {
-    // Get lower & upper bounds
-    auto lower_it = std::lower_bound(
-        std::begin(callsites_), std::end(callsites_),
-        prefix);
-    auto upper_it = std::upper_bound(
-        std::begin(callsites_), std::end(callsites_),
-        prefix);
-
-    // Return new vector containing data
-    std::vector<const std::vector<CsCFG::Id> *>
-        ret(std::distance(lower_it, upper_it));
+    return getAllContexts(find(prefix));
+  }
 
+  std::vector<const std::vector<CsCFG::Id> *>
+  getAllContexts(NodeId node) const {
+    std::vector<const std::vector<CsCFG::Id> *> ret;
+    if (node == NodeId::invalid()) {
+      return ret;
+    }
+
+    // The loaded stacks are sorted, so all stacks sharing a prefix are
+    //   adjacent
+    auto &trie_node = nodes_[static_cast<size_t>(node)];
+    auto lower_it = std::next(std::begin(callsites_), trie_node.first);
+    auto upper_it = std::next(std::begin(callsites_), trie_node.last);
+
+    ret.resize(std::distance(lower_it, upper_it));
     std::transform(lower_it, upper_it, std::begin(ret),
         [] (const std::vector<CsCFG::Id> &v) {
           return &v;
@@ -102,6 +148,14 @@ class CallContextLoader : public llvm::ModulePass {
     return callsites_.size();
   }
 
+  size_t numTrieNodes() const {
+    return nodes_.size();
+  }
+
+  size_t numShapes() const {
+    return numShapes_;
+  }
+
   void disable() {
     enabled_ = false;
   }
@@ -111,12 +165,51 @@ class CallContextLoader : public llvm::ModulePass {
   }
 
  private:
+  void buildTrie();
+
+  // The range of callsites_ which pass through a trie node
+  struct TrieNode {
+    TrieNode(uint32_t f, uint32_t l) : first(f), last(l) { }
+    uint32_t first;
+    uint32_t last;
+  };
+
+  struct TrieKey {
+    struct hasher {
+      size_t operator()(const TrieKey &k1) const {
+        auto ret = NodeId::hasher()(k1.parent);
+
+        ret ^= ret << 11;
+        ret ^= CsCFG::Id::hasher()(k1.frame);
+
+        return ret;
+      }
+    };
+
+    TrieKey(NodeId p, CsCFG::Id f) : parent(p), frame(f) { }
+
+    bool operator==(const TrieKey &rhs) const {
+      return parent == rhs.parent && frame == rhs.frame;
+    }
+
+    NodeId parent;
+    CsCFG::Id frame;
+  };
+
   bool loaded_ = false;
   bool enabled_ = true;
   // Get all callsites containing a (non-strict) partial stack
   // Keep sorted, to do prefix lookup
   std::vector<std::vector<CsCFG::Id>> callsites_;
 
+  // Prefix trie over callsites_, child edges hashed on (parent, frame)
+  std::vector<TrieNode> nodes_;
+  std::unordered_map<TrieKey, NodeId, TrieKey::hasher> edges_;
+
+  // The (hash-consed) subtree shape of each trie node
+  std::vector<ShapeId> shapes_;
+  size_t numShapes_ = 0;
+
   // Also keep map, to do by-id lookup:
   std::unordered_map<CsCFG::Id, std::vector<const std::vector<CsCFG::Id> *>>
     index_;
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015 David Devecsery
+ */
+
+#ifndef INCLUDE_LIB_CONTROLDEPS_H_
+#define INCLUDE_LIB_CONTROLDEPS_H_
+
+#include <vector>
+
+#include "include/util.h"
+#include "include/lib/BBNumber.h"
+#include "include/lib/UnusedFunctions.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/iterator_range.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Debug.h"
+
+// Builds the control-dependence graph of all (used) BBs in the module
+//   The graph is indexed by BBNumber::Id, and stored as a compressed adjacency
+//   array (offsets into a flat edge list), so a lookup is a single scan of a
+//   contiguous range
+class ControlDeps : public llvm::ModulePass {
+ public:
+  typedef BBNumber::Id Id;
+  typedef llvm::iterator_range<const Id *> dep_range;
+
+  static char ID;
+  ControlDeps();
+
+  void getAnalysisUsage(llvm::AnalysisUsage &usage) const;
+
+  virtual bool runOnModule(llvm::Module &m);
+
+  llvm::StringRef getPassName() const override {
+    return "ControlDeps";
+  }
+
+  // Returns the BBs whose terminators decide if |id| executes
+  dep_range getDeps(Id id) const {
+    auto idx = static_cast<size_t>(id);
+    assert(idx + 1 < offsets_.size());
+    const Id *base = deps_.data();
+    return dep_range(base + offsets_[idx], base + offsets_[idx+1]);
+  }
+
+  // Blocks which were never numbered (e.g. unreachable ones) have no deps
+  dep_range getDeps(const llvm::BasicBlock *bb) const {
+    auto id = bbNum_->findId(bb);
+    if (id == Id::invalid()) {
+      return dep_range(deps_.data(), deps_.data());
+    }
+    return getDeps(id);
+  }
+
+  size_t numDeps() const {
+    return deps_.size();
+  }
+
+ private:
+  const BBNumber *bbNum_ = nullptr;
+
+  // deps_[offsets_[i]] .. deps_[offsets_[i+1]] are the controlling BBs of BB i
+  std::vector<uint32_t> offsets_;
+  std::vector<Id> deps_;
+};
+
+#endif  // INCLUDE_LIB_CONTROLDEPS_H_
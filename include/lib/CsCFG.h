@@ -5,8 +5,12 @@
 #ifndef INCLUDE_LIB_CSCFG_H_
 #define INCLUDE_LIB_CSCFG_H_
 
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <set>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "include/util.h"
@@ -15,6 +19,7 @@
 #include "include/lib/UnusedFunctions.h"
 #include "include/lib/IndirFcnTarget.h"
 
+#include "llvm/ADT/iterator_range.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Function.h"
 #include "llvm/Analysis/AliasAnalysis.h"
@@ -94,16 +99,95 @@ class CsCFG : public llvm::ModulePass {
     return csGraph_.getNode<CsNode>(seg_id).reps();
   }
 
-  const std::vector<std::vector<Id>> &findPathsFromMain(Id end) const;
+  // Lazily enumerates the call paths from main to a node, main first.
+  //   Only the current path (and one cursor per frame) is held in memory
+  class PathIterator
+      : public std::iterator<std::forward_iterator_tag,
+                             const std::vector<Id>> {
+    //{{{
+   public:
+    // The end iterator
+    PathIterator() = default;
+    PathIterator(const CsCFG &cfg, Id end);
+
+    const std::vector<Id> &operator*() const {
+      return path_;
+    }
+
+    const std::vector<Id> *operator->() const {
+      return &path_;
+    }
+
+    PathIterator &operator++() {
+      advance();
+      return *this;
+    }
+
+    PathIterator operator++(int) {
+      PathIterator tmp(*this);
+      advance();
+      return tmp;
+    }
+
+    bool operator==(const PathIterator &rhs) const {
+      return cursors_ == rhs.cursors_;
+    }
+
+    bool operator!=(const PathIterator &rhs) const {
+      return !(*this == rhs);
+    }
+
+   private:
+    // For each frame from |end| down to main: the frame's node, and the
+    //   index of the pred currently taken
+    typedef std::pair<Id, uint32_t> Cursor;
+
+    // Descends from the top cursor to main, taking the first pred of each
+    //   frame which reaches main
+    void descend();
+    void advance();
+    void buildPath();
+
+    const CsCFG *cfg_ = nullptr;
+    std::vector<Cursor> cursors_;
+    std::vector<Id> path_;
+    //}}}
+  };
+
+  typedef llvm::iterator_range<PathIterator> PathRange;
+
+  // Path counts saturate at this value
+  static constexpr uint64_t MaxPathCount =
+    std::numeric_limits<uint64_t>::max() - 1;
+
+  // The number of call paths from main to |end|, computed by DP over the
+  //   (SCC-collapsed) callsite graph without enumerating any paths
+  uint64_t numPathsFromMain(Id end) const;
+
+  // All call paths from main to |end|, generated on demand
+  PathRange pathsFromMain(Id end) const {
+    if (numPathsFromMain(end) == 0) {
+      return PathRange(PathIterator(), PathIterator());
+    }
+
+    return PathRange(PathIterator(*this, end), PathIterator());
+  }
+
+  // The |n|th path (in pathsFromMain() order) from main to |end|, used to
+  //   sample paths without enumerating those before it
+  std::vector<Id> getPathFromMain(Id end, uint64_t n) const;
 
   size_t size() const {
     return csGraph_.getNumNodes();
   }
 
  private:
-  void findPath(const CsNode &node, Id end,
-      std::unordered_map<Id, std::vector<std::vector<Id>>, Id::hasher> &cache)
-    const;
+  static constexpr uint64_t UnknownPathCount =
+    std::numeric_limits<uint64_t>::max();
+
+  uint64_t pathCount(Id id) const {
+    return pathCounts_[static_cast<size_t>(id)];
+  }
 
   SEG csGraph_;
 
@@ -111,8 +195,8 @@ class CsCFG : public llvm::ModulePass {
 
   std::unordered_map<const llvm::Instruction *, SEG::NodeID> csMap_;
 
-  mutable std::unordered_map<Id, std::vector<std::vector<Id>>, Id::hasher>
-    pathCache_;
+  // Memoized number of paths from main to each node, filled on demand
+  mutable std::vector<uint64_t> pathCounts_;
 };
 
 #endif  // INCLUDE_LIB_CSCFG_H_
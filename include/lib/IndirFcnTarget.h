@@ -5,6 +5,8 @@
 #ifndef INCLUDE_LIB_INDIRFCNTARGET_H__
 #define INCLUDE_LIB_INDIRFCNTARGET_H__
 
+#include <map>
+#include <unordered_set>
 #include <vector>
 
 #include "llvm/Pass.h"
@@ -29,6 +31,11 @@ class IndirFunctionInfo : public llvm::ModulePass {
       return hasInfo_ && enabled_;
     }
 
+    // False if we've stopped speculating on the targets of |call|
+    bool hasInfo(const llvm::Value *call) const {
+      return hasInfo() && unspeculated_.count(call) == 0;
+    }
+
     const std::vector<const llvm::Value *> &
     getTargets(const llvm::Value *val) const {
       auto it = callToTarget_.find(val);
@@ -49,6 +56,12 @@ class IndirFunctionInfo : public llvm::ModulePass {
       return ret;
     }
 
+    // Stops speculating on the targets of |call|, it's resolved as any other
+    //   indirect call instead
+    void stopSpeculating(const llvm::Value *call) {
+      unspeculated_.insert(call);
+    }
+
     void disable() {
       enabled_ = false;
     }
@@ -60,6 +73,7 @@ class IndirFunctionInfo : public llvm::ModulePass {
  private:
     std::map<const llvm::Value *, std::vector<const llvm::Value *>>
       callToTarget_;
+    std::unordered_set<const llvm::Value *> unspeculated_;
 
     bool hasInfo_;
     bool enabled_ = true;
@@ -16,12 +16,16 @@
 #include <limits>
 #include <list>
 #include <memory>
+#include <new>
 #include <numeric>
 #include <set>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "include/Debug.h"
+#include "include/Telemetry.h"
 #include "llvm/Support/Debug.h"
 
 #ifdef SPECSFS_NOTIMERS
@@ -240,8 +244,9 @@ class PerfTimerTick {
 class PerfTimerPrinter {
   //{{{
  public:
+    // Also recorded as a telemetry::Phase
     explicit PerfTimerPrinter(llvm::raw_ostream &o, std::string name) :
-        o_(o), name_(std::move(name)) {
+        o_(o), name_(std::move(name)), phase_(name_) {
       if_timers(
       timer_.start();
       o << name_ << ": timer start\n");
@@ -257,6 +262,7 @@ class PerfTimerPrinter {
     llvm::raw_ostream &o_;
     PerfTimer timer_;
     std::string name_;
+    telemetry::Phase phase_;
   //}}}
 };
 //}}}
@@ -1088,6 +1094,80 @@ class SlabAlloc : std::allocator<T> {
 //}}}
 //}}}
 
+// Segmented Array {{{
+// Append-only array of T, backed by fixed-size chunks that are allocated on
+//   demand.  Element addresses are stable for the life of the array (we never
+//   move a chunk), so callers may hold references across emplace_back()
+template <typename T, size_t log_chunk_size = 16>
+class SegmentedArray {
+  //{{{
+ public:
+  static const size_t ChunkSize = 1 << log_chunk_size;
+
+  SegmentedArray() = default;
+
+  SegmentedArray(const SegmentedArray &) = delete;
+  SegmentedArray &operator=(const SegmentedArray &) = delete;
+
+  ~SegmentedArray() {
+    for (size_t i = 0; i < size_; ++i) {
+      (*this)[i].~T();
+    }
+  }
+
+  template <typename... va_args>
+  T &emplace_back(va_args&&... args) {
+    if (size_ == capacity()) {
+      chunks_.emplace_back(new chunk_storage[ChunkSize]);
+    }
+
+    T *ret = new (slot(size_)) T(std::forward<va_args>(args)...);
+    size_++;
+    return *ret;
+  }
+
+  T &operator[](size_t idx) {
+    assert(idx < size_);
+    return *reinterpret_cast<T *>(slot(idx));
+  }
+
+  const T &operator[](size_t idx) const {
+    assert(idx < size_);
+    return *reinterpret_cast<const T *>(
+        &chunks_[idx >> log_chunk_size][idx & (ChunkSize-1)]);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t capacity() const {
+    return chunks_.size() * ChunkSize;
+  }
+
+  // Bytes actually committed for elements
+  size_t memUsage() const {
+    return capacity() * sizeof(T);
+  }
+
+ private:
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type
+    chunk_storage;
+
+  void *slot(size_t idx) {
+    return &chunks_[idx >> log_chunk_size][idx & (ChunkSize-1)];
+  }
+
+  std::vector<std::unique_ptr<chunk_storage[]>> chunks_;
+  size_t size_ = 0;
+  //}}}
+};
+//}}}
+
 // Sparse BitMap {{{
 template <size_t bits_per_field>
 class BitmapNode {
@@ -1326,6 +1406,15 @@ class SparseBitmap {
   void clear() {
     elms_.clear();
   }
+
+  // Swaps contents without copying (curElm_ may be a list's end(), which
+  //   doesn't move with the contents, so it's reset)
+  void swap(SparseBitmap &rhs) {
+    std::swap(alloc_, rhs.alloc_);
+    elms_.swap(rhs.elms_);
+    curElm_ = std::begin(elms_);
+    rhs.curElm_ = std::begin(rhs.elms_);
+  }
   //}}}
 
   // Accessors {{{
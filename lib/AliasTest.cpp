@@ -35,6 +35,12 @@ static llvm::cl::opt<bool>
       llvm::cl::desc("AliasTest will count the dynamic load-store "
         "alias loader"));
 
+static llvm::cl::opt<unsigned>
+  alias_threads("alias-threads", llvm::cl::init(1),
+      llvm::cl::value_desc("unsigned"),
+      llvm::cl::desc("Threads AliasTest answers alias queries on, 0 uses "
+        "one per core"));
+
 class AliasTest : public llvm::ModulePass {
  public:
   static char ID;
@@ -124,59 +130,42 @@ class AliasTest : public llvm::ModulePass {
       }
     } else {
       auto &aa = getAnalysis<ModuleAAResults>();
+      auto count = [&num_may_alias, &num_must_alias, &num_no_alias]
+          (size_t may, size_t must, size_t no) {
+        num_may_alias += may;
+        num_must_alias += must;
+        num_no_alias += no;
+      };
+
       if (only_load_store) {
+        // Check if each load aliases with each store
+        std::vector<llvm::MemoryLocation> load_locs;
         for (auto li : load_list) {
-          auto load_src = li->getOperand(0);
-          for (auto si : store_list) {
-            // Check if the load aliases with a store
-            auto store_dest = si->getOperand(1);
-
-            auto alias = aa.alias(llvm::MemoryLocation(load_src, 1),
-                 llvm::MemoryLocation(store_dest, 1));
-
-            num_checked++;
-            if (alias == llvm::AliasResult::MayAlias) {
-              num_may_alias++;
-            }
-
-            if (alias == llvm::AliasResult::MustAlias) {
-              num_must_alias++;
-            }
-
-            if (alias == llvm::AliasResult::NoAlias) {
-              num_no_alias++;
-            }
-          }
+          load_locs.emplace_back(li->getOperand(0), 1);
         }
+        std::vector<llvm::MemoryLocation> store_locs;
+        for (auto si : store_list) {
+          store_locs.emplace_back(si->getOperand(1), 1);
+        }
+
+        auto mat = aa.aliasMatrix(load_locs, store_locs, alias_threads);
+        num_checked += mat.rows() * mat.cols();
+        count(mat.count(llvm::AliasResult::MayAlias),
+            mat.count(llvm::AliasResult::MustAlias),
+            mat.count(llvm::AliasResult::NoAlias));
       } else {
         llvm::dbgs() << "AliasTest: Counting Aliases\n";
-        // Now, iterate the list
-        // For each value to check
         {
           util::PerfTimerPrinter t(llvm::dbgs(), "Counting Aliases");
-          for (auto it = std::begin(value_list), en = std::end(value_list);
-              it != en; ++it) {
-            auto base_val = *it;
-            // Check against all values not yet checked (O(n^2))
-            for (auto it2 = it+1; it2 != en; ++it2) {
-              auto check_val = *it2;
-              auto alias = aa.alias(llvm::MemoryLocation(base_val, 1),
-                   llvm::MemoryLocation(check_val, 1));
-
-              num_checked++;
-              if (alias == llvm::AliasResult::MayAlias) {
-                num_may_alias++;
-              }
-
-              if (alias == llvm::AliasResult::MustAlias) {
-                num_must_alias++;
-              }
-
-              if (alias == llvm::AliasResult::NoAlias) {
-                num_no_alias++;
-              }
-            }
+          std::vector<llvm::MemoryLocation> locs;
+          for (auto val : value_list) {
+            locs.emplace_back(val, 1);
           }
+
+          // Check each value against all values after it (O(n^2))
+          auto counts = aa.aliasPairCounts(locs, alias_threads);
+          num_checked += counts.pairs;
+          count(counts.mayAlias, counts.mustAlias, counts.noAlias);
         }
       }
     }
@@ -67,7 +67,7 @@ BasicFcnCFG::BasicFcnCFG(llvm::Module &m, DynamicInfo &di) {
             }
           // Unless we have indir info
           } else {
-            if (indir_info.hasInfo()) {
+            if (indir_info.hasInfo(ci)) {
               // Don't bother w/ inline asm...
               if (!llvm::isa<llvm::InlineAsm>(cs.getCalledValue())) {
                 auto &dests = indir_info.getTargets(ci);
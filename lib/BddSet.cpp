@@ -8,26 +8,126 @@
 #include <bvec.h>
 #include <fdd.h>
 
+#include <ctime>
+
+#include <algorithm>
+#include <limits>
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "include/Telemetry.h"
+
+static llvm::cl::opt<int32_t> //  NOLINT
+  bdd_max_mb("anders-bdd-max-mb", llvm::cl::init(0),
+      llvm::cl::value_desc("MB"),
+      llvm::cl::desc("Caps the memory of the BDD node table and operator "
+        "caches, in MB (0 is unlimited)"));
+
 static bool bdd_initd = false;
 
 int32_t g_num_doms = 0;
 
-void bdd_init_once(int num_doms) {
+// Node table sizing {{{
+// A BuDDy node is 20 bytes, each operator cache entry 16.  BuDDy keeps six
+//   operator caches (apply, ite, quant, appex, replace and misc), each sized
+//   by the cache ratio
+static const size_t BddNodeBytes = 20;
+static const size_t BddCacheEntryBytes = 16;
+static const size_t BddNumCaches = 6;
+
+static const int32_t MinBddNodes = 1 << 16;
+static const int32_t MaxInitBddNodes = 1 << 24;
+// Expected live nodes per set member/constraint of the problem
+static const size_t BddNodesPerElement = 4;
+//}}}
+
+// GC/resize stats {{{
+static int32_t bdd_num_resizes = 0;
+static int32_t bdd_table_size = 0;
+static int32_t bdd_peak_nodes = 0;
+static int32_t bdd_last_gc_num = 0;
+static long bdd_gc_ticks = 0;  // NOLINT
+
+static void bdd_gc_handler(int pre, bddGbcStat *stat) {
+  if (pre) {
+    bdd_peak_nodes = std::max(bdd_peak_nodes, stat->nodes - stat->freenodes);
+  } else {
+    bdd_last_gc_num = stat->num;
+    bdd_gc_ticks = stat->sumtime;
+  }
+}
+
+static void bdd_resize_handler(int, int new_size) {
+  bdd_num_resizes++;
+  bdd_table_size = new_size;
+}
+//}}}
+
+void bdd_init_once(int num_doms, size_t size_hint) {
   g_num_doms += num_doms;
   if (bdd_initd) {
     return;
   }
   bdd_initd = true;
 
+  // Size the node table for the problem, so small modules don't pay for a
+  //   huge table and big ones don't start with a long run of resizes
+  size_t want_nodes = std::max<size_t>(size_hint * BddNodesPerElement,
+      MinBddNodes);
+  int32_t init_nodes = MinBddNodes;
+  while (init_nodes < MaxInitBddNodes &&
+      static_cast<size_t>(init_nodes) < want_nodes) {
+    init_nodes <<= 1;
+  }
+
+  // Small tables can afford a relatively larger operator cache
+  int32_t cache_ratio = (init_nodes >= (1 << 22)) ? 8 : 4;
+
+  int32_t max_nodes = 0;
+  if (bdd_max_mb > 0) {
+    auto bytes_per_node = BddNodeBytes +
+      (BddNumCaches * BddCacheEntryBytes) / cache_ratio;
+    max_nodes = static_cast<int32_t>(std::min<size_t>(
+          (static_cast<size_t>(bdd_max_mb) << 20) / bytes_per_node,
+          std::numeric_limits<int32_t>::max()));
+    init_nodes = std::min(init_nodes, max_nodes);
+  }
+
   // Now, we initialize the bdd library
-  bdd_init((1<<23), 1000);
+  bdd_init(init_nodes, 1000);
+  bdd_table_size = init_nodes;
 
   // We set some performance variables
-  bdd_setcacheratio(8);
+  bdd_setcacheratio(cache_ratio);
   bdd_setminfreenodes(40);
-  bdd_setmaxnodenum(0);
-  bdd_gbc_hook(NULL);
+  bdd_setmaxnodenum(max_nodes);
+  bdd_gbc_hook(bdd_gc_handler);
+  bdd_resize_hook(bdd_resize_handler);
 
   // We disable reordering, because we rely on ordering
   bdd_disable_reorder();
 }
+
+void bdd_print_stats(llvm::raw_ostream &o) {
+  if (!bdd_initd) {
+    return;
+  }
+
+  auto live_nodes = bdd_getnodenum();
+  bdd_peak_nodes = std::max(bdd_peak_nodes, live_nodes);
+  o << "BDD stats:\n";
+  o << "  table nodes: " << bdd_table_size << " (" << bdd_num_resizes <<
+    " resizes)\n";
+  o << "  live nodes: " << live_nodes << ", peak: " << bdd_peak_nodes << "\n";
+  o << "  gcs: " << bdd_last_gc_num << ", gc time: " <<
+    static_cast<double>(bdd_gc_ticks) / CLOCKS_PER_SEC << "s\n";
+
+  telemetry::stat("bdd.table_nodes", bdd_table_size);
+  telemetry::stat("bdd.resizes", bdd_num_resizes);
+  telemetry::stat("bdd.live_nodes", live_nodes);
+  telemetry::stat("bdd.peak_nodes", bdd_peak_nodes);
+  telemetry::stat("bdd.gcs", bdd_last_gc_num);
+  telemetry::stat("bdd.gc_secs",
+      static_cast<double>(bdd_gc_ticks) / CLOCKS_PER_SEC);
+}
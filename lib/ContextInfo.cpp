@@ -23,7 +23,8 @@ typedef ContextInfo::StackId StackId;
 typedef ContextInfo::ContextId ContextId;
 
 char ContextInfo::ID = 0;
-ContextInfo::ContextInfo() : llvm::ModulePass(ID), cache_(info_) { }
+ContextInfo::ContextInfo() : llvm::ModulePass(ID), cache_(info_),
+    stackCache_(info_) { }
 
 /*
  *    How do we determine which stores may provide a load l?
@@ -251,86 +252,72 @@ void ContextInfo::Context::populateLocal() const {
 }
 
 // Constructor... setup noContext_ context
-ContextInfo::ContextCache::ContextCache(ExternalInfo &info) : info_(info),
-    contextMem_(new int8_t[sizeof(Context) * MaxContexts]),
-    contexts_(reinterpret_cast<Context *>(contextMem_.get())) { }
+ContextInfo::ContextCache::ContextCache(ExternalInfo &info) : info_(info) { }
 
 ContextId ContextInfo::ContextCache::find(
     const llvm::Value *val,
     StackId stack,
     const ContextInfo &info) {
-  auto id_num = contextSize_;
+  auto id_num = contexts_.size();
   auto rc = cache_.emplace(std::piecewise_construct,
       std::make_tuple(val, stack), std::make_tuple(id_num));
 
   if (rc.second) {
-    // contexts_.emplace_back(val, stack, ContextId(id_num), info);
-    // This line constructs the context in the array... yeah...
-    new (&contexts_[contextSize_]) Context(val, stack, ContextId(id_num), info);
-    contextSize_++;
-    assert(contextSize_ < MaxContexts);
-    assert(contextSize_ == id_num+1);
+    contexts_.emplace_back(val, stack, ContextId(id_num), info);
+    assert(contexts_.size() == id_num+1);
   }
 
   auto it = rc.first;
   return ContextId(it->second);
 }
 
-StackId ContextInfo::StackCache::find(
-    const std::vector<CsCFG::Id> &stack) {
-  // Construct a bdd out of it?
-  StackSet s;
-  // llvm::dbgs() << "Making set\n";
-  for (auto &elm : stack) {
-    s.set(elm);
+StackId ContextInfo::StackCache::push(StackId parent, CsCFG::Id frame) {
+  auto val = StackId(stacks_.size() + NumReservedStacks);
+  auto rc = children_.emplace(std::piecewise_construct,
+      std::make_tuple(parent, frame), std::make_tuple(val));
+  if (rc.second) {
+    auto &parent_stack = getStack(parent);
+
+    CallContextLoader::NodeId dyn_node;
+    auto stack_info = info_.stack_info;
+    if (stack_info != nullptr && stack_info->hasDynData()) {
+      dyn_node = stack_info->extend(parent_stack.dynNode(), frame);
+    }
+
+    stacks_.emplace_back(parent, frame, parent_stack.depth() + 1, val,
+        dyn_node);
+    assert(stacks_.size() + NumReservedStacks == static_cast<size_t>(val)+1);
   }
-  // llvm::dbgs() << "Done making set\n";
 
-  auto val = stackSize_;
-  auto rc = cache_.emplace(s.id(), val);
-  if (rc.second) {
-    // Make entry in stacks_
-    /*
-    stacks_.emplace_back(stack, StackId(val));
-    assert(stacks_.size() == val+1);
-    */
-    new (&stacks_[stackSize_]) StackInfo(stack, s, StackId(val));
-    stackSize_++;
-    assert(stackSize_ < MaxStacks);
-    assert(stackSize_ == val+1);
+  return rc.first->second;
+}
+
+StackId ContextInfo::StackCache::find(
+    const std::vector<CsCFG::Id> &stack) {
+  auto ret = StackInfo::Empty();
+  for (auto frame : stack) {
+    ret = push(ret, frame);
   }
 
-  auto it = rc.first;
-  return StackId(it->second);
+  return ret;
 }
 
-StackId ContextInfo::StackInfo::parentId(
-    StackCache &cache) const {
-  if (parentId_ == StackId::invalid()) {
-    // Populate parentId
-    auto parent_stack = stack();
-    if (parent_stack.size() > 0) {
-      parent_stack.pop_back();
+std::vector<CsCFG::Id> ContextInfo::StackCache::getFrames(StackId id) const {
+  auto *stack = &getStack(id);
+  std::vector<CsCFG::Id> ret(stack->depth());
 
-      // llvm::dbgs() << "stack is: " << util::print_iter(parent_stack) << "\n";
-      parentId_ = cache.find(parent_stack);
-    } else {
-      parentId_ = id();
-    }
+  for (auto it = ret.rbegin(), en = ret.rend(); it != en; ++it) {
+    *it = stack->frame();
+    stack = &getStack(stack->parentId());
   }
 
-  assert(parentId_ != StackId::invalid());
-
-  return parentId_;
+  assert(stack->empty());
+  return ret;
 }
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &o,
     const ContextInfo::StackInfo &stack) {
-  o << "{";
-  for (auto &elm : stack.stack()) {
-    o << " " << elm;
-  }
-  o << " }";
+  o << "{ " << stack.parentId() << " <- " << stack.frame() << " }";
   return o;
 }
 
@@ -351,30 +338,35 @@ ContextInfo::stackPush(ContextId context_id,
   //   next possible stacks are
   if (stack_id != StackInfo::NonCons()) {
     auto &stack = stackCache_.getStack(stack_id);
-    auto stack_vec = stack.stack();
 
     // Sometimes we can have backpointers... ensure we don't make a stack with
     //   those...
     auto new_id = csCFG_->getId(cs.getInstruction());
-    if (stack_vec.back() == new_id) {
+    if (stack.frame() == new_id) {
       return std::vector<ContextId>();
     }
 
-    // Add the instruction to the stack
-    stack_vec.push_back(new_id);
-
     // Make sure the stack is dynamically valid...
-    if (info_.stack_info->hasDynData()) {
-      if (!info_.stack_info->isValid(stack_vec)) {
+    auto &stack_info = *info_.stack_info;
+    if (stack_info.hasDynData()) {
+      auto dyn_node = stack.dynNode();
+      // Stacks interned while the dynamic data was disabled don't know their
+      //   trie node yet
+      if (dyn_node == CallContextLoader::NodeId::invalid()) {
+        dyn_node = stack_info.find(stackCache_.getFrames(stack_id));
+      }
+
+      if (!stack_info.isValid(stack_info.extend(dyn_node, new_id))) {
         /*
-        llvm::dbgs() << "have dynamically invalid push: " <<
-          util::print_iter(stack_vec) << "\n";
+        llvm::dbgs() << "have dynamically invalid push: " << stack <<
+          " + " << new_id << "\n";
         */
         return std::vector<ContextId>();
       }
     }
 
-    new_stack_id = stackCache_.find(stack_vec);
+    // Add the instruction to the stack
+    new_stack_id = stackCache_.push(stack_id, new_id);
   }
   /*
   llvm::dbgs() << "Got stack " << new_stack_id << " with vec:" <<
@@ -426,12 +418,14 @@ ContextInfo::getAllContexts(const llvm::Instruction *inst) const {
       // llvm::dbgs() << "have: " << callers.size() << " callers\n";
       for (auto &ci : callers) {
         assert(llvm::isa<llvm::CallInst>(ci));
-        auto &cs_paths = csCFG_->findPathsFromMain(csCFG_->getId(ci));
-        // llvm::dbgs() << "  caller has: " << cs_paths.size() << " paths\n";
+        auto cs_id = csCFG_->getId(ci);
+        // llvm::dbgs() << "  caller has: " <<
+        //   csCFG_->numPathsFromMain(cs_id) << " paths\n";
 
-        // Now, iterate each path in fcn_paths
+        // Now, iterate each path to the caller -- they're generated one at a
+        //   time, so we never hold the whole (potentially exponential) set
         // llvm::dbgs() << "cs_paths:\n";
-        for (auto &path : cs_paths) {
+        for (auto &path : csCFG_->pathsFromMain(cs_id)) {
           // llvm::dbgs() << "  " << util::print_iter(path) << "\n";
 
           if (info_.stack_info->hasDynData()) {
@@ -550,22 +544,21 @@ ContextInfo::stackPop(ContextId context_id) const {
   }
 
   auto &stack = stackCache_.getStack(stack_id);
-  // llvm::dbgs() << "Have stack: " << util::print_iter(stack.stack()) << "\n";
-
-  auto parent_id = stack.parentId(stackCache_);
-  // llvm::dbgs() << "Have parent_id: " << parent_id << "\n";
+  // llvm::dbgs() << "Have stack: " << stack << "\n";
 
-  if (parent_id == StackId::invalid()) {
-    return ret;
-  }
-
-  if (stack.stack().size() == 0) {
+  if (stack.empty()) {
     // llvm::dbgs() << "Empty stack\n";
     return ret;
   }
 
   // llvm::dbgs() << "getting contexts\n";
-  return getContexts(stack.stack().back(), parent_id);
+  return getContexts(stack.frame(), stack.parentId());
+}
+
+void ContextInfo::printStats(llvm::raw_ostream &o) const {
+  o << "ContextInfo: " << numContexts() << " contexts (" <<
+    cache_.memUsage() / (1024 * 1024) << " MB), " << numStacks() <<
+    " stacks (" << stackCache_.memUsage() / (1024 * 1024) << " MB)\n";
 }
 
 void ContextInfo::getAnalysisUsage(llvm::AnalysisUsage &usage) const {
@@ -593,8 +586,6 @@ bool ContextInfo::runOnModule(llvm::Module &m) {
 
   BBBddSet::Setup(info_.bb_num->numBBs());
   StoreBddSet::Setup(info_.si_num->numStores());
-  llvm::dbgs() << "providing size: " << csCFG_->size() << "\n";
-  StackSet::Setup(csCFG_->size());
 
   mainFcn_ = m.getFunction("main");
 
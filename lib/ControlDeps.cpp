@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015 David Devecsery
+ */
+
+#include "include/lib/ControlDeps.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "include/util.h"
+#include "include/lib/BBNumber.h"
+#include "include/lib/UnusedFunctions.h"
+
+#include "llvm/Pass.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Debug.h"
+
+char ControlDeps::ID = 0;
+ControlDeps::ControlDeps() : llvm::ModulePass(ID) { }
+
+void ControlDeps::getAnalysisUsage(llvm::AnalysisUsage &usage) const {
+  usage.addRequired<UnusedFunctions>();
+  usage.addRequired<BBNumber>();
+  usage.setPreservesAll();
+}
+
+bool ControlDeps::runOnModule(llvm::Module &m) {
+  auto &dyn_info = getAnalysis<UnusedFunctions>();
+  bbNum_ = &getAnalysis<BBNumber>();
+
+  std::vector<std::vector<Id>> bb_deps(bbNum_->numBBs());
+
+  // Standard post-dominator based construction (Ferrante et al.):
+  //   For each edge A->S where S doesn't post-dominate A, every node on the
+  //   post-dom tree path from S up to (but excluding) ipdom(A) is control
+  //   dependent on A's terminator
+  for (auto &fcn : m) {
+    if (fcn.isDeclaration() || !dyn_info.isUsed(fcn)) {
+      continue;
+    }
+
+    llvm::PostDominatorTree pdt;
+    pdt.recalculate(fcn);
+
+    for (auto &bb : fcn) {
+      if (!dyn_info.isUsed(bb)) {
+        continue;
+      }
+
+      auto bb_node = pdt.getNode(&bb);
+      // Not reachable from an exit (e.g. infinite loops), no post-dom info
+      if (bb_node == nullptr) {
+        continue;
+      }
+
+      auto bb_id = bbNum_->getId(&bb);
+      auto stop_node = bb_node->getIDom();
+
+      for (auto it = succ_begin(&bb), en = succ_end(&bb); it != en; ++it) {
+        auto succ = *it;
+        if (!dyn_info.isUsed(succ) || pdt.dominates(succ, &bb)) {
+          continue;
+        }
+
+        for (auto node = pdt.getNode(succ);
+            node != nullptr && node != stop_node;
+            node = node->getIDom()) {
+          auto dep_bb = node->getBlock();
+          // The virtual exit node has no block
+          if (dep_bb == nullptr) {
+            break;
+          }
+
+          if (dyn_info.isUsed(dep_bb)) {
+            bb_deps[static_cast<size_t>(bbNum_->getId(dep_bb))]
+              .push_back(bb_id);
+          }
+        }
+      }
+    }
+  }
+
+  // Flatten into the adjacency array
+  offsets_.reserve(bb_deps.size() + 1);
+  offsets_.push_back(0);
+  for (auto &deps : bb_deps) {
+    std::sort(std::begin(deps), std::end(deps));
+    auto it = std::unique(std::begin(deps), std::end(deps));
+    deps_.insert(std::end(deps_), std::begin(deps), it);
+    offsets_.push_back(deps_.size());
+
+    // Free as we go, this can be sizable for large modules
+    std::vector<Id>().swap(deps);
+  }
+
+  llvm::dbgs() << "ControlDeps: " << bbNum_->numBBs() << " bbs, " <<
+    deps_.size() << " control edges\n";
+
+  // never ever modifies code
+  return false;
+}
+
+namespace llvm {
+static RegisterPass<ControlDeps> dX("control-deps",
+    "Builds the control-dependence graph of the (used) BBs within the program",
+    false, false);
+}  // namespace llvm
@@ -7,8 +7,8 @@
 #include <algorithm>
 #include <iterator>
 #include <map>
+#include <utility>
 #include <vector>
-#include <unordered_set>
 
 #include "include/LLVMHelper.h"
 #include "include/Tarjans.h"
@@ -174,143 +174,176 @@ bool CsCFG::runOnModule(llvm::Module &m) {
   return false;
 }
 
-static size_t num_added = 0;
-static size_t num_vecs_added = 0;
-static size_t most_preds = 0;
-
-void CsCFG::findPath(const CsNode &node, Id end,
-    std::unordered_map<Id, std::vector<std::vector<Id>>, Id::hasher> &cache)
-    const {
-  auto node_id = util::convert_id<Id>(node.id());
-  if (node_id == end) {
-    cache[node_id].emplace_back(std::vector<Id>(1, end));
-  } else {
-    // See if we have this node cached?
-    if (cache.find(node_id) != std::end(cache)) {
-      return;
-    }
+uint64_t CsCFG::numPathsFromMain(Id end) const {
+  // Paths are counted by DP rather than enumerated:
+  //   count(main) = 1
+  //   count(node) = sum(count(pred)) for each pred of node
+  // Tarjans collapsed the graph's SCCs, so (ignoring self edges) it is a DAG,
+  //   and each node's count is computed once and memoized for every query
+  if (pathCounts_.empty()) {
+    pathCounts_.assign(csGraph_.getNumNodes(), UnknownPathCount);
+    pathCounts_[static_cast<size_t>(mainNode_)] = 1;
+  }
+
+  if (pathCount(end) != UnknownPathCount) {
+    return pathCount(end);
+  }
 
-    std::vector<std::vector<Id>> rets;
+  // Iterative post-order, the graph can be deep enough to blow the stack
+  std::vector<std::pair<Id, SEG::Node::EdgeSet::const_iterator>> visit;
+  visit.emplace_back(end, std::begin(getNode(end).preds()));
 
-    auto &preds = node.preds();
-    /*
-    // most_preds = std::max(static_cast<size_t>(preds.size()), most_preds);
-    if (most_preds <= static_cast<size_t>(preds.size())) {
-      llvm::dbgs() << "Have most preds: " << preds.size() << "\n";
-      llvm::dbgs() << "Fcns:\n";
-      for (auto inst : node.reps()) {
-        llvm::dbgs() << "  " << ValPrinter(inst) << "\n";
+  while (!visit.empty()) {
+    auto node_id = visit.back().first;
+    auto &preds = getNode(node_id).preds();
+    auto &it = visit.back().second;
+
+    // Find the next pred we haven't counted yet
+    for (auto en = std::end(preds); it != en; ++it) {
+      auto pred_id = util::convert_id<Id>(csGraph_.getNode(*it).id());
+      if (pred_id != node_id && pathCount(pred_id) == UnknownPathCount) {
+        break;
       }
-      most_preds = preds.size();
     }
-    */
 
-    std::unordered_set<SEG::NodeID> dedup_set;
+    if (it != std::end(preds)) {
+      auto pred_id = util::convert_id<Id>(csGraph_.getNode(*it).id());
+      visit.emplace_back(pred_id, std::begin(getNode(pred_id).preds()));
+      continue;
+    }
 
-    for (auto &pred_id : preds) {
-      auto &pred_node = csGraph_.getNode<CsNode>(pred_id);
+    // All preds are counted, sum them
+    uint64_t count = 0;
+    for (auto raw_pred_id : preds) {
+      auto pred_id = util::convert_id<Id>(csGraph_.getNode(raw_pred_id).id());
       // Don't find a pred to myself
-      if (util::convert_id<Id>(pred_node.id()) == node_id) {
+      if (pred_id == node_id) {
         continue;
       }
 
-#ifndef NDEBUG
-      auto rc =
-#endif
-        dedup_set.emplace(pred_node.id());
-      assert(rc.second);
+      auto pred_count = pathCount(pred_id);
+      assert(pred_count != UnknownPathCount);
+      count += std::min(MaxPathCount - count, pred_count);
+    }
 
-      findPath(pred_node, end, cache);
+    pathCounts_[static_cast<size_t>(node_id)] = count;
+    visit.pop_back();
+  }
+
+  if (pathCount(end) == 0) {
+    llvm::dbgs() << "WARNING: No path from main to: " << end << "\n";
+  }
 
-      auto it = cache.find(util::convert_id<Id>(pred_node.id()));
-      assert(it != std::end(cache));
+  return pathCount(end);
+}
+
+std::vector<CsCFG::Id> CsCFG::getPathFromMain(Id end, uint64_t n) const {
+  assert(n < numPathsFromMain(end));
 
-      auto &pred_vec = it->second;
+  // Unrank |n|: at each node take the pred whose block of paths contains n
+  std::vector<Id> ret;
+  auto node_id = end;
+  ret.push_back(node_id);
 
-      // Copy all of the cached nodes into rets
-      /*
-      auto ins_it = rets.insert(std::end(rets),
-          std::begin(pred_vec), std::end(pred_vec));
-      for (auto en = std::end(rets); ins_it != en; ++ins_it) {
-        ins_it->emplace_back(node_id);
+  while (node_id != mainNode_) {
+    auto next_id = Id::invalid();
+    for (auto raw_pred_id : getNode(node_id).preds()) {
+      auto pred_id = util::convert_id<Id>(csGraph_.getNode(raw_pred_id).id());
+      if (pred_id == node_id) {
+        continue;
       }
-      */
-      // Handle sizing appropriately...
-      for (auto &vec : pred_vec) {
-        rets.emplace_back(vec.size()+1);
-        auto &new_vec = rets.back();
-        std::copy(std::begin(vec), std::end(vec), std::begin(new_vec));
-        new_vec[vec.size()] = node_id;
+
+      auto pred_count = pathCount(pred_id);
+      if (n < pred_count) {
+        next_id = pred_id;
+        break;
       }
+
+      n -= pred_count;
     }
+    assert(next_id != Id::invalid());
 
-    num_added++;
-    num_vecs_added += rets.size();
-    cache.emplace(node_id, std::move(rets));
+    node_id = next_id;
+    ret.push_back(node_id);
   }
+
+  std::reverse(std::begin(ret), std::end(ret));
+  return ret;
 }
 
-const std::vector<std::vector<CsCFG::Id>> &
-CsCFG::findPathsFromMain(Id end) const {
-  // Ugh, this is uglytown
-  // Optimizations
-  // Use DP algorithm,
-  // Memoize path results in table
-  std::unordered_map<Id, std::vector<std::vector<Id>>, Id::hasher>
-    result_cache;
-
-  // basic Algorithm:
-  //   findPath(node, goal_node):
-  //     if node == goal_node:
-  //       return { goal_node }
-  //     else
-  //       for succ in node.succs():
-  //         return { node } + findPath(succ, goal_nodes)
-  //
-  // Memoize:
-  //   add PathCache:
-  //     if node == goal_node:
-  //       return { goal_node }
-  //     if node in PathCache:
-  //       return PathCache.at(node)
-  //     else:
-  //       for succ in node.succs():
-  //         update PathCache[node]
-  //         return { node } + findPath(succ, goal_nodes)
-  auto it = pathCache_.find(end);
-
-  if (it != std::end(pathCache_)) {
-    return it->second;
-  }
+// PathIterator {{{
+CsCFG::PathIterator::PathIterator(const CsCFG &cfg, Id end) : cfg_(&cfg) {
+  assert(cfg.numPathsFromMain(end) > 0);
+  cursors_.emplace_back(end, 0);
+  descend();
+  buildPath();
+}
 
-  llvm::dbgs() << "Find path with graph size: " << csGraph_.getNumNodes() <<
-    "\n";
+void CsCFG::PathIterator::descend() {
+  // Walk from the top cursor down to main, taking the first pred which has
+  //   a path from main.  Every node we reach has a path, so this never
+  //   backtracks
+  while (cursors_.back().first != cfg_->mainNode_) {
+    auto &cursor = cursors_.back();
+    auto node_id = cursor.first;
+    auto &preds = cfg_->getNode(node_id).preds();
+
+    auto it = std::begin(preds) + cursor.second;
+    for (auto en = std::end(preds); it != en; ++it, ++cursor.second) {
+      auto pred_id =
+        util::convert_id<Id>(cfg_->csGraph_.getNode(*it).id());
+      if (pred_id != node_id && cfg_->pathCount(pred_id) != 0) {
+        break;
+      }
+    }
+    assert(it != std::end(preds));
 
-  num_added = 0;
-  num_vecs_added = 0;
-  most_preds = 0;
-  auto &end_node = csGraph_.getNode<CsNode>(
-      util::convert_id<SEG::NodeID>(end));
-  findPath(end_node, mainNode_,
-      result_cache);
+    cursors_.emplace_back(
+        util::convert_id<Id>(cfg_->csGraph_.getNode(*it).id()), 0);
+  }
+}
 
-  llvm::dbgs() << "total num added: " << num_added << "\n";
-  llvm::dbgs() << "total num vecs added: " << num_vecs_added << "\n";
-  llvm::dbgs() << "most preds: " << most_preds << "\n";
+void CsCFG::PathIterator::advance() {
+  // Main is always the last cursor, and has no choice to make
+  cursors_.pop_back();
+
+  // Find the deepest frame with another pred to take
+  while (!cursors_.empty()) {
+    auto &cursor = cursors_.back();
+    auto node_id = cursor.first;
+    auto &preds = cfg_->getNode(node_id).preds();
+
+    auto it = std::begin(preds) + cursor.second + 1;
+    for (auto en = std::end(preds); it != en; ++it) {
+      auto pred_id =
+        util::convert_id<Id>(cfg_->csGraph_.getNode(*it).id());
+      if (pred_id != node_id && cfg_->pathCount(pred_id) != 0) {
+        break;
+      }
+    }
 
-  auto rc_it = result_cache.find(util::convert_id<Id>(end_node.id()));
+    if (it != std::end(preds)) {
+      cursor.second = std::distance(std::begin(preds), it);
+      cursors_.emplace_back(
+          util::convert_id<Id>(cfg_->csGraph_.getNode(*it).id()), 0);
+      descend();
+      buildPath();
+      return;
+    }
 
-  if (rc_it == std::end(result_cache)) {
-    static std::vector<std::vector<CsCFG::Id>> empty_vector;
-    llvm::dbgs() << "WARNING: No path from main to: " << end << "\n";
-    return empty_vector;
+    cursors_.pop_back();
   }
 
-  auto &ret = rc_it->second;
-
-  auto rc = pathCache_.emplace(end, std::move(ret));
-
-  // llvm::dbgs() << "have paths of size: " << rc.first->second.size() << "\n";
-  return rc.first->second;
+  // Out of paths, become the end iterator
+  cfg_ = nullptr;
+  path_.clear();
 }
 
+void CsCFG::PathIterator::buildPath() {
+  path_.clear();
+  path_.reserve(cursors_.size());
+  for (auto it = cursors_.rbegin(), en = cursors_.rend(); it != en; ++it) {
+    path_.push_back(it->first);
+  }
+}
+//}}}
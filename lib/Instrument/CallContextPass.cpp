@@ -6,9 +6,11 @@
 
 #include <algorithm>
 #include <iostream>
+#include <map>
 #include <set>
 #include <string>
 #include <sstream>
+#include <utility>
 #include <vector>
 
 #include "include/util.h"
@@ -252,6 +254,57 @@ void CallContextLoader::getAnalysisUsage(llvm::AnalysisUsage &usage) const {
   usage.setPreservesAll();
 }
 
+void CallContextLoader::buildTrie() {
+  // Node 0 is the empty stack, shared by every callsite
+  nodes_.emplace_back(0, callsites_.size());
+
+  for (size_t i = 0; i < callsites_.size(); ++i) {
+    auto node = root();
+    for (auto frame : callsites_[i]) {
+      auto next_id = NodeId(nodes_.size());
+      auto rc = edges_.emplace(std::piecewise_construct,
+          std::make_tuple(node, frame), std::make_tuple(next_id));
+
+      node = rc.first->second;
+      if (rc.second) {
+        nodes_.emplace_back(i, i+1);
+      } else {
+        // callsites_ is sorted, so the stacks under a node are contiguous
+        auto &trie_node = nodes_[static_cast<size_t>(node)];
+        assert(trie_node.last == i || trie_node.last == i+1);
+        trie_node.last = i+1;
+      }
+    }
+  }
+
+  // Hash-cons the subtree below each node into a shape.  Children are always
+  //   created after their parents, so walking the nodes backwards visits each
+  //   node after all of its children
+  std::vector<std::vector<std::pair<CsCFG::Id, NodeId>>> children(
+      nodes_.size());
+  for (auto &pr : edges_) {
+    children[static_cast<size_t>(pr.first.parent)].emplace_back(
+        pr.first.frame, pr.second);
+  }
+
+  std::map<std::vector<std::pair<CsCFG::Id, ShapeId>>, ShapeId> shape_ids;
+  shapes_.resize(nodes_.size());
+  for (size_t i = nodes_.size(); i > 0; --i) {
+    std::vector<std::pair<CsCFG::Id, ShapeId>> shape;
+    for (auto &pr : children[i-1]) {
+      shape.emplace_back(pr.first, shapes_[static_cast<size_t>(pr.second)]);
+    }
+    std::sort(std::begin(shape), std::end(shape));
+
+    auto rc = shape_ids.emplace(std::move(shape), ShapeId(shape_ids.size()));
+    shapes_[i-1] = rc.first->second;
+  }
+  numShapes_ = shape_ids.size();
+
+  llvm::dbgs() << "CallContextLoader: " << nodes_.size() <<
+    " call-string trie nodes, " << numShapes_ << " distinct shapes\n";
+}
+
 // Here is where the magic happens
 bool CallContextLoader::runOnModule(llvm::Module &) {
   // Open the loader-file
@@ -292,6 +345,9 @@ bool CallContextLoader::runOnModule(llvm::Module &) {
     // Then, sort them
     std::sort(std::begin(callsites_), std::end(callsites_));
 
+    // Compile them into the prefix trie
+    buildTrie();
+
     // Then, index them
     // Here I can assume there will be no repeated entries
     //   (that would be a cycle)
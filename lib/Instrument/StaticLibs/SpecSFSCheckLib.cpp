@@ -25,10 +25,23 @@
 #define IN_INS
 
 #include "include/BloomHash.h"
+#include "include/CallStack.h"
+#include "include/SetCheck.h"
 
 static int64_t filter_check = 0;
 static int64_t filter_miss = 0;
 
+// Exact table hits, and how many of them were hash collisions
+static int64_t table_hit = 0;
+static int64_t table_false = 0;
+
+// Stats mode (-specsfs-callstack-stats), the bloom filter and the hash
+//   table are both probed at every check, and compared to a full scan
+static int64_t stats_checks = 0;
+static int64_t stats_matches = 0;
+static int64_t stats_bloom_hits = 0;
+static int64_t stats_table_hits = 0;
+
 
 /*
 [[ gnu::constructor ]]
@@ -40,6 +53,20 @@ void init(void) {
 void fini(void) {
   std::cerr << "filter good: " << filter_check << std::endl;
   std::cerr << "filter miss: " << filter_miss << std::endl;
+  std::cerr << "table hit: " << table_hit << std::endl;
+  std::cerr << "table false: " << table_false << std::endl;
+
+  if (stats_checks > 0) {
+    auto rate = [](int64_t false_hits) {
+      return static_cast<double>(false_hits) / stats_checks;
+    };
+    std::cerr << "callstack checks: " << stats_checks << " ("
+      << stats_matches << " matched)" << std::endl;
+    std::cerr << "  bloom hits: " << stats_bloom_hits << " false positive "
+      "rate: " << rate(stats_bloom_hits - stats_matches) << std::endl;
+    std::cerr << "  table hits: " << stats_table_hits << " false positive "
+      "rate: " << rate(stats_table_hits - stats_matches) << std::endl;
+  }
 }
 
 [[ gnu::unused ]]
@@ -127,15 +154,17 @@ class AddrRange {
 std::map<AddrRange, std::vector<int32_t>> addr_to_objid;
 std::vector<std::vector<void *>> stack_allocs;
 
-// Initialize to 0, to represent the "main" call node
-thread_local std::vector<std::pair<int32_t, uint64_t>> stack = {
-  std::pair<int32_t, uint64_t>(0, 0x5F5F5F5F5F5F5F5FULL) };
-
-thread_local std::unordered_map<void *, std::pair<size_t,
-             std::pair<int32_t, uint64_t>>> addr_to_frame;
+thread_local std::unordered_map<void *, std::pair<int64_t, CallStackFrame>>
+  addr_to_frame;
 
 extern "C" {
 
+// The instrumented code reads and updates these directly (see CallStack.h)
+// Zero initialized, frame 0 is the "main" call node, with CallStackInitHash
+static_assert(CallStackInitHash == 0, "frame 0 must be zero initialized");
+thread_local CallStackFrame __specsfs_callstack[CallStackMaxDepth];
+thread_local int64_t __specsfs_callstack_top = 0;
+
 void __specsfs_alloc_fcn(int32_t obj_id, void *addr, int64_t size);
 
 void __specsfs_main_init2(int32_t obj_id, int32_t argv_dest_id,
@@ -165,71 +194,124 @@ void __specsfs_do_call() {
   stack_allocs.emplace_back();
 }
 
-void __specsfs_callstack_push(int32_t id, uint32_t hash) {
-  auto &pr = stack.back();
-  if (stack.empty() || pr.first != id) {
-    auto &cur_hash = pr.second;
+void __specsfs_callstack_overflow() {
+  std::cerr << "callstack overflow! (more than " << CallStackMaxDepth
+    << " frames)" << std::endl;
+  abort();
+}
+
+// The instrumenter inlines push/pop/check, these are kept for reference and
+//   for hand-instrumented code
+void __specsfs_callstack_push(int32_t id, uint64_t hash) {
+  auto &top = __specsfs_callstack[__specsfs_callstack_top];
+  if (top.id != id) {
+    if (__specsfs_callstack_top + 1 >= CallStackMaxDepth) {
+      __specsfs_callstack_overflow();
+    }
 
-    auto new_hash = BloomHasher::mix_hash(cur_hash, hash);
-    stack.push_back(std::make_pair(id, new_hash));
+    auto new_hash = BloomHasher::mix_hash(top.hash, hash);
+    __specsfs_callstack[++__specsfs_callstack_top] = { id, new_hash };
   }
 }
 
 void __specsfs_callstack_pop(int32_t id) {
-  // if (!stack.empty() && stack.back() == id)
-  auto &pr = stack.back();
-  if (pr.first == id) {
-    stack.pop_back();
+  if (__specsfs_callstack[__specsfs_callstack_top].id == id) {
+    __specsfs_callstack_top--;
   }
 }
 
-void __specsfs_callstack_check(int32_t check_id, int32_t size, int32_t **ids,
-    uint64_t filter_hash[]) {
-  // First, check the bloom filter for this set
-  auto &stack_hash = stack.back().second;
-  filter_check++;
+// Returns true if the current stack is ids[i] for some i in [begin, end)
+static bool find_stack(int32_t **ids, int32_t begin, int32_t end) {
+  auto stack_size = static_cast<int32_t>(__specsfs_callstack_top + 1);
 
-  if (!BloomHasher::bloom_check(filter_hash, stack_hash)) {
-    return;
-  }
-  filter_miss++;
-
-  // Check if stack matches any in ids
-  for (int i = 0; i < size; ++i) {
+  for (int i = begin; i < end; ++i) {
     int32_t *id = ids[i];
     int32_t size = id[0];
     ++id;
 
-    if (size != static_cast<int32_t>(stack.size())) {
+    if (size != stack_size) {
       continue;
     }
 
     bool clear = false;
     for (int j = size-1; j >= 0; --j) {
-      if (stack[j].first != id[j]) {
+      if (__specsfs_callstack[j].id != id[j]) {
         clear = true;
         break;
       }
     }
 
     if (!clear) {
-      std::cerr << "stack check failed!" << std::endl;
-      std::cerr << "check id: " << check_id << std::endl;
-      std::cerr << "stack is: {";
-      for (int j = 0; j < size; ++j) {
-        std::cerr << " " << stack[j].first;
-      }
-      std::cerr << " }" << std::endl;
+      return true;
+    }
+  }
 
-      std::cerr << "ids[" << i << "] is: {";
-      for (int j = 0; j < size; ++j) {
-        std::cerr << " " << id[j];
-      }
-      std::cerr << " }" << std::endl;
+  return false;
+}
 
-      // print_trace();
-      do_exit();
-    }
+static void stack_check_failed(int32_t check_id) {
+  std::cerr << "stack check failed!" << std::endl;
+  std::cerr << "check id: " << check_id << std::endl;
+  std::cerr << "stack is: {";
+  for (int64_t j = 0; j <= __specsfs_callstack_top; ++j) {
+    std::cerr << " " << __specsfs_callstack[j].id;
+  }
+  std::cerr << " }" << std::endl;
+
+  // print_trace();
+  do_exit();
+}
+
+// Called once the stack's hash matches the one in |slot| of the check's
+//   table, the stacks with that hash are ids[starts[slot], starts[slot+1])
+void __specsfs_callstack_check_slow(int32_t check_id, int64_t slot,
+    int32_t starts[], int32_t **ids) {
+  table_hit++;
+  if (find_stack(ids, starts[slot], starts[slot+1])) {
+    stack_check_failed(check_id);
+  }
+  table_false++;
+}
+
+void __specsfs_callstack_check(int32_t check_id, int32_t size, int32_t **ids,
+    uint64_t filter_hash[]) {
+  // First, check the bloom filter for this set
+  auto stack_hash = __specsfs_callstack[__specsfs_callstack_top].hash;
+  filter_check++;
+
+  if (!BloomHasher::bloom_check(filter_hash, stack_hash)) {
+    return;
+  }
+  filter_miss++;
+
+  if (find_stack(ids, 0, size)) {
+    stack_check_failed(check_id);
+  }
+}
+
+void __specsfs_callstack_check_stats(int32_t check_id,
+    uint64_t filter_hash[], uint64_t keys[], uint64_t disps[],
+    int64_t num_buckets, int64_t num_slots, int32_t starts[],
+    int32_t **ids) {
+  auto stack_hash = __specsfs_callstack[__specsfs_callstack_top].hash;
+  stats_checks++;
+
+  if (BloomHasher::bloom_check(filter_hash, stack_hash)) {
+    stats_bloom_hits++;
+  }
+
+  auto bucket = StackHashTable::bucket(stack_hash, num_buckets);
+  auto slot = StackHashTable::slot(stack_hash, disps[bucket], num_slots);
+  bool table_match = keys[slot] == stack_hash;
+  if (table_match) {
+    stats_table_hits++;
+  }
+
+  if (find_stack(ids, 0, starts[num_slots])) {
+    stats_matches++;
+    // Every forbidden stack must hit in its slot
+    assert(table_match);
+    stack_check_failed(check_id);
   }
 }
 
@@ -239,14 +321,15 @@ void __specsfs_do_longjmp_call(int32_t, void *jmpstruct, int64_t) {
   auto it = addr_to_frame.find(jmpstruct);
   assert(it != std::end(addr_to_frame));
 
-  // IF we returned to an element w/in an scc, stack.size() will be one less
+  // IF we returned to an element w/in an scc, the stack will be one shorter
   // than the recorded size, in which case, we push the frame back on...
-  if (stack.size() < it->second.first) {
-    assert(stack.size() + 1 == it->second.first);
-    stack.push_back(it->second.second);
+  auto stack_size = __specsfs_callstack_top + 1;
+  if (stack_size < it->second.first) {
+    assert(stack_size + 1 == it->second.first);
+    __specsfs_callstack[++__specsfs_callstack_top] = it->second.second;
   // In the expected case, we just dump the top of our stack
   } else {
-    stack.resize(it->second.first);
+    __specsfs_callstack_top = it->second.first - 1;
   }
 }
 
@@ -261,7 +344,8 @@ void __specsfs_do_setjmp_call(int32_t, void *jmpstruct) {
   std::cout << std::endl;
   */
 
-  addr_to_frame[jmpstruct] = std::make_pair(stack.size(), stack.back());
+  addr_to_frame[jmpstruct] = std::make_pair(__specsfs_callstack_top + 1,
+      __specsfs_callstack[__specsfs_callstack_top]);
 }
 
 void __specsfs_alloca_fcn(int32_t obj_id, void *addr,
@@ -393,7 +477,7 @@ void __specsfs_visit_fcn(int32_t id) {
 }
 
 void __specsfs_set_check_fcn(int32_t id,
-    void *addr, int32_t set[], int32_t set_size) {
+    void *addr, int32_t set[], int32_t set_size, int32_t set_kind) {
   // visit_cnt++;
   // Don't check nulls, they are fine
   if (addr == nullptr) {
@@ -422,7 +506,7 @@ void __specsfs_set_check_fcn(int32_t id,
     std::cerr << std::endl;
     */
     for (auto o_id : obj_vec) {
-      found |= std::binary_search(set, set+set_size, o_id);
+      found |= SetEncoding::contains(set_kind, set, set_size, o_id);
     }
     obj_id = obj_vec.front();
   }
@@ -433,8 +517,17 @@ void __specsfs_set_check_fcn(int32_t id,
     std::cerr << "obj_id is: " << obj_id << std::endl;
     std::cerr << "addr is: " << addr << std::endl;
     std::cerr << "set is:";
-    for (int i = 0; i < set_size; i++) {
-      std::cerr << " " << set[i];
+    if (set_kind == SetEncoding::Bitset) {
+      std::cerr << " (bitset from " << set[0] << ")";
+      for (int i = 0; i < set_size * SetEncoding::BitsPerWord; i++) {
+        if (SetEncoding::contains(set_kind, set, set_size, set[0] + i)) {
+          std::cerr << " " << set[0] + i;
+        }
+      }
+    } else {
+      for (int i = 0; i < set_size; i++) {
+        std::cerr << " " << set[i];
+      }
     }
     std::cerr << std::endl;
     std::cerr << "id is: " << id << std::endl;
@@ -443,5 +536,15 @@ void __specsfs_set_check_fcn(int32_t id,
   }
 }
 
+// A run of set checks from one block, batched into one call
+void __specsfs_set_check_batch_fcn(int32_t num, int32_t ids[],
+    void *addrs[], int32_t *sets[], int32_t set_sizes[],
+    int32_t set_kinds[]) {
+  for (int32_t i = 0; i < num; i++) {
+    __specsfs_set_check_fcn(ids[i], addrs[i], sets[i], set_sizes[i],
+        set_kinds[i]);
+  }
+}
+
 }
 
@@ -21,6 +21,7 @@
 #include "include/LLVMHelper.h"
 #include "include/Tarjans.h"
 #include "include/lib/UnusedFunctions.h"
+#include "include/lib/ControlDeps.h"
 #include "include/lib/IndirFcnTarget.h"
 #include "include/lib/DynPtsto.h"
 #include "include/lib/DynAlias.h"
@@ -30,7 +31,6 @@
 #include "llvm/PassSupport.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/CFG.h"
-#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GetElementPtrTypeIterator.h"
 #include "llvm/IR/InstIterator.h"
@@ -166,6 +166,9 @@ class StaticSlice : public llvm::ModulePass {
     usage.addRequired<DynPtstoLoader>();
     usage.addRequired<CallDests>();
     usage.addRequired<BBNumber>();
+    if (!no_control_flow) {
+      usage.addRequired<ControlDeps>();
+    }
     if (force_alias) {
       usage.addRequired<DynAliasLoader>();
     }
@@ -184,28 +187,10 @@ class StaticSlice : public llvm::ModulePass {
     bbNum_ = &getAnalysis<BBNumber>();
     callDests_ = &getAnalysis<CallDests>();
 
-    // Create nearest inverse dominator list?
-    // The nearest inverse dominator of a bb is its parent in the dom tree
-    // The inverse dominators of a terminator are all direct children in the dom
-    //      tree
-    for (auto &fcn : m) {
-      if (!fcn.isDeclaration()) {
-        llvm::DominatorTree dom(fcn);
-
-        for (auto &bb : fcn) {
-          auto pnode = dom.getNode(&bb);
-
-          if (pnode != nullptr) {
-            auto idom = pnode->getIDom();
-            if (idom != nullptr) {
-              dom_[&bb] = pnode->getIDom()->getBlock();
-            }
-          }
-        }
-      }
+    if (!no_control_flow) {
+      ctrlDeps_ = &getAnalysis<ControlDeps>();
     }
 
-
     llvm::dbgs() << "SLICING\n";
 
     std::ofstream slice_writer(slice_save_str, std::ofstream::out);
@@ -342,6 +327,8 @@ class StaticSlice : public llvm::ModulePass {
       }
     }
 
+    contextInfo_->printStats(llvm::dbgs());
+
     return false;
   }
 
@@ -615,11 +602,10 @@ class StaticSlice : public llvm::ModulePass {
 
       // Also deal w/ control flow info:
       if (!no_control_flow) {
-        auto it = dom_.find(pinst->getParent());
-        if (it != std::end(dom_)) {
-          auto dom = it->second;
+        for (auto dep_id : ctrlDeps_->getDeps(pinst->getParent())) {
+          auto dep_bb = bbNum_->getBB(dep_id);
 
-          auto id = info.getContext(dom->getTerminator(), pos.stack());
+          auto id = info.getContext(dep_bb->getTerminator(), pos.stack());
           ret.emplace_back(info, id);
         }
       }
@@ -750,11 +736,11 @@ class StaticSlice : public llvm::ModulePass {
 
   ContextInfo *contextInfo_;
   CallDests *callDests_;
+  ControlDeps *ctrlDeps_ = nullptr;
 
   llvm::AliasAnalysis *alias_;
   DynAliasLoader *dynAlias_;
 
-  std::map<const llvm::BasicBlock *, const llvm::BasicBlock *> dom_;
   std::map<const llvm::Function *, std::vector<const llvm::ReturnInst *>>
     retToFcn_;
 };
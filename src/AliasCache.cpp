@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include "include/AliasCache.h"
+
+bool AliasCache::lookup(ClassId lhs, ClassId rhs, bool &intersects) {
+  auto k = key(lhs, rhs);
+  auto &shard = getShard(k);
+  std::lock_guard<std::mutex> lock(shard.lock);
+
+  auto it = shard.pairs.find(k);
+  if (it == std::end(shard.pairs)) {
+    pairMisses_++;
+    return false;
+  }
+
+  pairHits_++;
+  intersects = it->second;
+  return true;
+}
+
+void AliasCache::insert(ClassId lhs, ClassId rhs, bool intersects) {
+  auto k = key(lhs, rhs);
+  auto &shard = getShard(k);
+  std::lock_guard<std::mutex> lock(shard.lock);
+
+  // When a shard fills up, start it over rather than tracking recency
+  if (shard.pairs.size() >= maxPairs_ / NumShards + 1) {
+    evictions_ += shard.pairs.size();
+    shard.pairs.clear();
+  }
+
+  shard.pairs.emplace(k, intersects);
+}
+
+void AliasCache::clear() {
+  {
+    std::lock_guard<std::mutex> lock(classLock_);
+    valClass_.clear();
+    classIds_.clear();
+  }
+
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.lock);
+    shard.pairs.clear();
+  }
+}
+
+void AliasCache::printStats(llvm::raw_ostream &o) const {
+  auto rate = [] (size_t hits, size_t misses) {
+    auto total = hits + misses;
+    return (total == 0) ? 0.0 : 100.0 * hits / total;
+  };
+
+  o << "AliasCache:\n";
+  o << "  Value class hits:   " << classHits_ << " / " <<
+    classHits_ + classMisses_ << " (" <<
+    rate(classHits_, classMisses_) << "%)\n";
+  o << "  Num classes:        " << classIds_.size() << "\n";
+  o << "  Alias pair hits:    " << pairHits_ << " / " <<
+    pairHits_ + pairMisses_ << " (" <<
+    rate(pairHits_, pairMisses_) << "%)\n";
+  o << "  Alias pair evicted: " << evictions_ << "\n";
+}
@@ -5,24 +5,30 @@
 
 #include "include/Assumptions.h"
 
+#include <algorithm>
 #include <cassert>
-
+#include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "include/ExtInfo.h"
 #include "include/LLVMHelper.h"
+#include "include/SetCheck.h"
 
+#include "llvm/ADT/DepthFirstIterator.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GetElementPtrTypeIterator.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -33,6 +39,8 @@ static const std::string RetFcnName = "__specsfs_ret_fcn";
 static const std::string CallFcnName = "__specsfs_do_call";
 static const std::string AssignFcnName = "__specsfs_assign_fcn";
 static const std::string SetCheckFcnName = "__specsfs_set_check_fcn";
+static const std::string SetCheckBatchFcnName =
+  "__specsfs_set_check_batch_fcn";
 static const std::string VisitFcnName = "__specsfs_visit_fcn";
 
 // Getting external funcion names {{{
@@ -163,6 +171,8 @@ llvm::Function *getSetCheckFunction(llvm::Module &m) {
     ret_fcn_args.push_back(i32_ptr_type);
     // size
     ret_fcn_args.push_back(i32_type);
+    // kind
+    ret_fcn_args.push_back(i32_type);
     auto ret_fcn_type = llvm::FunctionType::get(
         void_type,
         ret_fcn_args,
@@ -198,6 +208,40 @@ llvm::Function *getAssignFunction(llvm::Module &m) {
   return ret;
 }
 
+llvm::Function *getSetCheckBatchFunction(llvm::Module &m) {
+  auto void_type = llvm::Type::getVoidTy(m.getContext());
+  auto i32_type = llvm::IntegerType::get(m.getContext(), 32);
+  auto i8_ptr_type = llvm::PointerType::get(
+      llvm::IntegerType::get(m.getContext(), 8), 0);
+  auto i32_ptr_type = llvm::PointerType::get(i32_type, 0);
+
+  auto ret = m.getFunction(SetCheckBatchFcnName);
+  if (ret == nullptr) {
+    std::vector<llvm::Type *> ret_fcn_args;
+    // Number of checks
+    ret_fcn_args.push_back(i32_type);
+    // ids
+    ret_fcn_args.push_back(i32_ptr_type);
+    // Pointers
+    ret_fcn_args.push_back(llvm::PointerType::get(i8_ptr_type, 0));
+    // Sets
+    ret_fcn_args.push_back(llvm::PointerType::get(i32_ptr_type, 0));
+    // Set sizes
+    ret_fcn_args.push_back(i32_ptr_type);
+    // Set kinds
+    ret_fcn_args.push_back(i32_ptr_type);
+    auto ret_fcn_type = llvm::FunctionType::get(
+        void_type,
+        ret_fcn_args,
+        false);
+    ret = llvm::Function::Create(
+        ret_fcn_type,
+        llvm::GlobalValue::ExternalLinkage,
+        SetCheckBatchFcnName, &m);
+  }
+  return ret;
+}
+
 // Visit function == "__specsfs_visit_fcn"!
 llvm::Function *getVisitFunction(llvm::Module &m) {
   auto void_type = llvm::Type::getVoidTy(m.getContext());
@@ -380,47 +424,46 @@ bool AssignmentInst::doInstrument(llvm::Module &m, const ExtLibInfo &) {
   return true;
 }
 
+// Each unique set is emitted once, laid out as |kind|
 static llvm::GlobalVariable *getGlobalSet(llvm::Module &m,
-    const std::set<ValueMap::Id> &set,
+    const SetCache::canon_set &set, SetEncoding::Kind kind,
     SetCache &cache) {
   int32_t id = cache.getID(set);
 
-  // llvm::dbgs() << "Have id: " << id << "\n";
-
   std::string gv_name = "__specsfs_gv_set" + std::to_string(id);
 
-  /*
-  llvm::dbgs() << "Have gv_name: " << gv_name << "\n";
-
-  llvm::dbgs() << "  Set data is:";
-  for (auto obj_id : set) {
-    llvm::dbgs() << " " << obj_id;
-  }
-  llvm::dbgs() << "\n";
-  */
-
   auto gv = m.getGlobalVariable(gv_name);
   if (gv == nullptr) {
     auto i32_type = llvm::IntegerType::get(m.getContext(), 32);
-    // Create the array type:
-    //   Note, its an array of (set.size()) of int32_ts
-    auto array_type = llvm::ArrayType::get(i32_type,
-        set.size());
 
     // Create the array initializer:
-    //   For each elm : set
+    //   Sorted: For each elm : set
     //     arrayInit[i] = elm
+    //   Bitset: arrayInit[0] = set.front(), followed by the bitmap words
     std::vector<llvm::Constant *> initializer;
-    // llvm::dbgs() << "  Creating gv: " << gv_name << "\n";
-    // llvm::dbgs() << "  With set:";
-    for (auto obj_id : set) {
-      initializer.push_back(
-          llvm::ConstantInt::get(i32_type, obj_id.val()));
-      // llvm::dbgs() << " " << obj_id;
-    }
-    // llvm::dbgs() << "\n";
+    if (kind == SetEncoding::Bitset) {
+      auto base = set.front().val();
+      std::vector<uint32_t> words(
+          SetEncoding::numWords(base, set.back().val()), 0);
+      for (auto obj_id : set) {
+        auto bit = obj_id.val() - base;
+        words[bit / SetEncoding::BitsPerWord] |=
+          1u << (bit % SetEncoding::BitsPerWord);
+      }
 
+      initializer.push_back(llvm::ConstantInt::get(i32_type, base));
+      for (auto word : words) {
+        initializer.push_back(llvm::ConstantInt::get(i32_type, word));
+      }
+    } else {
+      for (auto obj_id : set) {
+        initializer.push_back(
+            llvm::ConstantInt::get(i32_type, obj_id.val()));
+      }
+    }
 
+    auto array_type = llvm::ArrayType::get(i32_type,
+        initializer.size());
     auto array_init = llvm::ConstantArray::get(array_type, initializer);
 
     // Create it
@@ -449,6 +492,7 @@ bool SetCheckInst::doInstrument(llvm::Module &m, const ExtLibInfo &) {
   //   Pointer
   //   Pointer Set Array
   //   Pointer Set Size
+  //   Pointer Set Kind (SetEncoding::Kind)
 
   // Okay, we have two options here, an argument or an instruction
   auto assign_inst = assignInst_;
@@ -481,12 +525,25 @@ bool SetCheckInst::doInstrument(llvm::Module &m, const ExtLibInfo &) {
   std::vector<llvm::Constant *> idx_list;
   idx_list.push_back(llvm::ConstantInt::get(i32_type, 0));
   idx_list.push_back(llvm::ConstantInt::get(i32_type, 0));
-  auto array_ce = getGlobalSet(m, checkSet_, setCache_);
+  auto kind = SetEncoding::Sorted;
+  int32_t size = checkSet_.size();
+  if (!checkSet_.empty()) {
+    auto min_id = checkSet_.front().val();
+    auto max_id = checkSet_.back().val();
+    kind = SetEncoding::choose(size, min_id, max_id);
+    if (kind == SetEncoding::Bitset) {
+      size = SetEncoding::numWords(min_id, max_id);
+    }
+  }
+  auto array_ce = getGlobalSet(m, checkSet_, kind, setCache_);
   args.push_back(llvm::ConstantExpr::getGetElementPtr(
-        array_ce->getType(), array_ce, idx_list));
+        array_ce->getValueType(), array_ce, idx_list));
 
   // Set size:
-  args.push_back(llvm::ConstantInt::get(i32_type, checkSet_.size()));
+  args.push_back(llvm::ConstantInt::get(i32_type, size));
+
+  // Set kind:
+  args.push_back(llvm::ConstantInt::get(i32_type, kind));
 
   // Get first instruction:
   auto insert_after = first_inst;
@@ -635,7 +692,8 @@ PtstoAssumption::approxDependencies(
       pts_ids.push_back(id);
     }
   }
-  ret.emplace_back(new SetCheckInst(instOrArg_, pts_ids, bleh, nullptr));
+  ret.emplace_back(new SetCheckInst(instOrArg_, pts_ids, bleh,
+        const_cast<llvm::Instruction *>(site_)));
 
   // Now, create a double allocation site for each ptsto in this instruction
   // NOTE: The double is to approximate the free cost
@@ -693,5 +751,391 @@ DeadCodeAssumption::approxDependencies(
   return ret;
 }
 //}}}
+
+// Approx Benefits {{{
+int64_t PtstoAssumption::approxBenefit() const {
+  return instOrArg_->getNumUses();
+}
+
+int64_t DeadCodeAssumption::approxBenefit() const {
+  int64_t ret = 0;
+  for (auto &inst : *bb_) {
+    if (llvm::isa<llvm::PointerType>(inst.getType()) ||
+        llvm::isa<llvm::StoreInst>(inst) ||
+        llvm::isa<llvm::CallInst>(inst) ||
+        llvm::isa<llvm::InvokeInst>(inst)) {
+      ret++;
+    }
+  }
+
+  return ret;
+}
 //}}}
+//}}}
+
+
+// Check optimization {{{
+// A set check only depends on the value of the pointer it checks, and on
+//   which objects are live when it runs.  So, we may move a check earlier as
+//   long as it runs whenever it would have, and no object can be freed in
+//   between
+static llvm::Value *checked_ptr(llvm::CallInst *ci) {
+  auto ptr = ci->getArgOperand(1);
+  if (auto bc = dyn_cast<llvm::BitCastInst>(ptr)) {
+    return bc->getOperand(0);
+  }
+
+  return ptr;
+}
+
+static llvm::Value *ptr_at(llvm::Value *ptr, llvm::Instruction *pos) {
+  auto i8_ptr_type = llvm::PointerType::get(
+      llvm::IntegerType::get(ptr->getContext(), 8), 0);
+
+  if (ptr->getType() == i8_ptr_type) {
+    return ptr;
+  }
+
+  return new llvm::BitCastInst(ptr, i8_ptr_type, "", pos);
+}
+
+// Cleans up the casts SetCheckInst::doInstrument made for a check we removed
+static void erase_dead_cast(llvm::Value *val) {
+  auto bc = dyn_cast<llvm::BitCastInst>(val);
+  if (bc != nullptr && bc->use_empty()) {
+    bc->eraseFromParent();
+  }
+}
+
+// True if |loop| has a call which may free, or may not return (e.g. exit or
+//   abort).  A check hoisted over the latter could fire on a run which never
+//   reached the check
+static bool loop_has_barrier(const llvm::Loop *loop,
+    const llvm::Function *free_fcn) {
+  for (auto bb : loop->blocks()) {
+    for (auto &inst : *bb) {
+      llvm::ImmutableCallSite cs(&inst);
+      if (!cs) {
+        continue;
+      }
+
+      if (cs.doesNotReturn()) {
+        return true;
+      }
 
+      // Anything we can't see into may free, or exit
+      auto callee = LLVMHelper::getFcnFromCall(cs);
+      if (callee == nullptr || callee == free_fcn ||
+          !callee->isDeclaration()) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+static bool hoist_check(llvm::CallInst *ci, llvm::LoopInfo &li,
+    llvm::DominatorTree &dt,
+    std::unordered_map<const llvm::Loop *, bool> &has_barrier,
+    const llvm::Function *free_fcn) {
+  auto ptr = checked_ptr(ci);
+  bool ret = false;
+
+  for (auto loop = li.getLoopFor(ci->getParent()); loop != nullptr;
+      loop = loop->getParentLoop()) {
+    auto preheader = loop->getLoopPreheader();
+    if (preheader == nullptr || !loop->isLoopInvariant(ptr)) {
+      break;
+    }
+
+    // Only hoist checks which run every time the loop is entered, otherwise
+    //   we'd check pointers the program never relied on
+    llvm::SmallVector<llvm::BasicBlock *, 8> exiting;
+    loop->getExitingBlocks(exiting);
+    auto check_bb = ci->getParent();
+    if (exiting.empty() ||
+        !std::all_of(std::begin(exiting), std::end(exiting),
+          [&dt, check_bb] (llvm::BasicBlock *bb) {
+            return dt.dominates(check_bb, bb);
+          })) {
+      break;
+    }
+
+    auto rc = has_barrier.emplace(loop, false);
+    if (rc.second) {
+      rc.first->second = loop_has_barrier(loop, free_fcn);
+    }
+
+    if (rc.first->second) {
+      break;
+    }
+
+    auto term = preheader->getTerminator();
+    auto old_ptr = ci->getArgOperand(1);
+    ci->setArgOperand(1, ptr_at(ptr, term));
+    ci->moveBefore(term);
+    erase_dead_cast(old_ptr);
+
+    ret = true;
+  }
+
+  return ret;
+}
+
+// True if no barrier (per |is_barrier|) runs on any path from |dom| to |ci|.
+//   Expects |dom| to dominate |ci|
+template <typename BarrierFn>
+static bool check_reaches(const llvm::Instruction *dom,
+    const llvm::Instruction *ci, BarrierFn is_barrier,
+    std::unordered_map<const llvm::BasicBlock *, bool> &bb_barrier) {
+  auto dom_bb = dom->getParent();
+  auto ci_bb = ci->getParent();
+
+  auto scan = [&is_barrier] (llvm::BasicBlock::const_iterator it,
+      llvm::BasicBlock::const_iterator end) {
+    return std::none_of(it, end, is_barrier);
+  };
+
+  if (dom_bb == ci_bb) {
+    return scan(std::next(dom->getIterator()), ci->getIterator());
+  }
+
+  if (!scan(std::next(dom->getIterator()), dom_bb->end()) ||
+      !scan(ci_bb->begin(), ci->getIterator())) {
+    return false;
+  }
+
+  // Every block between the two (including |ci|'s, if it loops back on
+  //   itself) must be free of barriers
+  std::set<const llvm::BasicBlock *> visited;
+  std::vector<const llvm::BasicBlock *> worklist(llvm::pred_begin(ci_bb),
+      llvm::pred_end(ci_bb));
+  while (!worklist.empty()) {
+    auto bb = worklist.back();
+    worklist.pop_back();
+
+    if (bb == dom_bb || !visited.insert(bb).second) {
+      continue;
+    }
+
+    auto rc = bb_barrier.emplace(bb, false);
+    if (rc.second) {
+      rc.first->second = !scan(bb->begin(), bb->end());
+    }
+    if (rc.first->second) {
+      return false;
+    }
+
+    worklist.insert(std::end(worklist), llvm::pred_begin(bb),
+        llvm::pred_end(bb));
+  }
+
+  return true;
+}
+
+// Replaces a run of checks with one batched call, at the first check of the
+//   run so nothing is checked any later than it was
+static void batch_checks(llvm::Module &m,
+    const std::vector<llvm::CallInst *> &run) {
+  auto i32_type = llvm::IntegerType::get(m.getContext(), 32);
+  auto i8_ptr_type = llvm::PointerType::get(
+      llvm::IntegerType::get(m.getContext(), 8), 0);
+  auto i32_ptr_type = llvm::PointerType::get(i32_type, 0);
+
+  auto first = run.front();
+  auto &fcn = *first->getParent()->getParent();
+  auto num = run.size();
+
+  std::vector<llvm::Constant *> ids;
+  std::vector<llvm::Constant *> sets;
+  std::vector<llvm::Constant *> sizes;
+  std::vector<llvm::Constant *> kinds;
+  for (auto ci : run) {
+    ids.push_back(cast<llvm::Constant>(ci->getArgOperand(0)));
+    sets.push_back(cast<llvm::Constant>(ci->getArgOperand(2)));
+    sizes.push_back(cast<llvm::Constant>(ci->getArgOperand(3)));
+    kinds.push_back(cast<llvm::Constant>(ci->getArgOperand(4)));
+  }
+
+  std::vector<llvm::Constant *> idx_list;
+  idx_list.push_back(llvm::ConstantInt::get(i32_type, 0));
+  idx_list.push_back(llvm::ConstantInt::get(i32_type, 0));
+  auto make_table = [&m, &idx_list, num] (llvm::Type *type,
+      const std::vector<llvm::Constant *> &elms) {
+    auto array_type = llvm::ArrayType::get(type, num);
+    auto gv = new llvm::GlobalVariable(m,
+        array_type,
+        true,
+        llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantArray::get(array_type, elms),
+        "__specsfs_batch_table");
+    return llvm::ConstantExpr::getGetElementPtr(array_type, gv, idx_list);
+  };
+
+  // The pointers themselves go in a stack array
+  auto addrs_type = llvm::ArrayType::get(i8_ptr_type, num);
+  auto addrs = new llvm::AllocaInst(addrs_type, 0, "",
+      &*fcn.getEntryBlock().getFirstInsertionPt());
+
+  for (size_t i = 0; i < num; ++i) {
+    auto ci = run[i];
+    std::vector<llvm::Value *> addr_idx;
+    addr_idx.push_back(llvm::ConstantInt::get(i32_type, 0));
+    addr_idx.push_back(llvm::ConstantInt::get(i32_type, i));
+    auto slot = llvm::GetElementPtrInst::CreateInBounds(addrs_type, addrs,
+        addr_idx, "", first);
+    new llvm::StoreInst(ptr_at(checked_ptr(ci), first), slot, first);
+  }
+
+  std::vector<llvm::Value *> args;
+  args.push_back(llvm::ConstantInt::get(i32_type, num));
+  args.push_back(make_table(i32_type, ids));
+  std::vector<llvm::Value *> addrs_idx(std::begin(idx_list),
+      std::end(idx_list));
+  args.push_back(llvm::GetElementPtrInst::CreateInBounds(addrs_type, addrs,
+        addrs_idx, "", first));
+  args.push_back(make_table(i32_ptr_type, sets));
+  args.push_back(make_table(i32_type, sizes));
+  args.push_back(make_table(i32_type, kinds));
+  llvm::CallInst::Create(getSetCheckBatchFunction(m), args, "", first);
+
+  for (auto ci : run) {
+    auto old_ptr = ci->getArgOperand(1);
+    ci->eraseFromParent();
+    erase_dead_cast(old_ptr);
+  }
+}
+
+bool optimizeSetChecks(llvm::Module &m) {
+  auto check_fcn = m.getFunction(SetCheckFcnName);
+  if (check_fcn == nullptr) {
+    return false;
+  }
+  auto free_fcn = m.getFunction(FreeFcnName);
+
+  size_t num_checks = 0;
+  size_t num_hoisted = 0;
+  size_t num_merged = 0;
+  size_t num_batched = 0;
+  size_t num_batches = 0;
+
+  auto is_check = [check_fcn] (const llvm::Instruction &inst) {
+    auto ci = dyn_cast<llvm::CallInst>(&inst);
+    return ci != nullptr && ci->getCalledFunction() == check_fcn;
+  };
+
+  for (auto &fcn : m) {
+    if (fcn.isDeclaration()) {
+      continue;
+    }
+
+    std::vector<llvm::CallInst *> checks;
+    for (auto &bb : fcn) {
+      for (auto &inst : bb) {
+        if (is_check(inst)) {
+          checks.push_back(cast<llvm::CallInst>(&inst));
+        }
+      }
+    }
+
+    if (checks.empty()) {
+      continue;
+    }
+    num_checks += checks.size();
+
+    // We only move instructions, so the CFG (and these) stay valid throughout
+    llvm::DominatorTree dt(fcn);
+    llvm::LoopInfo li(dt);
+
+    // First, hoist checks of loop invariant pointers out of their loops
+    std::unordered_map<const llvm::Loop *, bool> has_barrier;
+    for (auto ci : checks) {
+      if (hoist_check(ci, li, dt, has_barrier, free_fcn)) {
+        num_hoisted++;
+      }
+    }
+
+    // Then, drop any check dominated by an identical check.  As with
+    //   batching, a call between the two may free the object (or never
+    //   return), so the earlier check only covers the later if no call lies
+    //   on any path between them.  We visit blocks in dominator tree preorder,
+    //   so a check's dominators are seen before it
+    auto is_barrier = [&is_check] (const llvm::Instruction &inst) {
+      return (llvm::isa<llvm::CallInst>(inst) ||
+          llvm::isa<llvm::InvokeInst>(inst)) && !is_check(inst);
+    };
+
+    std::map<std::pair<llvm::Value *, llvm::Value *>,
+      std::vector<llvm::CallInst *>> kept;
+    std::unordered_map<const llvm::BasicBlock *, bool> bb_barrier;
+    std::vector<llvm::CallInst *> dominated;
+    for (auto node : llvm::depth_first(dt.getRootNode())) {
+      for (auto &inst : *node->getBlock()) {
+        if (!is_check(inst)) {
+          continue;
+        }
+
+        auto ci = cast<llvm::CallInst>(&inst);
+        auto &group = kept[std::make_pair(checked_ptr(ci),
+            ci->getArgOperand(2))];
+        auto covered = std::any_of(std::begin(group), std::end(group),
+            [&dt, &is_barrier, &bb_barrier, ci] (llvm::CallInst *dom) {
+              return dt.dominates(dom, ci) &&
+                check_reaches(dom, ci, is_barrier, bb_barrier);
+            });
+
+        if (covered) {
+          dominated.push_back(ci);
+        } else {
+          group.push_back(ci);
+        }
+      }
+    }
+
+    for (auto ci : dominated) {
+      auto old_ptr = ci->getArgOperand(1);
+      ci->eraseFromParent();
+      erase_dead_cast(old_ptr);
+    }
+    num_merged += dominated.size();
+
+    // Finally, batch runs of checks within a block.  A run can't span a
+    //   call, as it may change which objects are live
+    for (auto &bb : fcn) {
+      std::vector<llvm::CallInst *> run;
+      auto flush = [&m, &run, &num_batched, &num_batches] {
+        if (run.size() > 1) {
+          num_batched += run.size();
+          num_batches++;
+          batch_checks(m, run);
+        }
+        run.clear();
+      };
+
+      for (auto &inst : bb) {
+        if (is_check(inst)) {
+          auto ci = cast<llvm::CallInst>(&inst);
+          // Every pointer in the run must be available at its first check
+          auto ptr_inst = dyn_cast<llvm::Instruction>(checked_ptr(ci));
+          if (!run.empty() && ptr_inst != nullptr &&
+              !dt.dominates(ptr_inst, run.front())) {
+            flush();
+          }
+          run.push_back(ci);
+        } else if (llvm::isa<llvm::CallInst>(inst) ||
+            llvm::isa<llvm::InvokeInst>(inst)) {
+          flush();
+        }
+      }
+      flush();
+    }
+  }
+
+  llvm::dbgs() << "Set check optimization: " << num_checks << " checks, "
+    << num_hoisted << " hoisted, " << num_merged << " merged, "
+    << num_batched << " batched into " << num_batches << " calls\n";
+
+  return num_hoisted + num_merged + num_batches > 0;
+}
+//}}}
@@ -8,8 +8,12 @@
 #include <cstdint>
 
 #include <algorithm>
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
+#include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -18,8 +22,10 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include "include/Assumptions.h"
+#include "include/CgDiskCache.h"
 #include "include/ExtInfo.h"
 #include "include/ValueMap.h"
 #include "include/lib/IndirFcnTarget.h"
@@ -31,6 +37,24 @@ llvm::cl::opt<bool>
       llvm::cl::desc("if set anders will not make any "
         "speculative assumptions"));
 
+static llvm::cl::opt<int32_t> //  NOLINT
+  cg_threads("anders-cg-threads", llvm::cl::init(0),
+      llvm::cl::value_desc("int"),
+      llvm::cl::desc("Number of threads used to build the per-SCC constraint "
+        "graphs (0 uses one per hardware thread)"));
+
+static llvm::cl::opt<bool>
+  renumber_objs("anders-renumber-objs", llvm::cl::init(false),
+      llvm::cl::desc("Cluster object ids by which pointers they flow into "
+        "when lowering allocations, for smaller ptsto BDDs and bitmaps"));
+
+static llvm::cl::opt<std::string>
+  cg_cache_dir("anders-cg-cache-dir", llvm::cl::init(""),
+      llvm::cl::value_desc("directory"),
+      llvm::cl::desc("If set, the per-SCC constraint graphs are cached in "
+        "this directory, and reused by later runs when their IR is "
+        "unchanged"));
+
 // Helpers for contraint IDs {{{
 static bool traceInt(const llvm::Value *val, std::set<const llvm::Value *> &src,
     std::map<const llvm::Value *, bool> &seen) {
@@ -219,7 +243,7 @@ void Cg::addConstraintForType(ConstraintType ctype,
 bool Cg::addConstraintsForExternalCall(llvm::ImmutableCallSite &cs,
     const llvm::Function *called_fcn,
     const CallInfo &call_info) {
-  llvm::dbgs() << "have external fcn: " << called_fcn->getName() << "\n";
+  dbg << "have external fcn: " << called_fcn->getName() << "\n";
   // Get the exteral
   auto &info = extInfo_.getInfo(called_fcn);
 
@@ -232,7 +256,7 @@ bool Cg::addConstraintsForExternalCall(llvm::ImmutableCallSite &cs,
   }
 
   if (extInfo_.isUnknownFunction((info))) {
-    llvm::dbgs() << "WARNING: Unknwon external function: " <<
+    dbg << "WARNING: Unknwon external function: " <<
       ValPrinter(cs.getInstruction()) << "\n";
   }
 
@@ -265,7 +289,7 @@ void Cg::addConstraintsForDirectCall(llvm::ImmutableCallSite &cs,
   } else if (
       llvm::isa<llvm::PointerType>(called_fcn->getFunctionType()->getReturnType())) {  // NOLINT
     // The call now aliases the universal value
-    llvm::dbgs() << "FIXME: Ignoring int to ptr for call\n";
+    dbg << "FIXME: Ignoring int to ptr for call\n";
   }
 
   auto ArgI = cs.arg_begin();
@@ -297,7 +321,7 @@ void Cg::addConstraintsForDirectCall(llvm::ImmutableCallSite &cs,
         // auto node_id = omap.createPhonyID();
         // auto dest_id = getValue(cg, omap, FargI);
 
-        llvm::dbgs() << "FIXME: Ignoring int to ptr for arg\n";
+        dbg << "FIXME: Ignoring int to ptr for arg\n";
       }
     }
 
@@ -488,7 +512,7 @@ void Cg::idRetInst(const llvm::Instruction &inst) {
 
   auto returned_id = getDef(src);
 
-  llvm::dbgs() << "ret edge: " << returned_id << " -> "
+  dbg << "ret edge: " << returned_id << " -> "
     << getCallInfo(parent_fcn).ret() << "\n";
   add(ConstraintType::Copy,
       returned_id, getCallInfo(parent_fcn).ret());
@@ -531,7 +555,7 @@ bool Cg::idCallInst(const llvm::Instruction &inst) {
 
     dout("Malloc addAddressForType(" << dest_id << ", " << src_obj_id
         << ")\n");
-    llvm::dbgs() << "Malloc src: " << src_obj_id << " size: "  << size <<
+    dbg << "Malloc src: " << src_obj_id << " size: "  << size <<
       " inst: " << inst << "\n";
     addConstraintForType(ConstraintType::AddressOf,
         inferred_type, dest_id, src_obj_id);
@@ -578,7 +602,7 @@ void Cg::idLoadInst(const llvm::Instruction &inst) {
       //   phony id
       auto dest_id = getDef(&ld);
 
-      llvm::dbgs() << __LINE__ << ": Load int into pointer\n";
+      dbg << __LINE__ << ": Load int into pointer\n";
       add(ConstraintType::Load, addr_id,
           dest_id,
           ValueMap::IntValue);
@@ -618,10 +642,10 @@ void Cg::idStoreInst(const llvm::Instruction &inst) {
       if (dest == ValueMap::NullValue) {
         // If this is not an object, store to the value
         dest = getDef(st.getOperand(1));
-        llvm::dbgs() << "No object for store dest: " << dest << " : " <<
+        dbg << "No object for store dest: " << dest << " : " <<
           ValPrint(dest, vals_) << "\n";
       }
-      llvm::dbgs() << "Store on inst: " << ValPrinter(&inst) << "\n";
+      dbg << "Store on inst: " << ValPrinter(&inst) << "\n";
       add(ConstraintType::Store,
           st_id,
           getDef(st.getOperand(0)),
@@ -636,7 +660,7 @@ void Cg::idStoreInst(const llvm::Instruction &inst) {
     if (!llvm::isa<llvm::IntegerType>(dest_type->getContainedType(0))) {
       auto dest = getDef(st.getOperand(1));
 
-      llvm::dbgs() << __LINE__ << ": Store int into pointer: " <<
+      dbg << __LINE__ << ": Store int into pointer: " <<
         st << "\n";
       add(ConstraintType::Store,
           st_id,
@@ -782,7 +806,7 @@ void Cg::idExtractInst(const llvm::Instruction &inst) {
         ValueMap::AggregateValue,
         getDef(&extract_inst));
   } else if (llvm::isa<llvm::IntegerType>(extract_inst.getType())) {
-    llvm::dbgs() << __LINE__ << ": EXTRACT INT?\n";
+    dbg << __LINE__ << ": EXTRACT INT?\n";
     add(ConstraintType::Copy,
         ValueMap::AggregateValue,
         ValueMap::IntValue);
@@ -798,7 +822,7 @@ void Cg::idInsertInst(const llvm::Instruction &inst) {
         getDef(src_val),
         ValueMap::AggregateValue);
   } else if (llvm::isa<llvm::IntegerType>(src_val->getType())) {
-    llvm::dbgs() << __LINE__ << ": INSERT INT?\n";
+    dbg << __LINE__ << ": INSERT INT?\n";
     add(ConstraintType::Copy,
         ValueMap::IntValue,
         ValueMap::AggregateValue);
@@ -813,6 +837,15 @@ Cg::Cg(const llvm::Function *fcn,
       ModInfo &mod_info,
       ExtLibInfo &ext_info,
       CsCFG &cfg) :
+      Cg(fcn, dyn_info, as, as, mod_info, ext_info, cfg) { }
+
+Cg::Cg(const llvm::Function *fcn,
+      const DynamicInfo &dyn_info,
+      AssumptionSet &as,
+      AssumptionSet &scan_as,
+      ModInfo &mod_info,
+      ExtLibInfo &ext_info,
+      CsCFG &cfg) :
       csCFG_(cfg),
       dynInfo_(dyn_info),
       as_(as),
@@ -834,7 +867,23 @@ Cg::Cg(const llvm::Function *fcn,
       std::make_tuple(fcn),
       std::make_tuple(std::move(ci), cfgId_));
   // Populate constraints
-  populateConstraints(as);
+  populateConstraints(scan_as);
+}
+
+Cg::Cg(const DynamicInfo &dyn_info,
+      AssumptionSet &as,
+      ModInfo &mod_info,
+      ExtLibInfo &ext_info,
+      CsCFG &cfg) :
+      csCFG_(cfg),
+      dynInfo_(dyn_info),
+      as_(as),
+      modInfo_(mod_info),
+      extInfo_(ext_info) {
+  // Assume we're part of main for now...
+  curStacks_.emplace_back(1);
+  curStacks_.back().back() =
+    util::convert_id<CsCFG::Id>(dynInfo_.call_info.getMainContext());
 }
 
 void Cg::populateConstraints(AssumptionSet &as) {
@@ -1003,7 +1052,7 @@ void Cg::addGlobalConstraints(const llvm::Module &m) {
       auto glbl_val = getGlobalInitializer(glbl);
 
       if (glbl_val == ValueMap::UniversalValue) {
-        llvm::dbgs() << "FIXME: Global Init -- universal value -- global: "
+        dbg << "FIXME: Global Init -- universal value -- global: "
           << glbl.getName() << "\n";
       }
       /*
@@ -1166,7 +1215,7 @@ void Cg::resolveDirAcyclicCall(CgCache &base_cgs, CgCache &full_cgs,
   if (call_info.hasDynData() && !no_spec && new_stacks.empty()) {
     // llvm::dbgs() << "Instruction: " << ValPrinter(cs.getInstruction())
     //     << "\n";
-    llvm::dbgs() << "  Skipping call due to no valid dyn stack\n";
+    dbg << "  Skipping call due to no valid dyn stack\n";
     // llvm::dbgs() << "  cs id: " << csCFG_.getId(cs.getInstruction()) << "\n";
     // Add invalid stacks which made me skip this call to my list of invalid
     //   stacks!
@@ -1178,22 +1227,86 @@ void Cg::resolveDirAcyclicCall(CgCache &base_cgs, CgCache &full_cgs,
   }
 
   // Check for the full cg:
-  auto tmp_cg = std::move(base_cgs.getCg(called_fcn).clone(
-        std::move(new_stacks)));
   const Cg *pcg = nullptr;
   if (!call_info.hasDynData() || no_spec) {
     pcg = full_cgs.tryGetCg(called_fcn);
-  }
-
-  if (pcg == nullptr) {
-    tmp_cg.resolveCalls(base_cgs, full_cgs);
 
-    if (!call_info.hasDynData() || no_spec) {
+    if (pcg == nullptr) {
+      auto tmp_cg = base_cgs.getCg(called_fcn).clone(std::move(new_stacks));
+      tmp_cg.resolveCalls(base_cgs, full_cgs);
       full_cgs.addCg(called_fcn, std::move(tmp_cg));
       pcg = full_cgs.tryGetCg(called_fcn);
-    } else {
-      pcg = &tmp_cg;
     }
+  } else {
+    // Order the stacks by the shape of their trie nodes, so any summary with
+    //   the same shapes lines up with them stack for stack
+    std::vector<std::pair<CallContextLoader::ShapeId, size_t>> shape_order;
+    for (size_t i = 0; i < new_stacks.size(); ++i) {
+      shape_order.emplace_back(
+          call_info.getShape(call_info.find(new_stacks[i])), i);
+    }
+    std::sort(std::begin(shape_order), std::end(shape_order));
+
+    std::vector<std::vector<CsCFG::Id>> sorted_stacks;
+    std::vector<CallContextLoader::ShapeId> shapes;
+    for (auto &pr : shape_order) {
+      shapes.push_back(pr.first);
+      sorted_stacks.emplace_back(std::move(new_stacks[pr.second]));
+    }
+
+    // Every entry stack ends with this call site
+    auto top = sorted_stacks.front().back();
+    assert(std::all_of(std::begin(sorted_stacks), std::end(sorted_stacks),
+          [top] (const std::vector<CsCFG::Id> &stack) {
+            return stack.back() == top;
+          }));
+
+    CgCache::SummaryKey key(called_fcn, top, std::move(shapes));
+    auto psummary = full_cgs.tryGetSummary(key);
+    if (psummary == nullptr) {
+      auto tmp_cg = base_cgs.getCg(called_fcn).clone(sorted_stacks);
+      auto summary_mark = full_cgs.numSummaries();
+      tmp_cg.resolveCalls(base_cgs, full_cgs);
+
+      // The summaries made resolving tmp_cg are only needed by later users
+      //   of tmp_cg, who will now reuse its summary instead
+      full_cgs.releaseSummaries(summary_mark);
+
+      // Strip the stacks we were entered with off of any invalid stacks, so
+      //   they can be re-targeted to the stacks of later users
+      std::vector<std::pair<size_t, std::vector<CsCFG::Id>>> suffixes;
+      for (auto &stack : tmp_cg.invalidStacks_) {
+        size_t idx = sorted_stacks.size();
+        for (size_t i = 0; i < sorted_stacks.size(); ++i) {
+          auto &entry = sorted_stacks[i];
+          if (entry.size() <= stack.size() &&
+              std::equal(std::begin(entry), std::end(entry),
+                std::begin(stack)) &&
+              (idx == sorted_stacks.size() ||
+               entry.size() > sorted_stacks[idx].size())) {
+            idx = i;
+          }
+        }
+        assert(idx < sorted_stacks.size());
+
+        suffixes.emplace_back(idx, std::vector<CsCFG::Id>(
+              std::next(std::begin(stack), sorted_stacks[idx].size()),
+              std::end(stack)));
+      }
+      tmp_cg.invalidStacks_.clear();
+
+      psummary = &full_cgs.addSummary(std::move(key),
+          CgCache::Summary(std::move(tmp_cg), std::move(suffixes)));
+    }
+
+    for (auto &pr : psummary->invalidSuffixes) {
+      auto stack = sorted_stacks[pr.first];
+      stack.insert(std::end(stack), std::begin(pr.second),
+          std::end(pr.second));
+      invalidStacks_.emplace(std::move(stack));
+    }
+
+    pcg = &psummary->cg;
   }
   auto &dest_cg = *pcg;
 
@@ -1228,26 +1341,33 @@ Cg::getCalleeStacks(llvm::ImmutableCallSite &cs,
     return new_stacks;
   }
 
-  for (auto &stack : curStacks_) {
-    auto new_id = csCFG_.getId(cs.getInstruction());
+  // Look up the trie nodes of any stacks we haven't seen yet, after this
+  //   each stack is validated with a single trie step
+  while (curStackNodes_.size() < curStacks_.size()) {
+    curStackNodes_.push_back(
+        call_info.find(curStacks_[curStackNodes_.size()]));
+  }
+
+  auto new_id = csCFG_.getId(cs.getInstruction());
+  for (size_t i = 0; i < curStacks_.size(); ++i) {
+    auto &stack = curStacks_[i];
     if (stack.back() != new_id) {
-      std::vector<CsCFG::Id> new_stack(stack.size() + 1);
-      std::vector<CsCFG::Id> cs_new_stack(stack.size() + 1);
-      // std::copy(std::begin(stack), std::end(stack), std::begin(new_stack));
-      size_t i = 0;
-      for (auto &id : stack) {
-        cs_new_stack[i] = util::convert_id<CsCFG::Id>(id);
-        new_stack[i] = id;
-        ++i;
+      bool valid = call_info.isValid(
+          call_info.extend(curStackNodes_[i], new_id));
+
+      // This is an invalid stack
+      if (!valid && pinvalid_stacks == nullptr) {
+        continue;
       }
-      cs_new_stack.back() = util::convert_id<CsCFG::Id>(new_id);
-      new_stack.back() = new_id;
 
-      if (call_info.hasDynData() && !call_info.isValid(cs_new_stack)) {
-        if (pinvalid_stacks != nullptr) {
-          pinvalid_stacks->emplace_back(std::move(new_stack));
-        }
-        // This is an invalid stack
+      std::vector<CsCFG::Id> new_stack;
+      new_stack.reserve(stack.size() + 1);
+      new_stack.insert(std::end(new_stack), std::begin(stack),
+          std::end(stack));
+      new_stack.push_back(new_id);
+
+      if (!valid) {
+        pinvalid_stacks->emplace_back(std::move(new_stack));
         continue;
       }
       new_stacks.emplace_back(std::move(new_stack));
@@ -1272,7 +1392,7 @@ void Cg::resolveDirCalls(CgCache &base_cgs, CgCache &full_cgs,
     // If it is to a function within our scc (recursion), then connect those
     //   nodes
     } else {
-      llvm::dbgs() << "  called_fcn is: " << called_fcn->getName() << "\n";
+      dbg << "  called_fcn is: " << called_fcn->getName() << "\n";
 
       auto it = callInfo_.find(called_fcn);
       if (it != std::end(callInfo_)) {
@@ -1330,7 +1450,7 @@ void Cg::resolveCalls(CgCache &base_cgs, CgCache &full_cgs) {
     // Else add an external call constraint
     } else {
       // Check for indir info:
-      if (indir_info.hasInfo() && !no_spec) {
+      if (indir_info.hasInfo(ci) && !no_spec) {
         // llvm::dbgs() << "have indir info!\n";
         // llvm::dbgs() << "ci is: " << *ci << "\n";
         auto &targets = indir_info.getTargets(ci);
@@ -1383,6 +1503,11 @@ void Cg::resolveCalls(CgCache &base_cgs, CgCache &full_cgs) {
 }
 
 void Cg::lowerAllocs() {
+  // Number objects pointed to together next to each other
+  if (renumber_objs) {
+    vals_.reorderAllocs(clusterAllocs());
+  }
+
   // First remap w/in the allocation list
   auto remap = vals_.lowerAllocs();
 
@@ -1503,7 +1628,7 @@ void Cg::mergeScc(const Cg &rhs) {
   assert(rhs.indirCalls_.empty());
 
   // FIXME(ddevec) -- see below
-  llvm::dbgs() << "Connect localCFG?\n";
+  dbg << "Connect localCFG?\n";
 
   // Dun?
 }
@@ -1520,8 +1645,13 @@ CgCache::CgCache(const llvm::Module &m,
   std::unordered_set<const llvm::Function *> visited;
   auto &used_info = di.used_info;
 
+  // First, gather the SCCs to build, in module order, as pairs of the fcn
+  //   which names the SCC in map_ and the SCC's members
+  std::vector<std::pair<const llvm::Function *,
+    std::vector<const llvm::Function *>>> sccs;
+
   // For each fcn
-  llvm::dbgs() << "VISIT START\n";
+  dbg << "VISIT START\n";
   for (auto &fcn : m) {
     if (!used_info.isUsed(fcn) && !no_spec) {
       continue;
@@ -1538,7 +1668,6 @@ CgCache::CgCache(const llvm::Module &m,
     assert(it != en);
 
     auto first_fcn = *it;
-    it = std::next(it);
 
     // If it has not been visited (can be visited multiple times b/c of SCCs,
     //     this resolves that)
@@ -1547,33 +1676,118 @@ CgCache::CgCache(const llvm::Module &m,
       continue;
     }
 
-    llvm::dbgs() << " First fcn: " << first_fcn->getName() << "\n";
-    // Populate the first function locally
-    Cg cg(first_fcn, di, as, mod_info, ext_info, cs_cfg);
+    dbg << " First fcn: " << first_fcn->getName() << "\n";
+    sccs.emplace_back();
+    sccs.back().first = &fcn;
+    auto &scc = sccs.back().second;
+    scc.push_back(first_fcn);
 
-    // Combine any other functions internally
-    for (; it != en; it = std::next(it)) {
+    for (it = std::next(it); it != en; it = std::next(it)) {
       auto scc_fcn = *it;
       // Make sure we note they are visited
-      llvm::dbgs() << "  visit fcn: " << scc_fcn->getName() << "\n";
+      dbg << "  visit fcn: " << scc_fcn->getName() << "\n";
       if_debug_enabled(auto scc_rc = )
         visited.emplace(scc_fcn);
       assert(scc_rc.second);
 
+      scc.push_back(scc_fcn);
+    }
+  }
+
+  // Now build the Cgs.  SCCs are independent of each other, so they're built
+  //   in parallel.  Each SCC only writes its own slot of scc_cgs and scc_as,
+  //   and those are merged in module order below, so the result doesn't
+  //   depend on the thread schedule
+  //   Each SCC's dbg output is buffered, and printed in module order by this
+  //   thread once the workers are done
+  std::vector<std::unique_ptr<Cg>> scc_cgs(sccs.size());
+  std::vector<AssumptionSet> scc_as(sccs.size());
+  std::vector<std::string> scc_logs(sccs.size());
+
+  // Settle the struct table (and with it the largest struct) up front, so
+  //   no worker sees it mid-update
+  mod_info.addModuleStructs(m);
+
+  CgDiskCache disk_cache(m, di, mod_info, cg_cache_dir);
+
+  auto build_scc = [&sccs, &scc_cgs, &scc_as, &scc_logs, &disk_cache, &di,
+       &as, &mod_info, &ext_info, &cs_cfg](size_t idx) {
+    auto &scc = sccs[idx].second;
+    auto &local_as = scc_as[idx];
+
+    llvm::raw_string_ostream log(scc_logs[idx]);
+    ScopedDebugStream redirect(log);
+
+    // Unchanged SCCs are loaded from the on-disk cache
+    std::string key;
+    if (disk_cache.enabled()) {
+      key = disk_cache.getKey(scc);
+      auto cached = disk_cache.load(key, scc, as, local_as, mod_info,
+          ext_info, cs_cfg);
+      if (cached != nullptr) {
+        scc_cgs[idx] = std::move(cached);
+        return;
+      }
+    }
+
+    // Populate the first function locally
+    auto cg = std::make_unique<Cg>(scc[0], di, as, local_as, mod_info,
+        ext_info, cs_cfg);
+
+    // Combine any other functions internally
+    for (size_t i = 1; i < scc.size(); ++i) {
       // Parse the local function
-      Cg to_merge(scc_fcn, di, as, mod_info, ext_info, cs_cfg);
+      Cg to_merge(scc[i], di, as, local_as, mod_info, ext_info, cs_cfg);
 
       // Merge the scc components
-      cg.mergeScc(to_merge);
+      cg->mergeScc(to_merge);
     }
 
+    if (disk_cache.enabled()) {
+      disk_cache.store(key, scc, *cg, local_as);
+    }
+
+    scc_cgs[idx] = std::move(cg);
+  };
+
+  std::atomic<size_t> next_scc(0);
+  auto worker = [&next_scc, &sccs, &build_scc] {
+    for (size_t idx = next_scc++; idx < sccs.size(); idx = next_scc++) {
+      build_scc(idx);
+    }
+  };
+
+  size_t num_threads = (cg_threads > 0) ? static_cast<size_t>(cg_threads) :
+    std::max(1u, std::thread::hardware_concurrency());
+  num_threads = std::min(num_threads, sccs.size());
+
+  dbg << "Building " << sccs.size() << " SCC Cgs with " <<
+    num_threads << " threads\n";
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (size_t idx = 0; idx < sccs.size(); ++idx) {
+    auto fcn = sccs[idx].first;
+    llvm::dbgs() << scc_logs[idx];
+    as.merge(scc_as[idx]);
+
     // Insert the cg into my map
-    auto fcn_id = cfg_.getId(&fcn);
-    llvm::dbgs() << "Inserting fcn: " << fcn.getName() << " to " << fcn_id <<
+    auto fcn_id = cfg_.getId(fcn);
+    dbg << "Inserting fcn: " << fcn->getName() << " to " << fcn_id <<
       "\n";
-    map_.emplace(fcn_id, std::move(cg));
+    map_.emplace(fcn_id, std::move(*scc_cgs[idx]));
+  }
+  if (disk_cache.enabled()) {
+    disk_cache.printStats(llvm::dbgs());
   }
-  llvm::dbgs() << "VISIT STOP\n";
+  dbg << "VISIT STOP\n";
 }
 
 
@@ -1619,7 +1833,7 @@ Cg::Id Cg::getConstValue(const llvm::Constant *c) {
         // llvm::dbgs() << "getConstValue returns IntValue\n";
         return ValueMap::IntValue;
       case llvm::Instruction::PtrToInt:
-        llvm::dbgs() << __LINE__ << ": getConstValue returns IntValue\n";
+        dbg << __LINE__ << ": getConstValue returns IntValue\n";
         // assert(0);
         return ValueMap::IntValue;
       case llvm::Instruction::BitCast:
@@ -1756,11 +1970,11 @@ void Cg::constraintStats() const {
     }
   }
 
-  llvm::dbgs() << "Constraint stats for cg:\n";
-  llvm::dbgs() << "  AddressOf: " << num_addr << "\n";
-  llvm::dbgs() << "  Load: " << num_load << "\n";
-  llvm::dbgs() << "  Store: " << num_store << "\n";
-  llvm::dbgs() << "  Copy: " << num_copy << "\n";
-  llvm::dbgs() << "  GEP: " << num_gep << "\n";
+  dbg << "Constraint stats for cg:\n";
+  dbg << "  AddressOf: " << num_addr << "\n";
+  dbg << "  Load: " << num_load << "\n";
+  dbg << "  Store: " << num_store << "\n";
+  dbg << "  Copy: " << num_copy << "\n";
+  dbg << "  GEP: " << num_gep << "\n";
 }
 
@@ -0,0 +1,1077 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include "include/CgDiskCache.h"
+
+#include <openssl/sha.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "include/Assumptions.h"
+#include "include/LLVMHelper.h"
+
+extern llvm::cl::opt<bool> no_spec;
+
+static const char *CacheMagic = "specsfs-cg";
+
+// Helpers {{{
+static void writeString(std::ostream &o, const std::string &str) {
+  o << str.size() << " " << str;
+}
+
+static bool readString(std::istream &in, std::string &str) {
+  size_t len;
+  if (!(in >> len) || in.get() != ' ') {
+    return false;
+  }
+
+  str.resize(len);
+  return static_cast<bool>(in.read(&str[0], len));
+}
+
+template <typename id_type>
+static void writeId(std::ostream &o, id_type id) {
+  o << " " << static_cast<int64_t>(id.val());
+}
+
+template <typename id_type>
+static bool readId(std::istream &in, id_type &id) {
+  int64_t val;
+  if (!(in >> val)) {
+    return false;
+  }
+
+  id = id_type(static_cast<typename id_type::base_type>(val));
+  return true;
+}
+
+static bool expect(std::istream &in, const char *tag) {
+  std::string str;
+  return (in >> str) && str == tag;
+}
+//}}}
+
+// ValueRefs {{{
+class CgDiskCache::ValueRefs {
+ public:
+  ValueRefs(const llvm::Module &m, const CgDiskCache &cache,
+      const std::vector<const llvm::Function *> &fcns) :
+        m_(m), cache_(cache), fcns_(fcns), insts_(fcns.size()),
+        bbs_(fcns.size()) {
+    for (size_t i = 0; i < fcns.size(); ++i) {
+      fcnIdx_.emplace(fcns[i], i);
+
+      for (auto &bb : *fcns[i]) {
+        local_.emplace(&bb, std::make_pair(i, bbs_[i].size()));
+        bbs_[i].push_back(&bb);
+
+        for (auto &inst : bb) {
+          local_.emplace(&inst, std::make_pair(i, insts_[i].size()));
+          insts_[i].push_back(&inst);
+        }
+      }
+    }
+  }
+
+  // Writes a reference to |val|, false if |val| has no stable reference
+  bool write(std::ostream &o, const llvm::Value *val) {
+    if (val == nullptr) {
+      o << " n";
+      return true;
+    }
+
+    if (auto gv = dyn_cast<llvm::GlobalValue>(val)) {
+      if (gv->hasName()) {
+        o << " g ";
+        writeString(o, gv->getName().str());
+        return true;
+      }
+
+      auto it = cache_.unnamedIdx_.find(gv);
+      if (it == std::end(cache_.unnamedIdx_)) {
+        return false;
+      }
+
+      o << " u " << it->second;
+      return true;
+    }
+
+    if (auto arg = dyn_cast<llvm::Argument>(val)) {
+      auto it = fcnIdx_.find(arg->getParent());
+      if (it == std::end(fcnIdx_)) {
+        return false;
+      }
+
+      o << " a " << it->second << " " << arg->getArgNo();
+      return true;
+    }
+
+    if (llvm::isa<llvm::Instruction>(val) ||
+        llvm::isa<llvm::BasicBlock>(val)) {
+      auto it = local_.find(val);
+      if (it == std::end(local_)) {
+        return false;
+      }
+
+      o << (llvm::isa<llvm::Instruction>(val) ? " i " : " b ") <<
+        it->second.first << " " << it->second.second;
+      return true;
+    }
+
+    if (auto c = dyn_cast<llvm::Constant>(val)) {
+      // Other constants are found as (nested) operands of our instructions
+      if (!pathsBuilt_) {
+        buildConstPaths();
+      }
+
+      auto it = constPaths_.find(c);
+      if (it == std::end(constPaths_)) {
+        return false;
+      }
+
+      auto &path = it->second;
+      o << " c " << path.size();
+      for (auto idx : path) {
+        o << " " << idx;
+      }
+      return true;
+    }
+
+    return false;
+  }
+
+  bool read(std::istream &in, const llvm::Value *&val) {
+    std::string kind;
+    if (!(in >> kind) || kind.size() != 1) {
+      return false;
+    }
+
+    switch (kind[0]) {
+      case 'n':
+        val = nullptr;
+        return true;
+      case 'g':
+        {
+          std::string name;
+          if (!readString(in, name)) {
+            return false;
+          }
+          val = m_.getNamedValue(name);
+          return val != nullptr;
+        }
+      case 'u':
+        {
+          size_t idx;
+          if (!(in >> idx) || idx >= cache_.unnamedGlobals_.size()) {
+            return false;
+          }
+          val = cache_.unnamedGlobals_[idx];
+          return true;
+        }
+      case 'a':
+        {
+          size_t fcn_idx, arg_no;
+          if (!(in >> fcn_idx >> arg_no) || fcn_idx >= fcns_.size() ||
+              arg_no >= fcns_[fcn_idx]->arg_size()) {
+            return false;
+          }
+          auto it = fcns_[fcn_idx]->arg_begin();
+          std::advance(it, arg_no);
+          val = &*it;
+          return true;
+        }
+      case 'i':
+      case 'b':
+        {
+          auto &table = (kind[0] == 'i') ? insts_ : bbs_;
+          size_t fcn_idx, idx;
+          if (!(in >> fcn_idx >> idx) || fcn_idx >= table.size() ||
+              idx >= table[fcn_idx].size()) {
+            return false;
+          }
+          val = table[fcn_idx][idx];
+          return true;
+        }
+      case 'c':
+        {
+          size_t len;
+          std::vector<size_t> path;
+          if (!(in >> len) || len < 3) {
+            return false;
+          }
+          path.resize(len);
+          for (auto &idx : path) {
+            if (!(in >> idx)) {
+              return false;
+            }
+          }
+
+          if (path[0] >= insts_.size() || path[1] >= insts_[path[0]].size()) {
+            return false;
+          }
+
+          auto user = cast<llvm::User>(insts_[path[0]][path[1]]);
+          const llvm::Value *cur = nullptr;
+          for (size_t i = 2; i < len; ++i) {
+            if (user == nullptr || path[i] >= user->getNumOperands()) {
+              return false;
+            }
+            cur = user->getOperand(path[i]);
+            user = dyn_cast<llvm::Constant>(cur);
+          }
+
+          val = cur;
+          return llvm::isa<llvm::Constant>(val);
+        }
+      default:
+        return false;
+    }
+  }
+
+ private:
+  void buildConstPaths() {
+    std::vector<size_t> path;
+    for (size_t i = 0; i < insts_.size(); ++i) {
+      for (size_t j = 0; j < insts_[i].size(); ++j) {
+        path = { i, j };
+        addConstPaths(cast<llvm::User>(insts_[i][j]), path);
+      }
+    }
+    pathsBuilt_ = true;
+  }
+
+  void addConstPaths(const llvm::User *user, std::vector<size_t> &path) {
+    for (size_t i = 0; i < user->getNumOperands(); ++i) {
+      auto c = dyn_cast<llvm::Constant>(user->getOperand(i));
+      // Globals are referred to by name
+      if (c == nullptr || llvm::isa<llvm::GlobalValue>(c)) {
+        continue;
+      }
+
+      path.push_back(i);
+      if (constPaths_.emplace(c, path).second) {
+        addConstPaths(c, path);
+      }
+      path.pop_back();
+    }
+  }
+
+  const llvm::Module &m_;
+  const CgDiskCache &cache_;
+  const std::vector<const llvm::Function *> &fcns_;
+
+  std::unordered_map<const llvm::Function *, size_t> fcnIdx_;
+  // Instructions and BBs of each fcn, by position
+  std::vector<std::vector<const llvm::Value *>> insts_;
+  std::vector<std::vector<const llvm::Value *>> bbs_;
+  std::unordered_map<const llvm::Value *, std::pair<size_t, size_t>> local_;
+
+  bool pathsBuilt_ = false;
+  std::unordered_map<const llvm::Constant *, std::vector<size_t>>
+    constPaths_;
+};
+//}}}
+
+// IR hashing {{{
+namespace {
+
+// Writes a canonical text form of the parts of the IR constraint generation
+//   looks at.  Locals are numbered by position rather than printed with their
+//   slots, so unrelated changes elsewhere in the module (e.g. metadata
+//   numbering) don't invalidate the entry
+class IRHasher {
+ public:
+  IRHasher(const DynamicInfo &dyn_info,
+      const std::unordered_map<const llvm::GlobalValue *, size_t> &unnamed) :
+        dynInfo_(dyn_info), unnamed_(unnamed), os_(buf_) { }
+
+  void addFunction(const llvm::Function &fcn) {
+    std::unordered_map<const llvm::Value *, size_t> local;
+    size_t bb_idx = 0;
+    size_t inst_idx = 0;
+    for (auto &bb : fcn) {
+      local.emplace(&bb, bb_idx++);
+      for (auto &inst : bb) {
+        local.emplace(&inst, inst_idx++);
+      }
+    }
+
+    os_ << "F ";
+    addValue(&fcn, local);
+    os_ << " ";
+    fcn.getFunctionType()->print(os_);
+    noteType(fcn.getFunctionType());
+    os_ << "\n";
+
+    for (auto &bb : fcn) {
+      os_ << "B " << local.at(&bb) << " " << dynInfo_.used_info.isUsed(bb) <<
+        "\n";
+
+      for (auto &inst : bb) {
+        os_ << inst.getOpcodeName() << " ";
+        inst.getType()->print(os_);
+
+        noteType(inst.getType());
+
+        if (auto ai = dyn_cast<llvm::AllocaInst>(&inst)) {
+          os_ << " ";
+          ai->getAllocatedType()->print(os_);
+          noteType(ai->getAllocatedType());
+        } else if (auto gep = dyn_cast<llvm::GetElementPtrInst>(&inst)) {
+          os_ << " ";
+          gep->getSourceElementType()->print(os_);
+          noteType(gep->getSourceElementType());
+        } else if (auto ev = dyn_cast<llvm::ExtractValueInst>(&inst)) {
+          for (auto idx : ev->getIndices()) {
+            os_ << " " << idx;
+          }
+        } else if (auto iv = dyn_cast<llvm::InsertValueInst>(&inst)) {
+          for (auto idx : iv->getIndices()) {
+            os_ << " " << idx;
+          }
+        } else if (auto phi = dyn_cast<llvm::PHINode>(&inst)) {
+          for (auto pred_bb : phi->blocks()) {
+            os_ << " " << local.at(pred_bb);
+          }
+        } else if (auto cmp = dyn_cast<llvm::CmpInst>(&inst)) {
+          os_ << " " << cmp->getPredicate();
+        } else if (auto ci = dyn_cast<llvm::CallInst>(&inst)) {
+          // The callee's signature, ExtLibInfo keys on the name, and we
+          //   treat declarations differently than definitions
+          auto callee = LLVMHelper::getFcnFromCall(ci);
+          if (callee != nullptr) {
+            os_ << " -> " << callee->isDeclaration() << " " <<
+              dynInfo_.used_info.isUsed(callee) << " ";
+            callee->getFunctionType()->print(os_);
+            noteType(callee->getFunctionType());
+          }
+        }
+
+        os_ << " (";
+        for (auto &op : inst.operands()) {
+          os_ << " ";
+          addValue(op.get(), local);
+        }
+        os_ << " )\n";
+      }
+    }
+  }
+
+  // Writes the layout of every struct type the functions added so far
+  //   reach, so only changes to those structs invalidate the entry
+  void addStructs() {
+    for (auto st : structs_) {
+      st->print(os_);
+      os_ << " " << st->isLiteral() << " " << st->isPacked() << " " <<
+        st->isOpaque() << " {";
+      for (auto elm : st->elements()) {
+        os_ << " ";
+        elm->print(os_);
+      }
+      os_ << " }\n";
+    }
+  }
+
+  std::string finish() {
+    os_.flush();
+
+    unsigned char raw[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char *>(buf_.data()), buf_.size(),
+        raw);
+
+    static const char *hex = "0123456789abcdef";
+    std::string ret;
+    for (auto c : raw) {
+      ret.push_back(hex[c >> 4]);
+      ret.push_back(hex[c & 0xf]);
+    }
+    return ret;
+  }
+
+  llvm::raw_ostream &os() {
+    return os_;
+  }
+
+ private:
+  // Notes the structs reachable from |type|: through struct fields,
+  //   array/vector elements, function signatures and pointees
+  void noteType(llvm::Type *type) {
+    if (!seenTypes_.insert(type).second) {
+      return;
+    }
+
+    if (auto st = dyn_cast<llvm::StructType>(type)) {
+      structs_.push_back(st);
+    }
+
+    for (auto sub : type->subtypes()) {
+      noteType(sub);
+    }
+  }
+
+  void addValue(const llvm::Value *val,
+      const std::unordered_map<const llvm::Value *, size_t> &local) {
+    noteType(val->getType());
+    if (auto gv = dyn_cast<llvm::GlobalValue>(val)) {
+      if (gv->hasName()) {
+        os_ << "@" << gv->getName();
+      } else {
+        os_ << "@#" << unnamed_.at(gv);
+      }
+    } else if (auto arg = dyn_cast<llvm::Argument>(val)) {
+      os_ << "a" << arg->getArgNo();
+    } else if (llvm::isa<llvm::Instruction>(val)) {
+      os_ << "i" << local.at(val);
+    } else if (llvm::isa<llvm::BasicBlock>(val)) {
+      os_ << "b" << local.at(val);
+    } else if (auto ce = dyn_cast<llvm::ConstantExpr>(val)) {
+      os_ << ce->getOpcodeName() << " ";
+      ce->getType()->print(os_);
+      if (ce->isCompare()) {
+        os_ << " " << ce->getPredicate();
+      }
+      if (ce->hasIndices()) {
+        for (auto idx : ce->getIndices()) {
+          os_ << " " << idx;
+        }
+      }
+      os_ << " (";
+      for (auto &op : ce->operands()) {
+        os_ << " ";
+        addValue(op.get(), local);
+      }
+      os_ << " )";
+    } else if (auto c = dyn_cast<llvm::Constant>(val)) {
+      if (c->getNumOperands() == 0) {
+        // Leaf data (ints, nulls, data arrays, ...)
+        c->print(os_);
+      } else {
+        os_ << "C" << c->getValueID() << " ";
+        c->getType()->print(os_);
+        os_ << " (";
+        for (auto &op : c->operands()) {
+          os_ << " ";
+          addValue(op.get(), local);
+        }
+        os_ << " )";
+      }
+    } else {
+      // Metadata, inline asm, ...
+      val->print(os_);
+    }
+  }
+
+  const DynamicInfo &dynInfo_;
+  const std::unordered_map<const llvm::GlobalValue *, size_t> &unnamed_;
+  std::unordered_set<llvm::Type *> seenTypes_;
+  // In the order first reached, so the key is deterministic
+  std::vector<llvm::StructType *> structs_;
+  std::string buf_;
+  llvm::raw_string_ostream os_;
+};
+
+}  // namespace
+//}}}
+
+CgDiskCache::CgDiskCache(const llvm::Module &m, const DynamicInfo &dyn_info,
+    const ModInfo &mod_info, std::string dir) :
+      m_(m), dynInfo_(dyn_info), dir_(std::move(dir)) {
+  if (!enabled()) {
+    return;
+  }
+
+  if (auto ec = llvm::sys::fs::create_directories(dir_)) {
+    llvm::errs() << "WARNING: Cannot create Cg cache directory " << dir_ <<
+      ": " << ec.message() << ", disabling Cg cache\n";
+    dir_.clear();
+    return;
+  }
+
+  auto add_unnamed = [this] (const llvm::GlobalValue &gv) {
+    if (!gv.hasName()) {
+      unnamedIdx_.emplace(&gv, unnamedGlobals_.size());
+      unnamedGlobals_.push_back(&gv);
+    }
+  };
+  for (auto &gv : m.globals()) {
+    add_unnamed(gv);
+  }
+  for (auto &fcn : m) {
+    add_unnamed(fcn);
+  }
+  for (auto &ga : m.aliases()) {
+    add_unnamed(ga);
+  }
+
+  // The module wide state which changes what constraints we generate
+  IRHasher hasher(dynInfo_, unnamedIdx_);
+  auto &os = hasher.os();
+  os << CacheMagic << " " << Version << " " << no_spec << " " <<
+    dynInfo_.used_info.hasInfo() << "\n";
+
+  // The largest struct, which unknown allocations are given the type of
+  auto &max_si = mod_info.getMaxStructInfo();
+  os << "max ";
+  max_si.type()->print(os);
+  os << " " << max_si << " [";
+  for (auto strong : max_si.strongs()) {
+    os << " " << static_cast<int32_t>(strong);
+  }
+  os << " ]\n";
+  envKey_ = hasher.finish();
+}
+
+std::string CgDiskCache::getKey(
+    const std::vector<const llvm::Function *> &fcns) const {
+  IRHasher hasher(dynInfo_, unnamedIdx_);
+  hasher.os() << envKey_ << "\n";
+
+  for (auto fcn : fcns) {
+    hasher.addFunction(*fcn);
+  }
+  hasher.addStructs();
+
+  return hasher.finish();
+}
+
+std::string CgDiskCache::getPath(const std::string &key) const {
+  return dir_ + "/" + key + ".cg";
+}
+
+// Serialization {{{
+bool CgDiskCache::writeCallInfo(std::ostream &o, const CallInfo &ci,
+    ValueRefs &refs) const {
+  o << " " << ci.args_.size();
+  for (auto id : ci.args_) {
+    writeId(o, id);
+  }
+  writeId(o, ci.ret_);
+  writeId(o, ci.varArg_);
+  return refs.write(o, ci.ci_);
+}
+
+bool CgDiskCache::readCallInfo(std::istream &in, std::unique_ptr<CallInfo> &ci,
+    ValueRefs &refs) const {
+  size_t num_args;
+  if (!(in >> num_args)) {
+    return false;
+  }
+
+  std::vector<CallInfo::Id> args(num_args);
+  for (auto &id : args) {
+    if (!readId(in, id)) {
+      return false;
+    }
+  }
+
+  CallInfo::Id ret, var_arg;
+  const llvm::Value *val;
+  if (!readId(in, ret) || !readId(in, var_arg) || !refs.read(in, val) ||
+      (val != nullptr && !llvm::isa<llvm::Instruction>(val))) {
+    return false;
+  }
+
+  ci.reset(new CallInfo(std::move(args), ret, var_arg,
+        llvm::cast_or_null<llvm::Instruction>(val)));
+  return true;
+}
+
+bool CgDiskCache::writeVals(std::ostream &o, const ValueMap &vals,
+    ValueRefs &refs) const {
+  o << "map " << vals.map_.size();
+  for (auto val : vals.map_) {
+    if (!refs.write(o, val)) {
+      return false;
+    }
+  }
+
+  // Only unresolved Cgs are cached, and they have imported nothing
+  if (!vals.revLayers_.empty()) {
+    return false;
+  }
+
+  o << "\nrev " << vals.revMap_->size();
+  for (auto &pr : *vals.revMap_) {
+    if (!refs.write(o, pr.first)) {
+      return false;
+    }
+    writeId(o, pr.second);
+  }
+
+  o << "\nconst " << vals.constMap_.size();
+  for (auto &pr : vals.constMap_) {
+    if (!refs.write(o, pr.first)) {
+      return false;
+    }
+    writeId(o, pr.second);
+  }
+
+  o << "\nallocrev " << vals.allocRevMap_.size();
+  for (auto &pr : vals.allocRevMap_) {
+    if (!refs.write(o, pr.first)) {
+      return false;
+    }
+    o << " " << pr.second.size();
+    for (auto id : pr.second) {
+      writeId(o, id);
+    }
+  }
+
+  o << "\nallocs " << vals.allocs_.size();
+  for (auto &pr : vals.allocs_) {
+    writeId(o, pr.first);
+    o << " " << pr.second;
+  }
+
+  o << "\nnamed " << vals.named_.size();
+  for (auto &pr : vals.named_) {
+    o << " ";
+    writeString(o, pr.first);
+    writeId(o, pr.second);
+  }
+
+  o << "\nmaxalloc";
+  writeId(o, vals.maxAllocId_);
+  writeId(o, vals.maxReserveAllocId_);
+
+  // Only the non-trivial union-find entries
+  std::vector<std::pair<ValueMap::Id, ValueMap::Id>> reps;
+  for (size_t i = 0; i < vals.map_.size(); ++i) {
+    ValueMap::Id id(i);
+    auto rep = vals.getRep(id);
+    if (rep != id) {
+      reps.emplace_back(id, rep);
+    }
+  }
+
+  o << "\nreps " << reps.size();
+  for (auto &pr : reps) {
+    writeId(o, pr.first);
+    writeId(o, pr.second);
+  }
+  o << "\n";
+
+  return true;
+}
+
+bool CgDiskCache::readVals(std::istream &in, ValueMap &vals,
+    ValueRefs &refs) const {
+  size_t size;
+  if (!expect(in, "map") || !(in >> size)) {
+    return false;
+  }
+  vals.map_.resize(size);
+  for (auto &val : vals.map_) {
+    if (!refs.read(in, val)) {
+      return false;
+    }
+  }
+  vals.reps_ = util::UnionFind<ValueMap::Id>(size);
+
+  if (!expect(in, "rev") || !(in >> size)) {
+    return false;
+  }
+  auto &rev_map = vals.ownRevMap();
+  rev_map.clear();
+  vals.revLayers_.clear();
+  vals.revIndexValid_ = false;
+  for (size_t i = 0; i < size; ++i) {
+    const llvm::Value *val;
+    ValueMap::Id id;
+    if (!refs.read(in, val) || !readId(in, id)) {
+      return false;
+    }
+    rev_map.emplace(val, id);
+  }
+
+  if (!expect(in, "const") || !(in >> size)) {
+    return false;
+  }
+  vals.constMap_.clear();
+  for (size_t i = 0; i < size; ++i) {
+    const llvm::Value *val;
+    ValueMap::Id id;
+    if (!refs.read(in, val) || !readId(in, id) ||
+        val == nullptr || !llvm::isa<llvm::Constant>(val)) {
+      return false;
+    }
+    vals.constMap_.emplace(cast<llvm::Constant>(val), id);
+  }
+
+  if (!expect(in, "allocrev") || !(in >> size)) {
+    return false;
+  }
+  vals.allocRevMap_.clear();
+  for (size_t i = 0; i < size; ++i) {
+    const llvm::Value *val;
+    size_t num_ids;
+    if (!refs.read(in, val) || !(in >> num_ids)) {
+      return false;
+    }
+    auto &ids = vals.allocRevMap_[val];
+    ids.resize(num_ids);
+    for (auto &id : ids) {
+      if (!readId(in, id)) {
+        return false;
+      }
+    }
+  }
+
+  if (!expect(in, "allocs") || !(in >> size)) {
+    return false;
+  }
+  vals.allocs_.resize(size);
+  for (auto &pr : vals.allocs_) {
+    if (!readId(in, pr.first) || !(in >> pr.second)) {
+      return false;
+    }
+  }
+
+  if (!expect(in, "named") || !(in >> size)) {
+    return false;
+  }
+  vals.named_.clear();
+  for (size_t i = 0; i < size; ++i) {
+    std::string name;
+    ValueMap::Id id;
+    if (!readString(in, name) || !readId(in, id)) {
+      return false;
+    }
+    vals.named_.emplace(std::move(name), id);
+  }
+
+  if (!expect(in, "maxalloc") || !readId(in, vals.maxAllocId_) ||
+      !readId(in, vals.maxReserveAllocId_)) {
+    return false;
+  }
+
+  if (!expect(in, "reps") || !(in >> size)) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    ValueMap::Id id, rep;
+    if (!readId(in, id) || !readId(in, rep) ||
+        static_cast<size_t>(id) >= vals.map_.size() ||
+        static_cast<size_t>(rep) >= vals.map_.size()) {
+      return false;
+    }
+    vals.reps_.merge(rep, id);
+  }
+
+  return true;
+}
+
+bool CgDiskCache::writeCg(std::ostream &o, const Cg &cg,
+    ValueRefs &refs) const {
+  if (!writeVals(o, cg.vals_, refs)) {
+    return false;
+  }
+
+  o << "callinfo " << cg.callInfo_.size();
+  for (auto &pr : cg.callInfo_) {
+    if (!refs.write(o, pr.first) ||
+        !writeCallInfo(o, pr.second.first, refs)) {
+      return false;
+    }
+    o << " " << static_cast<uint32_t>(pr.second.second);
+  }
+
+  o << "\ncalls " << cg.calls_.size();
+  for (auto &ci : cg.calls_) {
+    if (!writeCallInfo(o, ci, refs)) {
+      return false;
+    }
+  }
+
+  o << "\nindir " << cg.indirCalls_.size();
+  for (auto &tup : cg.indirCalls_) {
+    writeId(o, std::get<0>(tup));
+    if (!writeCallInfo(o, std::get<1>(tup), refs)) {
+      return false;
+    }
+    o << " " << static_cast<uint32_t>(std::get<2>(tup));
+  }
+
+  o << "\ncons " << cg.constraints_.size();
+  for (auto &cons : cg.constraints_) {
+    o << " " << static_cast<int32_t>(cons.type());
+    writeId(o, cons.src());
+    writeId(o, cons.dest());
+    writeId(o, cons.rep());
+    o << " " << cons.offs();
+  }
+
+  o << "\ncfg " << cg.localCFG_.size();
+  for (size_t i = 0; i < cg.localCFG_.size(); ++i) {
+    auto &node = cg.localCFG_.getNode(CsFcnCFG::Id(i));
+    if (!refs.write(o, node.fcn()) || !writeCallInfo(o, node.ci(), refs)) {
+      return false;
+    }
+    o << " " << node.preds().size();
+    for (auto pred : node.preds()) {
+      o << " " << static_cast<uint32_t>(pred);
+    }
+  }
+
+  o << "\ncfgid " << static_cast<uint32_t>(cg.cfgId_) << "\n";
+
+  return true;
+}
+
+bool CgDiskCache::readCg(std::istream &in, Cg &cg, ValueRefs &refs) const {
+  if (!readVals(in, cg.vals_, refs)) {
+    return false;
+  }
+
+  size_t size;
+  if (!expect(in, "callinfo") || !(in >> size)) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    const llvm::Value *val;
+    std::unique_ptr<CallInfo> ci;
+    uint32_t cfg_id;
+    if (!refs.read(in, val) || val == nullptr ||
+        !llvm::isa<llvm::Function>(val) ||
+        !readCallInfo(in, ci, refs) || !(in >> cfg_id)) {
+      return false;
+    }
+    cg.callInfo_.emplace(std::piecewise_construct,
+        std::make_tuple(cast<llvm::Function>(val)),
+        std::make_tuple(std::move(*ci), CsFcnCFG::Id(cfg_id)));
+  }
+
+  if (!expect(in, "calls") || !(in >> size)) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    std::unique_ptr<CallInfo> ci;
+    if (!readCallInfo(in, ci, refs)) {
+      return false;
+    }
+    cg.calls_.emplace_back(std::move(*ci));
+  }
+
+  if (!expect(in, "indir") || !(in >> size)) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    Cg::Id id;
+    std::unique_ptr<CallInfo> ci;
+    uint32_t cfg_id;
+    if (!readId(in, id) || !readCallInfo(in, ci, refs) || !(in >> cfg_id)) {
+      return false;
+    }
+    cg.indirCalls_.emplace_back(id, std::move(*ci), CsFcnCFG::Id(cfg_id));
+  }
+
+  if (!expect(in, "cons") || !(in >> size)) {
+    return false;
+  }
+  cg.constraints_.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    int32_t type, offs;
+    Cg::Id src, dest, rep;
+    if (!(in >> type) || !readId(in, src) || !readId(in, dest) ||
+        !readId(in, rep) || !(in >> offs)) {
+      return false;
+    }
+    cg.constraints_.emplace_back(static_cast<ConstraintType>(type), src, dest,
+        rep, offs);
+  }
+
+  if (!expect(in, "cfg") || !(in >> size)) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    const llvm::Value *val;
+    std::unique_ptr<CallInfo> ci;
+    size_t num_preds;
+    if (!refs.read(in, val) || val == nullptr ||
+        !llvm::isa<llvm::Function>(val) ||
+        !readCallInfo(in, ci, refs) || !(in >> num_preds)) {
+      return false;
+    }
+
+    auto node_id = cg.localCFG_.addNode(cast<llvm::Function>(val), *ci);
+    auto &node = cg.localCFG_.getNode(node_id);
+    for (size_t j = 0; j < num_preds; ++j) {
+      uint32_t pred;
+      if (!(in >> pred)) {
+        return false;
+      }
+      node.addPred(CsFcnCFG::Id(pred));
+    }
+  }
+
+  uint32_t cfg_id;
+  if (!expect(in, "cfgid") || !(in >> cfg_id)) {
+    return false;
+  }
+  cg.cfgId_ = CsFcnCFG::Id(cfg_id);
+
+  return true;
+}
+//}}}
+
+std::unique_ptr<Cg> CgDiskCache::load(const std::string &key,
+    const std::vector<const llvm::Function *> &fcns,
+    AssumptionSet &as, AssumptionSet &scan_as,
+    ModInfo &mod_info, ExtLibInfo &ext_info, CsCFG &cs_cfg) {
+  std::ifstream in(getPath(key));
+  if (!in.is_open()) {
+    misses_++;
+    return nullptr;
+  }
+
+  ValueRefs refs(m_, *this, fcns);
+  std::unique_ptr<Cg> ret(new Cg(dynInfo_, as, mod_info, ext_info, cs_cfg));
+  AssumptionSet dead_as;
+
+  auto read_entry = [this, &in, &key, &fcns, &refs, &ret, &dead_as] {
+    std::string file_key;
+    int32_t version;
+    size_t num_fcns;
+    if (!expect(in, CacheMagic) || !(in >> version) || version != Version ||
+        !readString(in, file_key) || file_key != key ||
+        !expect(in, "fcns") || !(in >> num_fcns) ||
+        num_fcns != fcns.size()) {
+      return false;
+    }
+
+    for (auto fcn : fcns) {
+      const llvm::Value *val;
+      if (!refs.read(in, val) || val != fcn) {
+        return false;
+      }
+    }
+
+    if (!readCg(in, *ret, refs)) {
+      return false;
+    }
+
+    size_t num_dead;
+    if (!expect(in, "dead") || !(in >> num_dead)) {
+      return false;
+    }
+    for (size_t i = 0; i < num_dead; ++i) {
+      const llvm::Value *val;
+      if (!refs.read(in, val) || val == nullptr ||
+          !llvm::isa<llvm::BasicBlock>(val)) {
+        return false;
+      }
+      dead_as.add(std::unique_ptr<Assumption>(new DeadCodeAssumption(
+              const_cast<llvm::BasicBlock *>(cast<llvm::BasicBlock>(val)))));
+    }
+
+    return expect(in, "end");
+  };
+
+  if (!read_entry()) {
+    // Corrupt, or a hash collision -- either way, rebuild it
+    dbg << "WARNING: Discarding bad Cg cache entry: " <<
+      getPath(key) << "\n";
+    stale_++;
+    misses_++;
+    return nullptr;
+  }
+
+  scan_as.merge(dead_as);
+  hits_++;
+  return ret;
+}
+
+void CgDiskCache::store(const std::string &key,
+    const std::vector<const llvm::Function *> &fcns,
+    const Cg &cg, const AssumptionSet &scan_as) {
+  ValueRefs refs(m_, *this, fcns);
+  std::ostringstream o;
+
+  auto write_entry = [this, &o, &key, &fcns, &refs, &cg, &scan_as] {
+    o << CacheMagic << " " << Version << " ";
+    writeString(o, key);
+    o << "\nfcns " << fcns.size();
+    for (auto fcn : fcns) {
+      if (!refs.write(o, fcn)) {
+        return false;
+      }
+    }
+    o << "\n";
+
+    if (!writeCg(o, cg, refs)) {
+      return false;
+    }
+
+    // Only DeadCode assumptions are made while scanning
+    o << "dead " << scan_as.size();
+    for (auto &pasm : scan_as) {
+      auto dead = dyn_cast<DeadCodeAssumption>(pasm.get());
+      if (dead == nullptr || !refs.write(o, dead->bb())) {
+        return false;
+      }
+    }
+    o << "\nend\n";
+
+    return true;
+  };
+
+  if (!write_entry()) {
+    uncacheable_++;
+    return;
+  }
+
+  // Write then rename, so concurrent runs (or threads) never see a partial
+  //   entry.  The temp file name is unique across processes and threads
+  auto path = getPath(key);
+  int fd;
+  llvm::SmallString<128> tmp_path;
+  if (llvm::sys::fs::createUniqueFile(path + ".tmp.%%%%%%%%", fd,
+        tmp_path)) {
+    llvm::errs() << "WARNING: Cannot create Cg cache entry: " << path <<
+      "\n";
+    return;
+  }
+
+  {
+    llvm::raw_fd_ostream out(fd, true);
+    out << o.str();
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::errs() << "WARNING: Cannot write Cg cache entry: " <<
+        tmp_path << "\n";
+      llvm::sys::fs::remove(tmp_path);
+      return;
+    }
+  }
+
+  if (llvm::sys::fs::rename(tmp_path, path)) {
+    llvm::sys::fs::remove(tmp_path);
+    return;
+  }
+
+  stores_++;
+}
+
+void CgDiskCache::printStats(llvm::raw_ostream &o) const {
+  o << "CgDiskCache: " << hits_ << " hits, " << misses_ << " misses (" <<
+    stale_ << " stale), " << stores_ << " stored, " << uncacheable_ <<
+    " uncacheable\n";
+}
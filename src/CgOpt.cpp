@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include "include/CgOpt.h"
+
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/Debug.h"
+
+#include "include/RunTarjans.h"
+
+// HU levels relabeling fewer SCCs than this are labeled serially, wider ones
+//   are handed out to threads in chunks
+static const size_t ParallelLevelMin = 4096;
+static const size_t ParallelLevelChunk = 256;
+
+HUState::Stats HUState::label(OptGraph &graph,
+    const std::vector<size_t> &node_key, size_t num_threads) {
+  Stats stats;
+
+  // Tarjan's collapses the SCCs and visits them in topological order (preds
+  //   first).  Here we only resolve each SCC's preds to reps and record its
+  //   level in the condensed DAG, so the SCCs of a level can be labeled at once
+  struct SccInfo {
+    GraphId rep;
+    size_t key;
+    std::vector<GraphId> preds;
+    std::vector<size_t> predKeys;
+  };
+
+  std::vector<SccInfo> sccs;
+  std::vector<GraphId> &scc_reps = sccReps_;
+  scc_reps.clear();
+  std::vector<GraphId> key_rep(numKeys(), GraphId::invalid());
+  std::vector<uint32_t> node_level(graph.size(), 0);
+  std::vector<std::vector<size_t>> levels;
+  auto visit_scc = [&graph, &node_key, &sccs, &scc_reps, &key_rep,
+       &node_level, &levels] (HVNNode &node, GraphId node_id) {
+    auto node_rep = graph.getRep(node_id);
+    auto key = node_key[static_cast<size_t>(node_rep)];
+    scc_reps.push_back(node_rep);
+    if (key >= key_rep.size()) {
+      key_rep.resize(key + 1, GraphId::invalid());
+    }
+    key_rep[key] = node_rep;
+
+    node.cleanPreds();
+
+    std::vector<GraphId> preds;
+    uint32_t level = 0;
+    for (auto pred_id : node.preds()) {
+      if (node.isImplicitPred(pred_id)) {
+        continue;
+      }
+
+      // skip pointers to self
+      auto pred_rep = graph.getRep(pred_id);
+      if (pred_rep == node_rep) {
+        continue;
+      }
+
+      preds.push_back(pred_rep);
+      level = std::max(level,
+          node_level[static_cast<size_t>(pred_rep)] + 1);
+    }
+    std::sort(std::begin(preds), std::end(preds));
+    preds.erase(std::unique(std::begin(preds), std::end(preds)),
+        std::end(preds));
+
+    std::vector<size_t> pred_keys;
+    for (auto pred_rep : preds) {
+      pred_keys.push_back(node_key[static_cast<size_t>(pred_rep)]);
+    }
+    std::sort(std::begin(pred_keys), std::end(pred_keys));
+
+    node_level[static_cast<size_t>(node_rep)] = level;
+    if (level >= levels.size()) {
+      levels.resize(level + 1);
+    }
+    levels[level].push_back(sccs.size());
+    sccs.push_back({node_rep, key, std::move(preds), std::move(pred_keys)});
+  };
+
+  // graph.printDotFile("HVNStart.dot", *g_omap);
+  // Finally run Tarjan's:
+  run_tarjans(graph, visit_scc);
+
+  // Graph::getNode() compresses union-find paths, so take direct node
+  //   pointers before going parallel
+  std::vector<HVNNode *> rep_nodes(graph.size(), nullptr);
+  for (auto rep_id : scc_reps) {
+    rep_nodes[static_cast<size_t>(rep_id)] = &graph.getNode(rep_id);
+  }
+
+  // Gathers the PEs an SCC gets from its preds.  Only reads the preds' labels
+  //   (and not through SparseBitmap::test(), which moves the bitmap's cursor),
+  //   and allocates no bitmap elements, as StackAlloc's free list is shared,
+  //   so it's safe to run on many SCCs of a level at once
+  auto gather_preds = [&sccs, &rep_nodes] (size_t idx,
+      std::vector<int32_t> &pes) {
+    for (auto pred_rep : sccs[idx].preds) {
+      auto &pred_pts = rep_nodes[static_cast<size_t>(pred_rep)]->ptsto();
+
+      // If the pred node isn't a non_ptr
+      if (!pred_pts.empty() && *std::begin(pred_pts) == HVNNode::PENonPtr) {
+        continue;
+      }
+      pes.insert(std::end(pes), std::begin(pred_pts), std::end(pred_pts));
+    }
+    std::sort(std::begin(pes), std::end(pes));
+    pes.erase(std::unique(std::begin(pes), std::end(pes)), std::end(pes));
+  };
+
+  // Every pred of an SCC is in a lower level, so its label (and whether it
+  //   changed) is final by the time the SCC's level is labeled.  An SCC with
+  //   the same inputs as last round, none of whose preds' labels changed,
+  //   takes its old label back instead of being relabeled
+  std::vector<bool> changed(graph.size(), false);
+  for (auto &level : levels) {
+    std::vector<size_t> relabel;
+    for (auto idx : level) {
+      auto &scc = sccs[idx];
+      auto &node = *rep_nodes[static_cast<size_t>(scc.rep)];
+
+      bool pred_changed = false;
+      for (auto pred_rep : scc.preds) {
+        pred_changed |= changed[static_cast<size_t>(pred_rep)];
+      }
+
+      auto &rep = getRep(scc.key);
+      if (rep.live && !pred_changed && rep.indirect == node.indirect() &&
+          rep.own == node.ptsto() && rep.preds == scc.predKeys) {
+        node.ptsto().swap(rep.label);
+        continue;
+      }
+
+      rep.live = true;
+      rep.indirect = node.indirect();
+      rep.own = node.ptsto();
+      rep.preds = scc.predKeys;
+
+      // If node is indirect, add its PE
+      if (node.indirect()) {
+        node.addPtsTo(getIndirectPE(scc.key));
+      }
+
+      relabel.push_back(idx);
+    }
+    stats.numRelabeled += relabel.size();
+
+    // Not worth starting threads for small levels
+    if (num_threads == 1 || relabel.size() < ParallelLevelMin) {
+      for (auto idx : relabel) {
+        auto &node = *rep_nodes[static_cast<size_t>(sccs[idx].rep)];
+
+        // Now, unite any pred ids:
+        for (auto pred_rep : sccs[idx].preds) {
+          auto &pred_node = *rep_nodes[static_cast<size_t>(pred_rep)];
+
+          // If the pred node isn't a non_ptr
+          if (!pred_node.ptsto().test(HVNNode::PENonPtr)) {
+            node.ptsto() |= pred_node.ptsto();
+          }
+        }
+      }
+    } else {
+      stats.numParallel += relabel.size();
+      std::vector<std::vector<int32_t>> pred_pes(relabel.size());
+      std::atomic<size_t> next(0);
+      auto worker = [&relabel, &pred_pes, &next, &gather_preds] {
+        size_t i;
+        while ((i = next.fetch_add(ParallelLevelChunk)) < relabel.size()) {
+          auto end = std::min(i + ParallelLevelChunk, relabel.size());
+          for (; i < end; ++i) {
+            gather_preds(relabel[i], pred_pes[i]);
+          }
+        }
+      };
+
+      std::vector<std::thread> threads;
+      for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(worker);
+      }
+      worker();
+      for (auto &thread : threads) {
+        thread.join();
+      }
+
+      // Back on one thread, fold the gathered PEs into the labels
+      for (size_t i = 0; i < relabel.size(); ++i) {
+        auto &node = *rep_nodes[static_cast<size_t>(sccs[relabel[i]].rep)];
+        for (auto pe : pred_pes[i]) {
+          node.addPtsTo(pe);
+        }
+      }
+    }
+
+    for (auto idx : relabel) {
+      auto rep_id = sccs[idx].rep;
+      auto &node = *rep_nodes[static_cast<size_t>(rep_id)];
+      if (node.ptsto().empty()) {
+        node.addPtsTo(HVNNode::PENonPtr);
+      }
+
+      if (!(node.ptsto() == getRep(sccs[idx].key).label)) {
+        changed[static_cast<size_t>(rep_id)] = true;
+        stats.numChanged++;
+      }
+    }
+  }
+
+  // Forget anything which isn't an SCC rep anymore
+  key_rep.resize(numKeys(), GraphId::invalid());
+  for (size_t key = 0; key < numKeys(); ++key) {
+    if (key_rep[key] == GraphId::invalid()) {
+      auto &rep = getRep(key);
+      if (rep.inTable) {
+        removeLabel(key);
+      }
+      rep = Rep();
+    }
+  }
+
+  // Merge the reps with equal labels.  Unchanged labels are still in the
+  //   table from last round, so only changed labels are looked up
+  for (auto rep_id : scc_reps) {
+    auto &node = graph.getNode(rep_id);
+    auto key = node_key[static_cast<size_t>(rep_id)];
+    auto &rep = getRep(key);
+
+    if (node.ptsto().test(HVNNode::PENonPtr)) {
+      node.makeNonPtr();
+      if (rep.inTable) {
+        removeLabel(key);
+      }
+      continue;
+    }
+
+    if (rep.inTable) {
+      if (!changed[static_cast<size_t>(rep_id)]) {
+        continue;
+      }
+      removeLabel(key);
+    }
+
+    auto hash = std::hash<Label>()(node.ptsto());
+    auto range = findLabel(hash);
+    auto it = range.first;
+    for (; it != range.second; ++it) {
+      if (graph.getNode(key_rep[it->second]).ptsto() == node.ptsto()) {
+        break;
+      }
+    }
+
+    if (it == range.second) {
+      addLabel(key, hash);
+      continue;
+    }
+
+    auto other_id = key_rep[it->second];
+    if (static_cast<size_t>(rep_id) == check_val ||
+        static_cast<size_t>(other_id) == check_val) {
+      llvm::dbgs() << "  Merging: " << rep_id << " and " << other_id << "\n";
+    }
+    if (graph.getRep(rep_id) != graph.getRep(other_id)) {
+      stats.numMerges++;
+    }
+    graph.merge(rep_id, other_id);
+  }
+
+  for (GraphId id(0); id < GraphId(graph.size()); id++) {
+    // We're done w/ preds now, clear them
+    graph.getNode(id).clearPreds();
+  }
+
+  stats.numSccs = sccs.size();
+  stats.numLevels = levels.size();
+  return stats;
+}
+
+void HUState::saveLabels(OptGraph &graph,
+    const std::vector<size_t> &node_key) {
+  // Reps merged above share the node of
+  //   the rep they merged into, so they copy its label before that rep takes
+  //   it
+  for (auto rep_id : sccReps_) {
+    auto merged_id = graph.getRep(rep_id);
+    if (merged_id != rep_id) {
+      auto &rep = getRep(node_key[static_cast<size_t>(rep_id)]);
+      rep.label = graph.getNode(merged_id).ptsto();
+    }
+  }
+
+  for (auto rep_id : sccReps_) {
+    if (graph.getRep(rep_id) == rep_id) {
+      auto &rep = getRep(node_key[static_cast<size_t>(rep_id)]);
+      rep.label.swap(graph.getNode(rep_id).ptsto());
+    }
+  }
+
+  for (auto rep_id : sccReps_) {
+    auto &rep = getRep(node_key[static_cast<size_t>(rep_id)]);
+    graph.getNode(rep_id).ptsto().clear();
+    if (rep.label.empty()) {
+      rep.live = false;
+    }
+  }
+}
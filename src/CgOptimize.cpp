@@ -8,7 +8,9 @@
 #include <algorithm>
 #include <limits>
 #include <map>
+#include <numeric>
 #include <set>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
@@ -20,6 +22,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "include/util.h"
 #include "include/RunTarjans.h"
@@ -28,6 +31,12 @@
 #include "include/lib/IndirFcnTarget.h"
 #include "include/lib/UnusedFunctions.h"
 
+static llvm::cl::opt<int32_t> //  NOLINT
+  opt_threads("anders-opt-threads", llvm::cl::init(0),
+      llvm::cl::value_desc("int"),
+      llvm::cl::desc("Number of threads used to label nodes in the offline "
+        "HU optimization (0 uses one per hardware thread)"));
+
 template <typename Graph>
 class OptData {
   //{{{
@@ -53,6 +62,11 @@ class OptData {
     return ref_it->second;
   }
 
+  // Each node with a ref node, mapped to its ref node
+  const std::map<Id, Id> &refs() const {
+    return nodeToRef_;
+  }
+
  protected:
   Graph &graph_;
   std::map<Id, Id> nodeToRef_;
@@ -127,6 +141,64 @@ class HCDData : public OptData<HCDGraph> {
 size_t check_val = std::numeric_limits<size_t>::max();
 // size_t check_val = 1034406;
 
+// Removes constraints equal (by operator<, which ignores reps) to an earlier
+//   one, keeping the first in place.  Int/null value constraints are never
+//   merged.  Sorting an index array, rather than inserting every constraint
+//   into a std::set, keeps this to two flat arrays on huge constraint sets
+size_t Cg::dedupConstraints() {
+  auto is_fixed = [](const Constraint &cons) {
+    return cons.src() == ValueMap::IntValue ||
+      cons.dest() == ValueMap::IntValue ||
+      cons.src() == ValueMap::NullValue ||
+      cons.dest() == ValueMap::NullValue;
+  };
+
+  std::vector<uint32_t> order;
+  order.reserve(constraints_.size());
+  for (size_t i = 0; i < constraints_.size(); ++i) {
+    if (!is_fixed(constraints_[i])) {
+      order.push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+  // Sorts by type first, so each constraint type is a contiguous run; ties
+  //   are broken by position so the first of any duplicates sorts first
+  std::sort(std::begin(order), std::end(order),
+      [this](uint32_t lhs, uint32_t rhs) {
+    auto &lhs_cons = constraints_[lhs];
+    auto &rhs_cons = constraints_[rhs];
+    if (lhs_cons < rhs_cons) {
+      return true;
+    }
+    if (rhs_cons < lhs_cons) {
+      return false;
+    }
+    return lhs < rhs;
+  });
+
+  std::vector<bool> dup(constraints_.size(), false);
+  for (size_t i = 1; i < order.size(); ++i) {
+    if (!(constraints_[order[i-1]] < constraints_[order[i]])) {
+      dup[order[i]] = true;
+    }
+  }
+
+  size_t num_kept = 0;
+  for (size_t i = 0; i < constraints_.size(); ++i) {
+    if (!dup[i]) {
+      if (num_kept != i) {
+        constraints_[num_kept] = constraints_[i];
+      }
+      num_kept++;
+    }
+  }
+
+  size_t num_removed = constraints_.size() - num_kept;
+  constraints_.erase(std::next(std::begin(constraints_), num_kept),
+      std::end(constraints_));
+  return num_removed;
+}
+
 size_t Cg::updateConstraints(OptGraph &graph) {
   std::unordered_map<GraphId, GraphId> rep_remapping;
 
@@ -161,19 +233,18 @@ size_t Cg::updateConstraints(OptGraph &graph) {
     }
   }
 
+  // Rewrite the constraints in place, compacting out any we remove
   size_t num_removed = 0;
-  std::set<Constraint> dedup;
-
-  std::vector<Constraint> new_cons;
+  size_t num_kept = 0;
   for (size_t i = 0; i < constraints_.size(); i++) {
-    auto &cons = constraints_[i];
+    auto cons = constraints_[i];
 
     // Don't optimize int/null value cons
     if (cons.src() == ValueMap::IntValue ||
         cons.dest() == ValueMap::IntValue ||
         cons.src() == ValueMap::NullValue ||
         cons.dest() == ValueMap::NullValue) {
-      new_cons.push_back(cons);
+      constraints_[num_kept++] = cons;
       continue;
     }
 
@@ -208,17 +279,13 @@ size_t Cg::updateConstraints(OptGraph &graph) {
       continue;
     }
 
-    auto rc = dedup.emplace(cons);
-    if (!rc.second) {
-      num_removed++;
-      continue;
-    }
-
-    new_cons.push_back(cons);
+    constraints_[num_kept++] = cons;
   }
 
-  assert(constraints_.size() - new_cons.size() == num_removed);
-  constraints_.swap(new_cons);
+  assert(constraints_.size() - num_kept == num_removed);
+  constraints_.erase(std::next(std::begin(constraints_), num_kept),
+      std::end(constraints_));
+  num_removed += dedupConstraints();
 
   // Also update indirect call info:
   for (auto &tup : indirCalls_) {
@@ -273,19 +340,18 @@ size_t Cg::updateHCDConstraints(HCDGraph &graph) {
     }
   }
 
+  // Rewrite the constraints in place, compacting out any we remove
   size_t num_removed = 0;
-  std::set<Constraint> dedup;
-
-  std::vector<Constraint> new_cons;
+  size_t num_kept = 0;
   for (size_t i = 0; i < constraints_.size(); i++) {
-    auto &cons = constraints_[i];
+    auto cons = constraints_[i];
 
     // Don't optimize int/null value cons
     if (cons.src() == ValueMap::IntValue ||
         cons.dest() == ValueMap::IntValue ||
         cons.src() == ValueMap::NullValue ||
         cons.dest() == ValueMap::NullValue) {
-      new_cons.push_back(cons);
+      constraints_[num_kept++] = cons;
       continue;
     }
 
@@ -312,17 +378,13 @@ size_t Cg::updateHCDConstraints(HCDGraph &graph) {
       continue;
     }
 
-    auto rc = dedup.emplace(cons);
-    if (!rc.second) {
-      num_removed++;
-      continue;
-    }
-
-    new_cons.push_back(cons);
+    constraints_[num_kept++] = cons;
   }
 
-  assert(constraints_.size() - new_cons.size() == num_removed);
-  constraints_.swap(new_cons);
+  assert(constraints_.size() - num_kept == num_removed);
+  constraints_.erase(std::next(std::begin(constraints_), num_kept),
+      std::end(constraints_));
+  num_removed += dedupConstraints();
 
   // Also update indirect call info:
   for (auto &tup : indirCalls_) {
@@ -540,7 +602,7 @@ size_t Cg::HVN() {
   return updateConstraints(hvn_graph);
 }
 
-size_t Cg::HU() {
+size_t Cg::HU(HUState &state) {
   OptGraph hvn_graph;
   HVNData data(hvn_graph);
 
@@ -661,7 +723,7 @@ size_t Cg::HU() {
           dest_ref.addImplicitPred(src_ref_id);
         // With offsets create a new PE, labeled by the src, offs combo
         } else {
-          dest_node.addPtsTo(data.getGEPPE(src_node_id, cons.offs()));
+          dest_node.addPtsTo(state.getGEPPE(src_node_id, cons.offs()));
         }
         break;
     }
@@ -678,103 +740,35 @@ size_t Cg::HU() {
     }
   }
 
-  auto traverse_pe = [this, &data, &hvn_graph]
-      (HVNNode &node, GraphId node_id) {
-    // If node is indirect, add a new PE
-    auto node_rep = hvn_graph.getRep(node_id);
-
-    if (node.indirect()) {
-      auto next_pe = data.getNextPE();
-      node.addPtsTo(next_pe);
-      /*
-      if (node_id == GraphId(1000213)) {
-        llvm::dbgs() << "adding PE: " << next_pe << " to node: "
-          << node_id << "\n";
-        llvm::dbgs() << "rep_id: " << node_rep << "\n";
-        assert(&node == &hvn_graph.getNode(node_rep));
-        llvm::dbgs() << "pts now: " << node.ptsto() << "\n";
-      }
-      */
-    }
-
-    // Now, unite any pred ids:
-    for (auto pred_id : node.preds()) {
-      if (node.isImplicitPred(pred_id)) {
-        continue;
-      }
-
-      auto pred_rep = hvn_graph.getRep(pred_id);
-      auto &pred_node = hvn_graph.getNode(pred_rep);
-
-      // skip pointers to self
-      if (pred_rep == node_rep) {
-        continue;
-      }
-
-      // If the pred node isn't a non_ptr
-      if (!pred_node.ptsto().test(HVNNode::PENonPtr)) {
-        node.ptsto() |= pred_node.ptsto();
-      }
-    }
-
-    if (node.ptsto().empty()) {
-      node.addPtsTo(HVNNode::PENonPtr);
-    }
-
-    node.cleanPreds();
-  };
-
-  // hvn_graph.printDotFile("HVNStart.dot", *g_omap);
-  // Finally run Tarjan's:
-  run_tarjans(hvn_graph, traverse_pe);
-
-  std::unordered_map<util::SparseBitmap<int32_t>, GraphId> pts_to_pe;
-
-  for (GraphId id(0); id < GraphId(hvn_graph.size()); id++) {
-    auto &node = hvn_graph.getNode(id);
-    // We're done w/ preds now, clear them
-    node.clearPreds();
-
-    auto &ptsto = node.ptsto();
-
-    /*
-    if (id == GraphId(1000213)) {
-      llvm::dbgs() << "Have node: " << id << "\n";
-      llvm::dbgs() << "  rep: " << hvn_graph.getRep(id) << "\n";
-      llvm::dbgs() << "  pts: " << ptsto << "\n";
-    }
-    */
+  // Name each node by its key
+  std::vector<size_t> node_key(hvn_graph.size());
+  for (size_t i = 0; i < node_key.size(); ++i) {
+    node_key[i] = HUState::nodeKey(GraphId(i));
+  }
+  for (auto &pr : data.refs()) {
+    node_key[static_cast<size_t>(pr.second)] = HUState::refKey(pr.first);
+  }
 
-    if (ptsto.empty() || ptsto.test(HVNNode::PENonPtr)) {
-      // assert(ptsto.count() <= 1);
-      node.makeNonPtr();
-      continue;
-    }
+  size_t num_threads = (opt_threads > 0) ?
+    static_cast<size_t>(opt_threads) :
+    std::max(1u, std::thread::hardware_concurrency());
+  auto stats = state.label(hvn_graph, node_key, num_threads);
 
-    /*
-    if (util::convert_id<Id>(id) < vals_.getMaxAlloc() ||
-        util::convert_id<Id>(id) > vals_.getMaxReservedAlloc()) {
-      llvm::dbgs() << "Node: " << id << " has pts: " << ptsto << "\n";
-    }
-    */
-    auto ret = pts_to_pe.emplace(ptsto, hvn_graph.getRep(id));
-    if (!ret.second) {
-      auto it = ret.first;
+  llvm::dbgs() << "  HU: " << hvn_graph.size() << " nodes, " <<
+    stats.numSccs << " sccs, " << stats.numLevels << " levels, " <<
+    stats.numRelabeled << " relabeled (" << stats.numParallel <<
+    " in parallel, " << stats.numChanged << " changed), " <<
+    state.numLabels() << " labels, " << stats.numMerges <<
+    " label merges\n";
 
-      // auto &rep_node = hvn_graph.getNode(it->second);
+  // Now, update constraints based on the hvn_graph
+  auto num_removed = updateConstraints(hvn_graph);
 
-      if (static_cast<size_t>(id) == check_val ||
-          static_cast<size_t>(it->second) == check_val) {
-        llvm::dbgs() << "  Merging: " << id << " and " << it->second << "\n";
-      }
-      auto rep_id = hvn_graph.merge(id, it->second);
-      it->second = rep_id;
-    }
-  }
+  // Keep the labels for the next round
+  state.saveLabels(hvn_graph, node_key);
 
-  // Now, update constraints based on the hvn_graph, return how many constraitns
-  //    we removed
-  return updateConstraints(hvn_graph);
+  // Return how many constraitns we removed
+  return num_removed;
 }
 
 // Plan:
@@ -904,14 +898,82 @@ void Cg::HCD() {
   updateHCDConstraints(hcd_graph);
 }
 
+// Orders the allocation blocks so objects likely to share points-to sets
+//   get nearby ids.  Pointers joined by offset-free copies are approximated
+//   as one points-to class (what HVN would discover), and each object is
+//   keyed on the first class its address is taken into.  Blocks with the
+//   same key keep their original order
+std::vector<size_t> Cg::clusterAllocs() {
+  util::UnionFind<Id> classes(static_cast<size_t>(getMaxId()));
+  for (auto &cons : constraints_) {
+    if (ValueMap::isSpecial(cons.src()) || ValueMap::isSpecial(cons.dest())) {
+      continue;
+    }
+
+    if (cons.type() == ConstraintType::Copy && cons.offs() == 0) {
+      classes.merge(cons.src(), cons.dest());
+    }
+  }
+
+  // Number the classes in the order their addresses are first taken
+  std::unordered_map<Id, size_t> class_order;
+  std::unordered_map<Id, size_t> obj_key;
+  for (auto &cons : constraints_) {
+    if (cons.type() != ConstraintType::AddressOf ||
+        ValueMap::isSpecial(cons.dest())) {
+      continue;
+    }
+
+    auto cls = classes.find(cons.dest());
+    auto rc = class_order.emplace(cls, class_order.size());
+    obj_key.emplace(cons.src(), rc.first->second);
+  }
+
+  auto &allocs = vals_.allocSizes();
+  auto blocks = vals_.allocBlocks();
+  std::vector<std::pair<size_t, size_t>> keys;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    auto key = std::numeric_limits<size_t>::max();
+    for (size_t j = 0; j < blocks[i].second; ++j) {
+      auto it = obj_key.find(allocs[blocks[i].first + j].first);
+      if (it != std::end(obj_key)) {
+        key = std::min(key, it->second);
+      }
+    }
+    keys.emplace_back(key, i);
+  }
+  std::sort(std::begin(keys), std::end(keys));
+
+  std::vector<size_t> order;
+  size_t num_moved = 0;
+  for (auto &pr : keys) {
+    if (pr.second != order.size()) {
+      num_moved++;
+    }
+    order.push_back(pr.second);
+  }
+
+  llvm::dbgs() << "Object renumbering: " << blocks.size() << " allocs, " <<
+    class_order.size() << " ptsto classes, " << num_moved << " moved\n";
+
+  return order;
+}
+
 void Cg::HRU(size_t min_removed) {
   int32_t itr = 0;
   size_t num_removed;
+  util::PerfTimer round_timer;
+  HUState state;
   do {
     llvm::dbgs() << "HRU iter: " << itr << "\n";
-    num_removed = HU();
+    auto start_size = constraints_.size();
+    round_timer.reset();
+    round_timer.start();
+    num_removed = HU(state);
     // num_removed = HVN(cg, omap);
-    llvm::dbgs() << "  num_removed: " << num_removed << "\n";
+    round_timer.stop();
+    llvm::dbgs() << "  num_removed: " << num_removed << " of " <<
+      start_size << " in " << round_timer.totalElapsed().count() << "s\n";
     itr++;
   } while (num_removed > min_removed);
 }
@@ -4,14 +4,24 @@
 
 #include "include/ConstraintPass.h"
 
+#include <algorithm>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "include/LLVMHelper.h"
+
 using std::swap;
 
 extern llvm::cl::opt<bool> no_spec;
 
+static llvm::cl::opt<double> //  NOLINT
+  assumption_budget("anders-assumption-budget", llvm::cl::init(0.0),
+      llvm::cl::value_desc("fraction"),
+      llvm::cl::desc("If set, speculative assumptions whose profiled check "
+        "cost pushes the total over this fraction of the profiled dynamic "
+        "instructions are not made (0 keeps every assumption)"));
+
 // Error handling functions {{{
 // Don't warn about this (if it is an) unused function... I'm being sloppy
 [[ gnu::unused ]]
@@ -57,6 +67,9 @@ void ConstraintPass::getAnalysisUsage(llvm::AnalysisUsage &usage) const {
   // Required for call info passes
   usage.addRequired<CsCFG>();
   usage.addRequired<CallContextLoader>();
+
+  // For pricing assumptions
+  usage.addRequired<DynEdgeLoader>();
 }
 
 bool ConstraintPass::runOnModule(llvm::Module &m) {
@@ -76,8 +89,29 @@ bool ConstraintPass::runOnModule(llvm::Module &m) {
   auto &cs_cfg =
       getAnalysis<CsCFG>();
 
-  BasicFcnCFG fcn_cfg(m, dyn_info);
+  auto fcn_cfg = std::make_unique<BasicFcnCFG>(m, dyn_info);
+  buildCg(m, dyn_info, *fcn_cfg, cs_cfg);
+
+  if (assumption_budget > 0 && !no_spec &&
+      selectAssumptions(m, getAnalysis<DynEdgeLoader>(), indir_info)) {
+    // Some indirect calls are no longer resolved to their profiled targets,
+    //   so the constraints (and the assumptions they rely on) must be
+    //   regenerated without them
+    llvm::dbgs() << "Rebuilding constraints with the kept assumptions\n";
+    callCgCache_.reset();
+    cgCache_.reset();
+    specAssumptions_ = AssumptionSet();
 
+    fcn_cfg = std::make_unique<BasicFcnCFG>(m, dyn_info);
+    buildCg(m, dyn_info, *fcn_cfg, cs_cfg);
+  }
+
+  // We don't change code.  Ever.
+  return false;
+}
+
+void ConstraintPass::buildCg(llvm::Module &m, const DynamicInfo &dyn_info,
+    const BasicFcnCFG &fcn_cfg, CsCFG &cs_cfg) {
   // Create a cg for each function in module
   // Then get the main cg
   // "merge sccs" with all the other functions cgs
@@ -131,10 +165,156 @@ bool ConstraintPass::runOnModule(llvm::Module &m) {
   // functions, they will all be resolved w/ internal edges (without context
   //   sensitivity)
   mainCg_->resolveCalls(*cgCache_, *callCgCache_);
+  callCgCache_->printSummaryStats(llvm::dbgs());
+  callCgCache_->releaseSummaries(0);
 
   llvm::dbgs() << "Post resolveCalls constraints\n";
   mainCg_->constraintStats();
+}
 
-  // We don't change code.  Ever.
-  return false;
+// Assumption selection {{{
+bool ConstraintPass::selectAssumptions(const llvm::Module &m,
+    const DynEdgeLoader &dyn_edges, IndirFunctionInfo &indir_info) {
+  if (!dyn_edges.hasDynData()) {
+    llvm::dbgs() << "Assumption selection: no edge profile, keeping all "
+      "assumptions\n";
+    return false;
+  }
+
+  // Price everything in profiled dynamic instructions, as CostApprox did
+  double total_dyn_insts = 0;
+  for (auto &fcn : m) {
+    for (auto &bb : fcn) {
+      total_dyn_insts += static_cast<double>(dyn_edges.getExecutionCount(&bb)) *
+        bb.size();
+    }
+  }
+
+  if (total_dyn_insts == 0) {
+    return false;
+  }
+
+  struct AssumptionCost {
+    const Assumption *asmp;
+    double cost;
+    int64_t benefit;
+    bool dropped;
+  };
+
+  std::vector<AssumptionCost> costs;
+  costs.reserve(specAssumptions_.size());
+
+  auto &map = mainCg_->vals();
+  double total_cost = 0;
+  for (auto &pasm : specAssumptions_) {
+    // Each instrumentation site costs as often as its block ran.  A ptsto
+    //   assumption's set check runs at its call, while a dead block's visit
+    //   call never ran in the profile, so it costs nothing
+    double cost = 0;
+    for (auto &psite : pasm->getApproxDependencies(map, m)) {
+      cost += static_cast<double>(psite->approxCost()) *
+        dyn_edges.getExecutionCount(psite->getBB());
+    }
+
+    total_cost += cost;
+    costs.push_back({pasm.get(), cost, pasm->getApproxBenefit(), false});
+  }
+
+  // Most cost per unit of benefit first
+  std::vector<AssumptionCost *> order;
+  order.reserve(costs.size());
+  for (auto &ac : costs) {
+    if (ac.cost > 0) {
+      order.push_back(&ac);
+    }
+  }
+
+  std::sort(std::begin(order), std::end(order),
+      [] (const AssumptionCost *lhs, const AssumptionCost *rhs) {
+        return lhs->cost * std::max<int64_t>(rhs->benefit, 1) >
+          rhs->cost * std::max<int64_t>(lhs->benefit, 1);
+      });
+
+  double budget = assumption_budget * total_dyn_insts;
+  double kept_cost = total_cost;
+  for (auto pac : order) {
+    if (kept_cost <= budget) {
+      break;
+    }
+
+    // Only ptsto assumptions have a profiled cost, we drop one by resolving
+    //   its indirect call without speculating on its targets
+    auto pta = dyn_cast<PtstoAssumption>(pac->asmp);
+    if (pta == nullptr || pta->site() == nullptr) {
+      continue;
+    }
+
+    pac->dropped = true;
+    kept_cost -= pac->cost;
+  }
+
+  // Report {{{
+  struct KindStats {
+    size_t num = 0;
+    size_t dropped = 0;
+    double cost = 0;
+    double dropped_cost = 0;
+    int64_t benefit = 0;
+    int64_t dropped_benefit = 0;
+  };
+
+  KindStats ptsto_stats;
+  KindStats dead_stats;
+  for (auto &ac : costs) {
+    auto &stats = llvm::isa<DeadCodeAssumption>(ac.asmp) ?
+      dead_stats : ptsto_stats;
+    stats.num++;
+    stats.cost += ac.cost;
+    stats.benefit += ac.benefit;
+    if (ac.dropped) {
+      stats.dropped++;
+      stats.dropped_cost += ac.cost;
+      stats.dropped_benefit += ac.benefit;
+    }
+  }
+
+  auto print_kind = [total_dyn_insts] (const char *name,
+      const KindStats &stats) {
+    llvm::dbgs() << "  " << name << ": " << stats.num << " ("
+      << stats.dropped << " dropped), cost: "
+      << stats.cost / total_dyn_insts << " ("
+      << stats.dropped_cost / total_dyn_insts << " dropped), benefit: "
+      << stats.benefit << " (" << stats.dropped_benefit << " dropped)\n";
+  };
+
+  llvm::dbgs() << "Assumption selection: budget " << assumption_budget
+    << ", estimated overhead " << total_cost / total_dyn_insts << " -> "
+    << kept_cost / total_dyn_insts << "\n";
+  print_kind("ptsto", ptsto_stats);
+  print_kind("dead code", dead_stats);
+
+  static const size_t NumReported = 10;
+  for (size_t i = 0; i < std::min(order.size(), NumReported); ++i) {
+    auto pac = order[i];
+    llvm::dbgs() << "    " << (pac->dropped ? "drop" : "keep") << " cost: "
+      << pac->cost / total_dyn_insts << " benefit: " << pac->benefit;
+    if (auto pta = dyn_cast<PtstoAssumption>(pac->asmp)) {
+      llvm::dbgs() << " ptsto at " << ValPrinter(pta->site());
+    } else {
+      llvm::dbgs() << " dead code";
+    }
+    llvm::dbgs() << "\n";
+  }
+  //}}}
+
+  bool ret = false;
+  for (auto &ac : costs) {
+    if (ac.dropped) {
+      indir_info.stopSpeculating(cast<PtstoAssumption>(ac.asmp)->site());
+      ret = true;
+    }
+  }
+
+  return ret;
 }
+//}}}
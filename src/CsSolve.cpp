@@ -21,6 +21,7 @@
 #include "include/AndersGraph.h"
 #include "include/Debug.h"
 #include "include/SpecAndersCS.h"
+#include "include/Telemetry.h"
 
 extern llvm::cl::opt<bool> no_spec;
 
@@ -127,6 +128,7 @@ class CSRunNuutila {
     */
     if (node_data.root == dfs_idx) {
       bool ch = false;
+      size_t scc_size = 1;
 
       while (!nodeStack_.empty()) {
         auto next_id = nodeStack_.top();
@@ -143,6 +145,7 @@ class CSRunNuutila {
         // If we weren't already merged (HCD can cause this)
         if (rep_next_id != node_rep.id()) {
           lcd_merge_count++;
+          scc_size++;
           auto &nd = graph_.getNode(rep_next_id);
 
           /*
@@ -159,6 +162,10 @@ class CSRunNuutila {
       // llvm::dbgs() << "  ~~merged_.insert(" << node_id << ")\n";
       merged_.insert(node_rep_id);
 
+      if (scc_size > 1) {
+        telemetry::sample("asc.lcd_scc_size", scc_size);
+      }
+
       if (ch) {
         if_debug_enabled(auto &node = graph_.getNode(node_rep_id));
         assert(node.id() == node_rep_id);
@@ -213,6 +220,7 @@ bool SpecAndersCS::solve() {
 
   size_t hcd_merge_count = 0;
   size_t lcd_check_count = 0;
+  size_t lcd_merge_start = lcd_merge_count;
   size_t hcd_merge_last = 0;
   size_t lcd_merge_last = 0;
   size_t lcd_check_last = 0;
@@ -552,6 +560,9 @@ bool SpecAndersCS::solve() {
   llvm::dbgs() << "Final hcd_merge_count: " << hcd_merge_count << "\n";
   llvm::dbgs() << "Final lcd_check_count: " << lcd_check_count << "\n";
   llvm::dbgs() << "Final lcd_merge_count: " << lcd_merge_count << "\n";
+  telemetry::count("asc.hcd_merges", hcd_merge_count);
+  telemetry::count("asc.lcd_checks", lcd_check_count);
+  telemetry::count("asc.lcd_merges", lcd_merge_count - lcd_merge_start);
 
   return false;
 }
@@ -8,7 +8,9 @@
 
 #include <cassert>
 
+#include <algorithm>
 #include <map>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
@@ -2301,8 +2303,115 @@ ExtLibInfo::ExtLibInfo(ModInfo &info) : modInfo_(info) {
       std::make_tuple(new ExtMemcpy()));
   //}}}
   //}}}
+
+  // Compile the name matcher {{{
+  for (auto &pr : info_) {
+    matcher_.addExact(pr.first, pr.second.get());
+  }
+  for (auto &pr : matchInfo_) {
+    matcher_.addPartial(pr.first, pr.second.get());
+  }
+  matcher_.build();
+  //}}}
 }  // NOLINT
 
+// NameMatcher {{{
+uint32_t ExtLibInfo::NameMatcher::insert(const std::string &str) {
+  uint32_t node = 0;
+  for (auto c : str) {
+    auto it = nodes_[node].next.find(c);
+    if (it == std::end(nodes_[node].next)) {
+      uint32_t new_node = nodes_.size();
+      nodes_.emplace_back();
+      it = nodes_[node].next.emplace(c, new_node).first;
+    }
+    node = it->second;
+  }
+
+  return node;
+}
+
+void ExtLibInfo::NameMatcher::addExact(const std::string &name,
+    const ExtInfo *info) {
+  auto node = insert(name);
+  nodes_[node].exact = info;
+}
+
+void ExtLibInfo::NameMatcher::addPartial(const std::string &pattern,
+    const ExtInfo *info) {
+  auto node = insert(pattern);
+  uint32_t idx = partials_.size();
+  partials_.emplace_back(pattern, info);
+  nodes_[node].partial = std::min(nodes_[node].partial, idx);
+}
+
+void ExtLibInfo::NameMatcher::build() {
+  // Breadth first, so each node's fail target is finished before the node
+  std::vector<uint32_t> queue;
+  for (auto &pr : nodes_[0].next) {
+    queue.push_back(pr.second);
+  }
+
+  for (size_t i = 0; i < queue.size(); ++i) {
+    auto node = queue[i];
+    nodes_[node].partial = std::min(nodes_[node].partial,
+        nodes_[nodes_[node].fail].partial);
+
+    for (auto &pr : nodes_[node].next) {
+      auto c = pr.first;
+      auto child = pr.second;
+
+      auto fail = nodes_[node].fail;
+      while (fail != 0 &&
+          nodes_[fail].next.find(c) == std::end(nodes_[fail].next)) {
+        fail = nodes_[fail].fail;
+      }
+      auto it = nodes_[fail].next.find(c);
+      if (it != std::end(nodes_[fail].next) && it->second != child) {
+        nodes_[child].fail = it->second;
+      }
+
+      queue.push_back(child);
+    }
+  }
+}
+
+const ExtInfo &ExtLibInfo::NameMatcher::match(llvm::StringRef name,
+    const ExtInfo &unknown) const {
+  uint32_t node = 0;
+  // Set while every character so far has followed a trie edge from the root
+  bool exact = true;
+  uint32_t partial = NoPartial;
+  for (auto c : name) {
+    auto it = nodes_[node].next.find(c);
+    while (it == std::end(nodes_[node].next) && node != 0) {
+      exact = false;
+      node = nodes_[node].fail;
+      it = nodes_[node].next.find(c);
+    }
+
+    if (it == std::end(nodes_[node].next)) {
+      exact = false;
+      continue;
+    }
+
+    node = it->second;
+    partial = std::min(partial, nodes_[node].partial);
+  }
+
+  if (exact && nodes_[node].exact != nullptr) {
+    return *nodes_[node].exact;
+  }
+
+  if (partial != NoPartial) {
+    llvm::dbgs() << "  have match on: " << partials_[partial].first << "\n";
+    return *partials_[partial].second;
+  }
+
+  return unknown;
+}
+//}}}
+
 // Initialize the internal info_ (unordered_map) here
 void ExtLibInfo::addGlobalConstraints(const llvm::Module &m, Cg &cg) {
   // Setup constriants for named values
@@ -7,7 +7,10 @@
 
 #include <algorithm>
 #include <functional>
+#include <map>
+#include <numeric>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -15,13 +18,16 @@
 #include "llvm/Pass.h"
 #include "llvm/PassSupport.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 // #include "llvm/Analysis/ProfileInfo.h"
 
 #include "include/BloomHash.h"
+#include "include/CallStack.h"
 #include "include/ConstraintPass.h"
 #include "include/ExtInfo.h"
 #include "include/LLVMHelper.h"
@@ -29,14 +35,29 @@
 #include "include/SpecAndersCS.h"
 #include "include/ValueMap.h"
 
+static llvm::cl::opt<bool>
+  no_check_opt("specsfs-no-check-opt", llvm::cl::init(false),
+      llvm::cl::value_desc("bool"),
+      llvm::cl::desc("If set, set checks are left exactly where their "
+        "assumptions put them (no hoisting, merging, or batching)"));
+
+static llvm::cl::opt<bool>
+  callstack_stats("specsfs-callstack-stats", llvm::cl::init(false),
+      llvm::cl::value_desc("bool"),
+      llvm::cl::desc("If set, callstack checks are done out of line, probing "
+        "both a bloom filter and the exact hash table to report their false "
+        "positive rates"));
+
 const int64_t PtrSizeBytes = sizeof(void *);
 
 static const std::string MainInit2Name = "__specsfs_main_init2";
 static const std::string MainInit3Name = "__specsfs_main_init3";
 
-static const std::string PushName = "__specsfs_callstack_push";
-static const std::string PopName = "__specsfs_callstack_pop";
-static const std::string CheckName = "__specsfs_callstack_check";
+static const std::string StackName = "__specsfs_callstack";
+static const std::string StackTopName = "__specsfs_callstack_top";
+static const std::string OverflowName = "__specsfs_callstack_overflow";
+static const std::string CheckSlowName = "__specsfs_callstack_check_slow";
+static const std::string CheckStatsName = "__specsfs_callstack_check_stats";
 
 static const std::string SetJmpName = "__specsfs_do_setjmp_call";
 static const std::string LongJmpName = "__specsfs_do_longjmp_call";
@@ -154,16 +175,43 @@ class SpecSFSInstrumenter : public llvm::ModulePass {
 
   llvm::Function *getSetJmpFcn(llvm::Module &m);
   llvm::Function *getLongJmpFcn(llvm::Module &m);
-  llvm::Function *getPushFcn(llvm::Module &m);
-  llvm::Function *getPopFcn(llvm::Module &m);
-  llvm::Function *getCheckFcn(llvm::Module &m);
+  llvm::Function *getOverflowFcn(llvm::Module &m);
+  llvm::Function *getCheckSlowFcn(llvm::Module &m);
+  llvm::Function *getCheckStatsFcn(llvm::Module &m);
+
+  // The runtime's thread-local call stack (see CallStack.h), which call
+  //   sites push, pop, and check inline
+  llvm::GlobalVariable *getStackGV(llvm::Module &m);
+  llvm::GlobalVariable *getStackTopGV(llvm::Module &m);
+
+  // Returns a pointer to field |field| of the top frame of the call stack
+  llvm::Value *getFramePtr(llvm::Module &m, llvm::Value *top, int32_t field,
+      llvm::Instruction *insert_before);
 
   llvm::Constant *BloomFilterToPointer(
       llvm::Module &,
       const BloomHasher::BloomFilter &);
 
-  std::pair<llvm::Constant *, llvm::Constant *>
-  getCheckData(llvm::Module &m,
+  llvm::Constant *ConstArrayToPointer(llvm::Module &m, llvm::Type *elm_type,
+      const std::vector<llvm::Constant *> &elms, const std::string &name);
+
+  // The constant tables a call site's stack check probes
+  struct CheckData {
+    // The forbidden stacks (int32_t *[]), grouped by slot.  Each is its
+    //   size, followed by its ids
+    llvm::Constant *ids;
+    // Per slot: the stack hash it holds (uint64_t[]), and its first stack in
+    //   ids (int32_t[], one longer than the number of slots)
+    llvm::Constant *keys;
+    llvm::Constant *starts;
+    // Per bucket displacements (uint64_t[])
+    llvm::Constant *disps;
+
+    uint64_t numBuckets;
+    uint64_t numSlots;
+  };
+
+  CheckData getCheckData(llvm::Module &m,
       const std::vector<const std::vector<CsCFG::Id> *> &data,
       BloomHasher::BloomFilter *hash_combine);
 
@@ -184,10 +232,13 @@ class SpecSFSInstrumenter : public llvm::ModulePass {
   llvm::Type *int8PtrType_ = nullptr;
 
   llvm::Type *voidType_ = nullptr;
+  llvm::StructType *frameType_ = nullptr;
 
-  llvm::Function *callCheckFcn_ = nullptr;
-  llvm::Function *callPopFcn_ = nullptr;
-  llvm::Function *callPushFcn_ = nullptr;
+  llvm::Function *callCheckSlowFcn_ = nullptr;
+  llvm::Function *callCheckStatsFcn_ = nullptr;
+  llvm::Function *callOverflowFcn_ = nullptr;
+  llvm::GlobalVariable *stackGV_ = nullptr;
+  llvm::GlobalVariable *stackTopGV_ = nullptr;
   llvm::Function *callSetJmpFcn_ = nullptr;
   llvm::Function *callLongJmpFcn_ = nullptr;
 };
@@ -213,7 +264,8 @@ namespace llvm {
 }  // namespace llvm
 
 static free_location_multimap findFreeLocs(llvm::Module &m, UnusedFunctions &uf,
-    IndirFunctionInfo &indir_info, Cg &cg, AliasAnalysis &aa) {
+    IndirFunctionInfo &indir_info, Cg &cg, AliasAnalysis &aa,
+    const std::function<const PtstoSet *(const llvm::Value *)> &get_pts) {
   auto &map = cg.vals();
   auto &ext_info = cg.extInfo();
 
@@ -236,8 +288,9 @@ static free_location_multimap findFreeLocs(llvm::Module &m, UnusedFunctions &uf,
             // Each value stacked prior to this point is freed by this insn
             // AKA: for each insn : alloca_list add to free list
             for (auto alloc_inst : alloc_insts) {
-              free_locs.emplace(map.getDef(alloc_inst),
-                  &insn);
+              for (auto obj_id : map.getIds(alloc_inst)) {
+                free_locs.emplace(obj_id, &insn);
+              }
             }
           // Also gather information about all allocs
           } else if (auto ci = dyn_cast<llvm::CallInst>(&insn)) {
@@ -285,6 +338,78 @@ static free_location_multimap findFreeLocs(llvm::Module &m, UnusedFunctions &uf,
     }
   }
 
+  // Invert the allocations' points-to sets, so each freed pointer is only
+  //   alias checked against the allocations it may point into.  Allocations
+  //   we have no points-to set for are checked against every free
+  std::unordered_map<ValueMap::Id, std::vector<size_t>> obj_to_allocs;
+  std::unordered_map<const llvm::Value *, size_t> alloc_idx;
+  std::vector<size_t> unindexed_allocs;
+  for (size_t i = 0; i < allocs.size(); ++i) {
+    alloc_idx.emplace(allocs[i], i);
+
+    auto pts = get_pts(allocs[i]);
+    if (pts == nullptr) {
+      unindexed_allocs.push_back(i);
+      continue;
+    }
+
+    for (auto obj_id : *pts) {
+      if (obj_id != ValueMap::NullValue) {
+        obj_to_allocs[obj_id].push_back(i);
+      }
+    }
+  }
+
+  std::vector<size_t> alloc_stamp(allocs.size(), 0);
+  size_t stamp = 0;
+  size_t num_queries = 0;
+  size_t num_pairs = 0;
+  auto alias_candidates = [&allocs, &get_pts, &obj_to_allocs, &alloc_idx,
+       &unindexed_allocs, &alloc_stamp, &stamp, &num_queries, &num_pairs]
+      (const llvm::Value *free_arg) {
+    std::vector<size_t> ret;
+    num_pairs += allocs.size();
+
+    auto pts = get_pts(free_arg);
+    if (pts == nullptr) {
+      ret.resize(allocs.size());
+      std::iota(std::begin(ret), std::end(ret), 0);
+      num_queries += ret.size();
+      return ret;
+    }
+
+    ++stamp;
+    auto add = [&ret, &alloc_stamp, stamp] (size_t idx) {
+      if (alloc_stamp[idx] != stamp) {
+        alloc_stamp[idx] = stamp;
+        ret.push_back(idx);
+      }
+    };
+
+    for (auto obj_id : *pts) {
+      if (obj_id == ValueMap::NullValue) {
+        continue;
+      }
+
+      auto it = obj_to_allocs.find(obj_id);
+      if (it != std::end(obj_to_allocs)) {
+        std::for_each(std::begin(it->second), std::end(it->second), add);
+      }
+    }
+    std::for_each(std::begin(unindexed_allocs), std::end(unindexed_allocs),
+        add);
+
+    // AAs ahead of ours in the chain may call a pointer taken directly from
+    //   an allocation aliasing, whatever its points-to set
+    auto it = alloc_idx.find(free_arg->stripPointerCasts());
+    if (it != std::end(alloc_idx)) {
+      add(it->second);
+    }
+
+    num_queries += ret.size();
+    return ret;
+  };
+
   for (auto &fcn : m) {
     for (auto &bb : fcn) {
       if (uf.isUsed(bb)) {
@@ -317,12 +442,14 @@ static free_location_multimap findFreeLocs(llvm::Module &m, UnusedFunctions &uf,
               auto &info = ext_info.getInfo(fcn);
               llvm::Instruction *ia = ci;
               auto free_info = info.getFreeData(m, cs, map, &ia);
-              for (auto &alloc : allocs) {
-                for (auto free_arg : free_info) {
+              for (auto free_arg : free_info) {
+                for (auto idx : alias_candidates(free_arg)) {
+                  auto alloc = allocs[idx];
                   if (aa.alias(Location(free_arg), Location(alloc)) !=
                       AliasResult::NoAlias) {
-                    free_locs.emplace(map.getDef(alloc),
-                        free_arg);
+                    for (auto obj_id : map.getIds(alloc)) {
+                      free_locs.emplace(obj_id, free_arg);
+                    }
                   }
                 }
               }
@@ -333,6 +460,9 @@ static free_location_multimap findFreeLocs(llvm::Module &m, UnusedFunctions &uf,
     }
   }
 
+  llvm::dbgs() << "findFreeLocs: " << num_queries << " alias queries of " <<
+    num_pairs << " free/alloc pairs\n";
+
   return free_locs;
 }
 
@@ -347,6 +477,9 @@ void SpecSFSInstrumenter::setupTypes(llvm::Module &m) {
   int8PtrType_ = llvm::PointerType::get(int8Type_, 0);
 
   voidType_ = llvm::Type::getVoidTy(m.getContext());
+
+  std::vector<llvm::Type *> frame_fields = { int32Type_, int64Type_ };
+  frameType_ = llvm::StructType::get(m.getContext(), frame_fields);
 }
 
 llvm::Function *SpecSFSInstrumenter::getSetJmpFcn(llvm::Module &m) {
@@ -379,119 +512,192 @@ llvm::Function *SpecSFSInstrumenter::getLongJmpFcn(llvm::Module &m) {
   return callLongJmpFcn_;
 }
 
-llvm::Function *SpecSFSInstrumenter::getPushFcn(llvm::Module &m) {
-  if (callPushFcn_ == nullptr) {
-    std::vector<llvm::Type *> push_args =
-        { int32Type_, int64Type_ };
+llvm::Function *SpecSFSInstrumenter::getOverflowFcn(llvm::Module &m) {
+  if (callOverflowFcn_ == nullptr) {
+    std::vector<llvm::Type *> overflow_args;
     auto fcn_type = llvm::FunctionType::get(
         voidType_,
-        push_args,
+        overflow_args,
         false);
-    callPushFcn_ = llvm::Function::Create(fcn_type,
+    callOverflowFcn_ = llvm::Function::Create(fcn_type,
         llvm::GlobalValue::ExternalLinkage,
-        PushName, &m);
+        OverflowName, &m);
+    callOverflowFcn_->setDoesNotReturn();
   }
-  return callPushFcn_;
+  return callOverflowFcn_;
 }
 
-llvm::Function *SpecSFSInstrumenter::getPopFcn(llvm::Module &m) {
-  if (callPopFcn_ == nullptr) {
-    std::vector<llvm::Type *> pop_args =
-        { int32Type_ };
+llvm::Function *SpecSFSInstrumenter::getCheckSlowFcn(llvm::Module &m) {
+  if (callCheckSlowFcn_ == nullptr) {
+    std::vector<llvm::Type *> check_args =
+        { int32Type_, int64Type_, int32PtrType_, int32PtrPtrType_ };
     auto fcn_type = llvm::FunctionType::get(
         voidType_,
-        pop_args,
+        check_args,
         false);
-    callPopFcn_ = llvm::Function::Create(fcn_type,
+    callCheckSlowFcn_ = llvm::Function::Create(fcn_type,
         llvm::GlobalValue::ExternalLinkage,
-        PopName, &m);
+        CheckSlowName, &m);
   }
-  return callPopFcn_;
+  return callCheckSlowFcn_;
 }
 
-llvm::Function *SpecSFSInstrumenter::getCheckFcn(llvm::Module &m) {
-  if (callCheckFcn_ == nullptr) {
+llvm::Function *SpecSFSInstrumenter::getCheckStatsFcn(llvm::Module &m) {
+  if (callCheckStatsFcn_ == nullptr) {
     std::vector<llvm::Type *> check_args =
-        { int32Type_, int32Type_, int32PtrPtrType_, int64PtrType_ };
+        { int32Type_, int64PtrType_, int64PtrType_, int64PtrType_,
+          int64Type_, int64Type_, int32PtrType_, int32PtrPtrType_ };
     auto fcn_type = llvm::FunctionType::get(
         voidType_,
         check_args,
         false);
-    callCheckFcn_ = llvm::Function::Create(fcn_type,
+    callCheckStatsFcn_ = llvm::Function::Create(fcn_type,
         llvm::GlobalValue::ExternalLinkage,
-        CheckName, &m);
+        CheckStatsName, &m);
   }
-  return callCheckFcn_;
+  return callCheckStatsFcn_;
 }
 
-std::pair<llvm::Constant *, llvm::Constant *>
+// The check runtime is a static library, so its TLS is always in the
+//   executable's initial TLS block
+llvm::GlobalVariable *SpecSFSInstrumenter::getStackGV(llvm::Module &m) {
+  if (stackGV_ == nullptr) {
+    auto stack_type = llvm::ArrayType::get(frameType_, CallStackMaxDepth);
+    stackGV_ = new llvm::GlobalVariable(m, stack_type, false,
+        llvm::GlobalValue::ExternalLinkage, nullptr, StackName, nullptr,
+        llvm::GlobalValue::InitialExecTLSModel);
+  }
+  return stackGV_;
+}
+
+llvm::GlobalVariable *SpecSFSInstrumenter::getStackTopGV(llvm::Module &m) {
+  if (stackTopGV_ == nullptr) {
+    stackTopGV_ = new llvm::GlobalVariable(m, int64Type_, false,
+        llvm::GlobalValue::ExternalLinkage, nullptr, StackTopName, nullptr,
+        llvm::GlobalValue::InitialExecTLSModel);
+  }
+  return stackTopGV_;
+}
+
+llvm::Value *SpecSFSInstrumenter::getFramePtr(llvm::Module &m,
+    llvm::Value *top, int32_t field, llvm::Instruction *insert_before) {
+  auto stack_gv = getStackGV(m);
+  std::vector<llvm::Value *> indicies =
+      { llvm::ConstantInt::get(int64Type_, 0), top,
+        llvm::ConstantInt::get(int32Type_, field) };
+  return llvm::GetElementPtrInst::CreateInBounds(stack_gv->getValueType(),
+      stack_gv, indicies, "", insert_before);
+}
+
+llvm::Constant *SpecSFSInstrumenter::ConstArrayToPointer(llvm::Module &m,
+    llvm::Type *elm_type, const std::vector<llvm::Constant *> &elms,
+    const std::string &name) {
+  auto array_type = llvm::ArrayType::get(elm_type, elms.size());
+  auto gv = new llvm::GlobalVariable(m, array_type, true,
+      llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantArray::get(array_type, elms), name);
+
+  std::vector<llvm::Constant *> indicies =
+      { llvm::ConstantInt::get(int32Type_, 0),
+        llvm::ConstantInt::get(int32Type_, 0) };
+  return llvm::ConstantExpr::getInBoundsGetElementPtr(array_type, gv,
+      indicies);
+}
+
+SpecSFSInstrumenter::CheckData
 SpecSFSInstrumenter::getCheckData(llvm::Module &m,
     const std::vector<const std::vector<CsCFG::Id> *> &data,
     BloomHasher::BloomFilter *hash_combine) {
-  // Okay, create a type for this data
-  // We will return a pair, a size followed by an array of size, data arrays
-  // We are ultimately returning an array of i32PtrTypes_
-  std::vector<llvm::Constant *> glbl_array_data;
-  std::vector<llvm::Value *> stacks;
+  // Hash each stack as the runtime's pushes will.  The bottom (main) frame
+  //   is never pushed, it starts the stack with CallStackInitHash
+  std::map<uint64_t, std::vector<const std::vector<CsCFG::Id> *>>
+    hash_to_stacks;
   for (auto &pstack : data) {
-    // Create an array of the stack:
-    // Type is: i32_t, size+1
-    auto array_type = llvm::ArrayType::get(int32Type_, pstack->size()+1);
-
-    // Now, create the constant array
-    // elm 0 is constant of size:
-    std::vector<llvm::Constant *> array_data =
-        { llvm::ConstantInt::get(int32Type_, pstack->size()) };
-    int64_t array_hash = 0x5F5F5F5F5F5F5F5FULL;
-    for (auto &id : *pstack) {
-      array_data.push_back(llvm::ConstantInt::get(int32Type_,
-            static_cast<int32_t>(id)));
-
+    assert(!pstack->empty());
+    uint64_t array_hash = CallStackInitHash;
+    for (auto it = std::next(std::begin(*pstack)), en = std::end(*pstack);
+        it != en; ++it) {
       // size_t id_hash = std::hash<CsCFG::Id>()(id);
-      size_t id_hash = bloom_hash(static_cast<size_t>(id));
-      llvm::dbgs() << "id hash is: " << id_hash << "\n";
+      size_t id_hash = bloom_hash(static_cast<size_t>(*it));
 
       array_hash = BloomHasher::mix_hash(array_hash,
           id_hash);
     }
     BloomHasher::bloom_add(*hash_combine, array_hash);
 
-    // Now, create a constant array
-    auto const_array = llvm::ConstantArray::get(array_type, array_data);
-    // Now, create the array:
-    llvm::GlobalVariable *sub_array = new llvm::GlobalVariable(m,
-        array_type, true,
-        llvm::GlobalValue::InternalLinkage, const_array,
-        "CallStackCheckData_internal");
-
-    std::vector<llvm::Constant *> indicies =
-        { llvm::ConstantInt::get(int32Type_, 0),
-          llvm::ConstantInt::get(int32Type_, 0) };
-    // And bitcast that to an int32PtrType_
-    auto gep = llvm::ConstantExpr::getInBoundsGetElementPtr(
-        sub_array->getType(),
-        sub_array,
-        indicies);
-    glbl_array_data.push_back(gep);
+    hash_to_stacks[array_hash].push_back(pstack);
   }
 
-  auto array_type = llvm::ArrayType::get(int32PtrType_, data.size());
+  // Then, lay the distinct hashes out in a minimal perfect hash table
+  std::vector<uint64_t> keys;
+  for (auto &pr : hash_to_stacks) {
+    keys.push_back(pr.first);
+  }
 
-  auto gv_init = llvm::ConstantArray::get(array_type, glbl_array_data);
+  CheckData ret;
+  ret.numBuckets = std::max<uint64_t>(1, keys.size() / 2);
+  std::vector<uint64_t> disps;
+  std::vector<uint64_t> key_slots;
+  StackHashTable::build(keys, ret.numBuckets, &ret.numSlots, &disps,
+      &key_slots);
+
+  std::vector<const std::vector<const std::vector<CsCFG::Id> *> *>
+    slot_stacks(ret.numSlots, nullptr);
+  std::vector<llvm::Constant *> key_data(ret.numSlots,
+      llvm::ConstantInt::get(int64Type_, 0));
+  {
+    size_t i = 0;
+    for (auto &pr : hash_to_stacks) {
+      auto slot = key_slots[i++];
+      slot_stacks[slot] = &pr.second;
+      key_data[slot] = llvm::ConstantInt::get(int64Type_, pr.first);
+    }
+  }
 
-  // Now, create the array:
-  llvm::GlobalVariable *gv = new llvm::GlobalVariable(m, array_type, true,
-      llvm::GlobalValue::InternalLinkage, gv_init, "CallStackCheckData");
+  std::vector<llvm::Constant *> ids_data;
+  std::vector<llvm::Constant *> starts_data;
+  for (auto pstacks : slot_stacks) {
+    starts_data.push_back(llvm::ConstantInt::get(int32Type_,
+          ids_data.size()));
+    if (pstacks == nullptr) {
+      continue;
+    }
 
-  // Now, get the pointer to the first element (thats an int32ptrptrtype_)
-  std::vector<llvm::Constant *> indicies =
-      { llvm::ConstantInt::get(int32Type_, 0),
-        llvm::ConstantInt::get(int32Type_, 0) };
-  // And bitcast that to an int32PtrType_
-  auto gep = llvm::ConstantExpr::getInBoundsGetElementPtr(gv->getType(),
-      gv, indicies);
+    for (auto pstack : *pstacks) {
+      // elm 0 is the stack's size, followed by its ids
+      std::vector<llvm::Constant *> array_data =
+          { llvm::ConstantInt::get(int32Type_, pstack->size()) };
+      for (auto &id : *pstack) {
+        array_data.push_back(llvm::ConstantInt::get(int32Type_,
+              static_cast<int32_t>(id)));
+      }
+
+      ids_data.push_back(ConstArrayToPointer(m, int32Type_, array_data,
+            "CallStackCheckData_internal"));
+    }
+  }
+  starts_data.push_back(llvm::ConstantInt::get(int32Type_, ids_data.size()));
+
+  std::vector<llvm::Constant *> disp_data;
+  for (auto disp : disps) {
+    disp_data.push_back(llvm::ConstantInt::get(int64Type_, disp));
+  }
+
+  ret.ids = ConstArrayToPointer(m, int32PtrType_, ids_data,
+      "CallStackCheckData");
+  ret.keys = ConstArrayToPointer(m, int64Type_, key_data,
+      "CallStackCheckData_keys");
+  ret.starts = ConstArrayToPointer(m, int32Type_, starts_data,
+      "CallStackCheckData_starts");
+  ret.disps = ConstArrayToPointer(m, int64Type_, disp_data,
+      "CallStackCheckData_disps");
+
+  if (ret.numSlots != keys.size()) {
+    llvm::dbgs() << "callstack check table for " << keys.size()
+      << " hashes needed " << ret.numSlots << " slots\n";
+  }
 
-  return std::make_pair(llvm::ConstantInt::get(int32Type_, data.size()), gep);
+  return ret;
 }
 
 llvm::Constant *SpecSFSInstrumenter::BloomFilterToPointer(
@@ -527,49 +733,138 @@ llvm::Constant *SpecSFSInstrumenter::BloomFilterToPointer(
   return array_ptr;
 }
 
+// Push, check, and pop are emitted inline, they run at every instrumented
+//   call site.  Only an exact stack hash match (or a stack overflow) leaves
+//   the fast path
 void SpecSFSInstrumenter::addCallInst(llvm::Module &m,
     CsCFG::Id val,
     llvm::Instruction *cs,
     const std::vector<const std::vector<CsCFG::Id> *> &stacks) {
-  // First add a call to the push function
-  {
-    auto push_fcn = getPushFcn(m);
+  auto top_gv = getStackTopGV(m);
+  auto val_id = llvm::ConstantInt::get(int32Type_, static_cast<int32_t>(val));
+  auto cold_weights = llvm::MDBuilder(m.getContext()).createBranchWeights(1,
+      1 << 20);
+
+  auto new_binop = [&cs] (llvm::Instruction::BinaryOps op, llvm::Value *lhs,
+      llvm::Value *rhs) {
+    return llvm::BinaryOperator::Create(op, lhs, rhs, "", cs);
+  };
+
+  auto get_int64 = [this] (uint64_t val) {
+    return llvm::ConstantInt::get(int64Type_, val);
+  };
 
+  // First push this call site, unless it is already on top of the stack
+  //   (recursion through one call site doesn't grow the stack):
+  //   if (stack[top].id != val) stack[++top] = { val, mix(stack[top].hash) }
+  // This is done without branches, other than the overflow check
+  {
     // we add the push jsut before the call
     // size_t val_hash = std::hash<CsCFG::Id>()(val);
     size_t val_hash = bloom_hash(static_cast<size_t>(val));
-    std::vector<llvm::Value *> push_args =
-        { llvm::ConstantInt::get(int32Type_, static_cast<int32_t>(val)),
-          llvm::ConstantInt::get(int64Type_, val_hash) };
-    llvm::CallInst::Create(push_fcn, push_args, "", cs);
+
+    auto top = new llvm::LoadInst(int64Type_, top_gv, "", false, cs);
+    auto cur_id = new llvm::LoadInst(int32Type_,
+        getFramePtr(m, top, 0, cs), "", false, cs);
+    auto cur_hash = new llvm::LoadInst(int64Type_,
+        getFramePtr(m, top, 1, cs), "", false, cs);
+
+    // BloomHasher::mix_hash(cur_hash, val_hash)
+    auto mixed = new_binop(llvm::Instruction::Add,
+        get_int64(static_cast<uint64_t>(val_hash) + 0x9e3779b9),
+        new_binop(llvm::Instruction::Add,
+          new_binop(llvm::Instruction::Shl, cur_hash, get_int64(6)),
+          new_binop(llvm::Instruction::LShr, cur_hash, get_int64(2))));
+    auto new_hash = new_binop(llvm::Instruction::Xor, cur_hash, mixed);
+
+    auto do_push = new llvm::ICmpInst(cs, llvm::CmpInst::ICMP_NE, cur_id,
+        val_id);
+    auto new_top = new_binop(llvm::Instruction::Add, top,
+        new llvm::ZExtInst(do_push, int64Type_, "", cs));
+    auto push_hash = llvm::SelectInst::Create(do_push, new_hash, cur_hash, "",
+        cs);
+
+    auto overflow = new llvm::ICmpInst(cs, llvm::CmpInst::ICMP_SGE, new_top,
+        get_int64(CallStackMaxDepth));
+    auto overflow_term = llvm::SplitBlockAndInsertIfThen(overflow, cs, true,
+        cold_weights);
+    llvm::CallInst::Create(getOverflowFcn(m), "", overflow_term);
+
+    // When we don't push, these rewrite the top frame with its own values
+    new llvm::StoreInst(val_id, getFramePtr(m, new_top, 0, cs), cs);
+    new llvm::StoreInst(push_hash, getFramePtr(m, new_top, 1, cs), cs);
+    new llvm::StoreInst(new_top, top_gv, cs);
   }
 
-  // Then, (if needed), do a call to the check function
+  // Then, (if needed), check the stack against this site's table
   if (stacks.size() > 0) {
-    auto check_fcn = getCheckFcn(m);
-
     // Initialize array to 0
     BloomHasher::BloomFilter stack_hash;
     BloomHasher::bloom_clear(stack_hash);
-    auto data_pr = getCheckData(m, stacks, &stack_hash);
-
-    auto array_data = BloomFilterToPointer(m, stack_hash);
-    llvm::dbgs() << "array_data is: " << *array_data << "\n";
-    std::vector<llvm::Value *> check_args =
-        { llvm::ConstantInt::get(int32Type_, static_cast<int32_t>(val)),
-          data_pr.first, data_pr.second,
-          array_data };
-    llvm::CallInst::Create(check_fcn, check_args, "", cs);
+    auto check_data = getCheckData(m, stacks, &stack_hash);
+
+    if (callstack_stats) {
+      auto array_data = BloomFilterToPointer(m, stack_hash);
+      std::vector<llvm::Value *> check_args =
+          { val_id, array_data, check_data.keys, check_data.disps,
+            get_int64(check_data.numBuckets), get_int64(check_data.numSlots),
+            check_data.starts, check_data.ids };
+      llvm::CallInst::Create(getCheckStatsFcn(m), check_args, "", cs);
+    } else {
+      // The StackHashTable lookup of stack[top].hash:
+      //   bucket = (hash >> 32) % num_buckets
+      //   x = (hash ^ disps[bucket]) * SlotMul
+      //   slot = (x ^ (x >> 33)) % num_slots
+      auto top = new llvm::LoadInst(int64Type_, top_gv, "", false, cs);
+      auto hash = new llvm::LoadInst(int64Type_,
+          getFramePtr(m, top, 1, cs), "", false, cs);
+
+      auto load_elm = [&cs] (llvm::Type *type, llvm::Value *array,
+          llvm::Value *idx) {
+        std::vector<llvm::Value *> elm_idx = { idx };
+        return new llvm::LoadInst(type,
+            llvm::GetElementPtrInst::CreateInBounds(type, array, elm_idx, "",
+              cs), "", false, cs);
+      };
+
+      auto bucket = new_binop(llvm::Instruction::URem,
+          new_binop(llvm::Instruction::LShr, hash, get_int64(32)),
+          get_int64(check_data.numBuckets));
+      auto disp = load_elm(int64Type_, check_data.disps, bucket);
+
+      auto x = new_binop(llvm::Instruction::Mul,
+          new_binop(llvm::Instruction::Xor, hash, disp),
+          get_int64(StackHashTable::SlotMul));
+      auto slot = new_binop(llvm::Instruction::URem,
+          new_binop(llvm::Instruction::Xor, x,
+            new_binop(llvm::Instruction::LShr, x, get_int64(33))),
+          get_int64(check_data.numSlots));
+      auto key = load_elm(int64Type_, check_data.keys, slot);
+
+      // Only an exact hash match leaves the fast path
+      auto is_hit = new llvm::ICmpInst(cs, llvm::CmpInst::ICMP_EQ, key, hash);
+      auto slow_term = llvm::SplitBlockAndInsertIfThen(is_hit, cs, false,
+          cold_weights);
+
+      std::vector<llvm::Value *> check_args =
+          { val_id, slot, check_data.starts, check_data.ids };
+      llvm::CallInst::Create(getCheckSlowFcn(m), check_args, "", slow_term);
+    }
   }
 
-  // Finally call the pop function
+  // Finally pop our frame, if we pushed it:
+  //   top -= (stack[top].id == val)
   {
-    auto pop_fcn = getPopFcn(m);
-
-    std::vector<llvm::Value *> pop_args =
-        { llvm::ConstantInt::get(int32Type_, static_cast<int32_t>(val)) };
-    auto pop_call = llvm::CallInst::Create(pop_fcn, pop_args);
-    pop_call->insertAfter(cs);
+    auto after = cs->getNextNode();
+
+    auto top = new llvm::LoadInst(int64Type_, top_gv, "", false, after);
+    auto cur_id = new llvm::LoadInst(int32Type_,
+        getFramePtr(m, top, 0, after), "", false, after);
+    auto is_ours = new llvm::ICmpInst(after, llvm::CmpInst::ICMP_EQ, cur_id,
+        val_id);
+    auto new_top = llvm::BinaryOperator::Create(llvm::Instruction::Sub, top,
+        new llvm::ZExtInst(is_ours, int64Type_, "", after), "", after);
+    new llvm::StoreInst(new_top, top_gv, after);
   }
 }
 
@@ -721,15 +1016,22 @@ bool SpecSFSInstrumenter::runOnModule(llvm::Module &m) {
 
   const AssumptionSet *passumptions = nullptr;
   const ConstraintPass *pcp;
+  std::function<const PtstoSet *(const llvm::Value *)> get_pts;
 
   if (auto panders = getAnalysisIfAvailable<SpecAndersWrapperPass>()) {
     llvm::dbgs() << "Have anders ptsto\n";
     passumptions = &panders->anders().getSpecAssumptions();
     pcp = &panders->anders().getConstraintPass();
+    get_pts = [panders] (const llvm::Value *val) {
+      return panders->anders().getPointsTo(val);
+    };
   } else if (auto pcsa = getAnalysisIfAvailable<SpecAndersCS>()) {
     llvm::dbgs() << "Have cs anders ptsto\n";
     passumptions = &pcsa->getSpecAssumptions();
     pcp = &pcsa->getConstraintPass();
+    get_pts = [pcsa] (const llvm::Value *val) {
+      return pcsa->getPointsTo(val);
+    };
   } else {
     llvm_unreachable("Don't have valid AA?\n");
   }
@@ -752,7 +1054,8 @@ bool SpecSFSInstrumenter::runOnModule(llvm::Module &m) {
   //   possible deallocated objects
 
   // **This is a mapping of allocation site to all possible free sites
-  free_location_multimap free_locs = findFreeLocs(m, uf, indir, cg, aa);
+  free_location_multimap free_locs = findFreeLocs(m, uf, indir, cg, aa,
+      get_pts);
 
   // Woot, I got my free set... that was exhausting
   //
@@ -831,6 +1134,10 @@ bool SpecSFSInstrumenter::runOnModule(llvm::Module &m) {
     ret |= pinst->doInstrument(m, ext_info);
   }
 
+  if (!no_check_opt) {
+    ret |= optimizeSetChecks(m);
+  }
+
 
   {
     auto i8_ptr_type = llvm::PointerType::get(
@@ -894,27 +1201,27 @@ bool SpecSFSInstrumenter::runOnModule(llvm::Module &m) {
         [&map, &malloc_fcn, &m, &first_inst,
           &i32_type, &i8_ptr_type, &set_cache]
         (llvm::Value &glbl) {
-      // Get the obj from the return value
-      auto obj_id = map.getDef(&glbl);
-
-      if (set_cache.gvUsed(obj_id)) {
-        // Get the arg_pos for the size from the function
-        // llvm::dbgs() << "glbl type is: " << *glbl.getType() << "\n";
-        auto type = glbl.getType();
-        assert(llvm::isa<llvm::PointerType>(type));
-        // Strip pointer type:
-        type = type->getContainedType(0);
-        // llvm::dbgs() << "passed type is: " << *type << "\n";
-        auto size_val = LLVMHelper::calcTypeOffset(m,
-            type, &first_inst);
-
-        // Make the call
-        std::vector<llvm::Value *> args;
-        args.push_back(llvm::ConstantInt::get(i32_type, obj_id.val()));
-        args.push_back(llvm::ConstantExpr::getBitCast(
-              cast<llvm::Constant>(&glbl), i8_ptr_type));
-        args.push_back(size_val);
-        llvm::CallInst::Create(malloc_fcn, args, "", &first_inst);
+      // Globals are constants, so they are mapped like the functions above
+      for (auto obj_id : map.getIds(&glbl)) {
+        if (set_cache.gvUsed(obj_id)) {
+          // Get the arg_pos for the size from the function
+          // llvm::dbgs() << "glbl type is: " << *glbl.getType() << "\n";
+          auto type = glbl.getType();
+          assert(llvm::isa<llvm::PointerType>(type));
+          // Strip pointer type:
+          type = type->getContainedType(0);
+          // llvm::dbgs() << "passed type is: " << *type << "\n";
+          auto size_val = LLVMHelper::calcTypeOffset(m,
+              type, &first_inst);
+
+          // Make the call
+          std::vector<llvm::Value *> args;
+          args.push_back(llvm::ConstantInt::get(i32_type, obj_id.val()));
+          args.push_back(llvm::ConstantExpr::getBitCast(
+                cast<llvm::Constant>(&glbl), i8_ptr_type));
+          args.push_back(size_val);
+          llvm::CallInst::Create(malloc_fcn, args, "", &first_inst);
+        }
       }
     });
   }
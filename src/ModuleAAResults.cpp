@@ -4,6 +4,15 @@
 
 #include "include/ModuleAAResults.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "llvm/Pass.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 
@@ -38,6 +47,259 @@ AliasResult ModuleAAResults::alias(const llvm::MemoryLocation &l1,
   return ret;
 }
 
+// Batch queries {{{
+namespace {
+
+// A class of locations which share one points-to set
+struct AliasClass {
+  enum class Kind {
+    // Aliases if |pts| intersect
+    Pts,
+    // We have no points-to set, may alias anything
+    Unknown,
+    // An int-to-ptr constant, aliases nothing
+    NoAlias,
+  };
+
+  Kind kind = Kind::Pts;
+
+  // Sorted, without ValueMap::NullValue
+  std::vector<ValueMap::Id> pts;
+};
+
+}  // namespace
+
+static bool is_int_to_ptr(const llvm::Value *v) {
+  if (auto ce = dyn_cast<llvm::ConstantExpr>(v)) {
+    return ce->getOpcode() == llvm::Instruction::IntToPtr;
+  }
+  return false;
+}
+
+// Maps each of |locs| to its class in |classes|.  |aa| is either
+//   SpecAndersAnalysis or SpecAndersCS
+template <typename AA>
+static std::vector<size_t> classify(AA *aa, bool check_int_to_ptr,
+    const std::vector<llvm::MemoryLocation> &locs,
+    std::vector<AliasClass> &classes) {
+  static const size_t NoClass = std::numeric_limits<size_t>::max();
+  std::map<std::vector<ValueMap::Id>, size_t> class_ids;
+  size_t unknown = NoClass;
+  size_t no_alias = NoClass;
+
+  auto special = [&classes] (size_t &cls, AliasClass::Kind kind) {
+    if (cls == NoClass) {
+      cls = classes.size();
+      classes.emplace_back();
+      classes.back().kind = kind;
+    }
+    return cls;
+  };
+
+  std::vector<size_t> ret;
+  for (auto &loc : locs) {
+    auto val = loc.Ptr;
+    if (aa == nullptr) {
+      ret.push_back(special(unknown, AliasClass::Kind::Unknown));
+      continue;
+    }
+
+    if (check_int_to_ptr && is_int_to_ptr(val)) {
+      ret.push_back(special(no_alias, AliasClass::Kind::NoAlias));
+      continue;
+    }
+
+    auto rc = class_ids.emplace(aa->getRepClass(val), classes.size());
+    if (rc.second) {
+      classes.emplace_back();
+      auto &cls = classes.back();
+      auto pts = aa->getPointsTo(val);
+      if (pts == nullptr) {
+        cls.kind = AliasClass::Kind::Unknown;
+      } else {
+        for (auto obj_id : *pts) {
+          if (obj_id != ValueMap::NullValue) {
+            cls.pts.push_back(obj_id);
+          }
+        }
+        std::sort(std::begin(cls.pts), std::end(cls.pts));
+      }
+    }
+    ret.push_back(rc.first->second);
+  }
+
+  return ret;
+}
+
+static llvm::AliasResult class_alias(const AliasClass &lhs,
+    const AliasClass &rhs) {
+  if (lhs.kind == AliasClass::Kind::NoAlias ||
+      rhs.kind == AliasClass::Kind::NoAlias) {
+    return llvm::AliasResult::NoAlias;
+  }
+
+  if (lhs.kind == AliasClass::Kind::Unknown ||
+      rhs.kind == AliasClass::Kind::Unknown) {
+    return llvm::AliasResult::MayAlias;
+  }
+
+  auto lhs_it = std::begin(lhs.pts);
+  auto rhs_it = std::begin(rhs.pts);
+  while (lhs_it != std::end(lhs.pts) && rhs_it != std::end(rhs.pts)) {
+    if (*lhs_it < *rhs_it) {
+      ++lhs_it;
+    } else if (*rhs_it < *lhs_it) {
+      ++rhs_it;
+    } else {
+      return llvm::AliasResult::MayAlias;
+    }
+  }
+
+  return llvm::AliasResult::NoAlias;
+}
+
+size_t AliasMatrix::count(llvm::AliasResult res) const {
+  std::vector<size_t> row_cnt(numColClasses_ == 0 ? 0 :
+      results_.size() / numColClasses_, 0);
+  std::vector<size_t> col_cnt(numColClasses_, 0);
+  for (auto cls : rowClass_) {
+    row_cnt[cls]++;
+  }
+  for (auto cls : colClass_) {
+    col_cnt[cls]++;
+  }
+
+  size_t ret = 0;
+  for (size_t row = 0; row < row_cnt.size(); ++row) {
+    for (size_t col = 0; col < col_cnt.size(); ++col) {
+      if (classResult(row, col) == res) {
+        ret += row_cnt[row] * col_cnt[col];
+      }
+    }
+  }
+
+  return ret;
+}
+
+// Classifies |locs| with whichever analysis we have
+static std::vector<size_t> classify_locs(SpecAndersCS *anders_cs,
+    SpecAndersWrapperPass *anders_wrapper,
+    const std::vector<llvm::MemoryLocation> &locs,
+    std::vector<AliasClass> &classes) {
+  if (anders_cs) {
+    return classify(anders_cs, false, locs, classes);
+  }
+
+  SpecAndersAnalysis *anders = nullptr;
+  if (anders_wrapper) {
+    anders = &anders_wrapper->anders();
+  }
+  return classify(anders, true, locs, classes);
+}
+
+// Runs |worker| on up to |num_threads| threads (0 uses one per core), but no
+//   more than there are |num_rows| for them to take
+static void run_workers(size_t num_threads, size_t num_rows,
+    const std::function<void()> &worker) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::max<size_t>(1, std::min(num_threads, num_rows));
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void AliasPairCounts::add(llvm::AliasResult res, size_t cnt) {
+  pairs += cnt;
+  if (res == llvm::AliasResult::NoAlias) {
+    noAlias += cnt;
+  } else if (res == llvm::AliasResult::MustAlias) {
+    mustAlias += cnt;
+  } else {
+    mayAlias += cnt;
+  }
+}
+
+void AliasPairCounts::merge(const AliasPairCounts &rhs) {
+  pairs += rhs.pairs;
+  mayAlias += rhs.mayAlias;
+  mustAlias += rhs.mustAlias;
+  noAlias += rhs.noAlias;
+}
+
+AliasMatrix ModuleAAResults::aliasMatrix(
+    const std::vector<llvm::MemoryLocation> &locs_a,
+    const std::vector<llvm::MemoryLocation> &locs_b,
+    size_t num_threads) {
+  // Points-to sets aren't thread-safe, so they are all flattened into their
+  //   classes up front, the intersections only read the classes
+  std::vector<AliasClass> a_classes;
+  std::vector<AliasClass> b_classes;
+  auto row_class = classify_locs(andersCS_, anders_, locs_a, a_classes);
+  auto col_class = classify_locs(andersCS_, anders_, locs_b, b_classes);
+
+  AliasMatrix ret(std::move(row_class), a_classes.size(),
+      std::move(col_class), b_classes.size());
+
+  std::atomic<size_t> next_row(0);
+  run_workers(num_threads, a_classes.size(),
+      [&next_row, &a_classes, &b_classes, &ret] {
+    for (size_t row = next_row++; row < a_classes.size(); row = next_row++) {
+      for (size_t col = 0; col < b_classes.size(); ++col) {
+        ret.setClassResult(row, col,
+            class_alias(a_classes[row], b_classes[col]));
+      }
+    }
+  });
+
+  return ret;
+}
+
+AliasPairCounts ModuleAAResults::aliasPairCounts(
+    const std::vector<llvm::MemoryLocation> &locs, size_t num_threads) {
+  std::vector<AliasClass> classes;
+  auto loc_class = classify_locs(andersCS_, anders_, locs, classes);
+
+  std::vector<size_t> class_cnt(classes.size(), 0);
+  for (auto cls : loc_class) {
+    class_cnt[cls]++;
+  }
+
+  // Only the upper triangle of class pairs (diagonal included) is computed,
+  //   and each is counted as it is computed, so nothing is kept per pair
+  AliasPairCounts ret;
+  std::mutex ret_lock;
+  std::atomic<size_t> next_row(0);
+  run_workers(num_threads, classes.size(),
+      [&next_row, &classes, &class_cnt, &ret, &ret_lock] {
+    AliasPairCounts counts;
+    for (size_t row = next_row++; row < classes.size(); row = next_row++) {
+      auto row_cnt = class_cnt[row];
+      // Distinct locations within the class
+      counts.add(class_alias(classes[row], classes[row]),
+          row_cnt * (row_cnt - 1) / 2);
+
+      for (size_t col = row + 1; col < classes.size(); ++col) {
+        counts.add(class_alias(classes[row], classes[col]),
+            row_cnt * class_cnt[col]);
+      }
+    }
+
+    std::lock_guard<std::mutex> guard(ret_lock);
+    ret.merge(counts);
+  });
+
+  return ret;
+}
+//}}}
+
 namespace llvm {
   static RegisterPass<ModuleAAResults>
       ModAARP("ModuleAAResults", "Wrapper for andersens AAs", false, true);
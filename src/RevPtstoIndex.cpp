@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include "include/RevPtstoIndex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "include/AndersGraph.h"
+
+void RevPtstoIndex::build(AndersGraph &graph, size_t num_threads) {
+  // First flatten the reps' sets, in CSR form, the points-to sets themselves
+  //   aren't thread-safe
+  std::vector<Id> fwd_reps;
+  std::vector<size_t> fwd_offsets(1, 0);
+  std::vector<Id> fwd_objs;
+  for (auto &node : graph) {
+    if (!graph.isRep(node) || node.ptsto().empty()) {
+      continue;
+    }
+
+    fwd_reps.push_back(node.id());
+    for (auto obj_id : node.ptsto()) {
+      fwd_objs.push_back(obj_id);
+    }
+    std::sort(std::begin(fwd_objs) + fwd_offsets.back(), std::end(fwd_objs));
+    fwd_offsets.push_back(fwd_objs.size());
+  }
+
+  build(fwd_reps, fwd_offsets, fwd_objs, num_threads);
+}
+
+void RevPtstoIndex::build(const std::vector<Id> &fwd_reps,
+    const std::vector<size_t> &fwd_offsets, const std::vector<Id> &fwd_objs,
+    size_t num_threads) {
+  assert(fwd_offsets.size() == fwd_reps.size() + 1);
+  assert(fwd_objs.size() < std::numeric_limits<uint32_t>::max());
+
+  size_t num_objs = 0;
+  for (auto obj_id : fwd_objs) {
+    num_objs = std::max(num_objs, static_cast<size_t>(obj_id.val()) + 1);
+  }
+
+  // Each thread owns a contiguous range of objects, so no
+  //   two threads ever write the same entry
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::max<size_t>(1, std::min(num_threads, num_objs));
+
+  auto parallel = [num_threads] (std::function<void(size_t)> fn) {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+      threads.emplace_back(fn, i);
+    }
+    fn(0);
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  };
+
+  // Calls |fn(rep_idx, obj_id)| for each object in the thread's range, in
+  //   rep order
+  auto for_range = [num_objs, num_threads, &fwd_reps, &fwd_objs,
+       &fwd_offsets] (size_t thread, std::function<void(size_t, Id)> fn) {
+    Id lo(num_objs * thread / num_threads);
+    Id hi(num_objs * (thread + 1) / num_threads);
+    for (size_t i = 0; i < fwd_reps.size(); ++i) {
+      auto st = std::begin(fwd_objs) + fwd_offsets[i];
+      auto en = std::begin(fwd_objs) + fwd_offsets[i + 1];
+      for (auto it = std::lower_bound(st, en, lo);
+          it != en && *it < hi; ++it) {
+        fn(i, *it);
+      }
+    }
+  };
+
+  offsets_.assign(num_objs + 1, 0);
+  parallel([this, &for_range] (size_t thread) {
+    for_range(thread, [this] (size_t, Id obj_id) {
+      offsets_[obj_id.val() + 1]++;
+    });
+  });
+
+  for (size_t i = 1; i < offsets_.size(); ++i) {
+    offsets_[i] += offsets_[i - 1];
+  }
+
+  reps_.assign(fwd_objs.size(), Id());
+  auto next = offsets_;
+  parallel([this, &for_range, &next, &fwd_reps] (size_t thread) {
+    for_range(thread, [this, &next, &fwd_reps] (size_t rep_idx, Id obj_id) {
+      reps_[next[obj_id.val()]++] = fwd_reps[rep_idx];
+    });
+  });
+}
+
+void RevPtstoIndex::printStats(llvm::raw_ostream &o) const {
+  size_t num_pointed_to = 0;
+  size_t max_pointed_to = 0;
+  for (size_t i = 0; i + 1 < offsets_.size(); ++i) {
+    auto cnt = offsets_[i + 1] - offsets_[i];
+    if (cnt != 0) {
+      num_pointed_to++;
+    }
+    max_pointed_to = std::max<size_t>(max_pointed_to, cnt);
+  }
+
+  o << "RevPtstoIndex:\n";
+  o << "  Num objects:        " << num_pointed_to << "\n";
+  o << "  Num edges:          " << reps_.size() << "\n";
+  o << "  Max pointed to by:  " << max_pointed_to << "\n";
+}
@@ -21,6 +21,7 @@
 #include "include/AndersGraph.h"
 #include "include/Debug.h"
 #include "include/SpecAnders.h"
+#include "include/Telemetry.h"
 
 extern llvm::cl::opt<bool> no_spec;
 
@@ -133,6 +134,7 @@ class RunNuutila {
     */
     if (node_data.root == dfs_idx) {
       bool ch = false;
+      size_t scc_size = 1;
 
       while (!nodeStack_.empty()) {
         auto next_id = nodeStack_.top();
@@ -149,6 +151,7 @@ class RunNuutila {
         // If we weren't already merged (HCD can cause this)
         if (rep_next_id != node_rep.id()) {
           lcd_merge_count++;
+          scc_size++;
           auto &nd = graph_.getNode(rep_next_id);
           /*
           if (node_id == ObjectMap::NullValue ||
@@ -167,6 +170,10 @@ class RunNuutila {
       // llvm::dbgs() << "  ~~merged_.insert(" << node_id << ")\n";
       merged_.insert(node_rep_id);
 
+      if (scc_size > 1) {
+        telemetry::sample("anders.lcd_scc_size", scc_size);
+      }
+
       if (ch) {
         if_debug_enabled(auto &node = graph_.getNode(node_rep_id));
         assert(node.id() == node_rep_id);
@@ -217,6 +224,7 @@ bool SpecAndersAnalysis::solve() {
 
   size_t hcd_merge_count = 0;
   size_t lcd_check_count = 0;
+  size_t lcd_merge_start = lcd_merge_count;
   size_t hcd_merge_last = 0;
   size_t lcd_merge_last = 0;
   size_t lcd_check_last = 0;
@@ -548,6 +556,9 @@ bool SpecAndersAnalysis::solve() {
   llvm::dbgs() << "Final hcd_merge_count: " << hcd_merge_count << "\n";
   llvm::dbgs() << "Final lcd_check_count: " << lcd_check_count << "\n";
   llvm::dbgs() << "Final lcd_merge_count: " << lcd_merge_count << "\n";
+  telemetry::count("anders.hcd_merges", hcd_merge_count);
+  telemetry::count("anders.lcd_checks", lcd_check_count);
+  telemetry::count("anders.lcd_merges", lcd_merge_count - lcd_merge_start);
 
   return false;
 }
@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <limits>
+#include <list>
 #include <map>
 #include <set>
 #include <utility>
@@ -13,6 +14,15 @@
 
 #include "include/lib/BddSet.h"
 
+#include "llvm/Support/CommandLine.h"
+
+static llvm::cl::opt<int32_t> //  NOLINT
+  gep_cache_nodes("anders-gep-cache-nodes", llvm::cl::init(1 << 20),
+      llvm::cl::value_desc("int"),
+      llvm::cl::desc("Max BDD nodes the GEP offset cache may pin, counted as "
+        "the nodes of each entry's source and result BDDs (0 disables the "
+        "cache)"));
+
 // BddPtstoSet statics {{{
 bool BddPtstoSet::bddInitd_ = false;
 std::vector<bdd> BddPtstoSet::geps_;
@@ -28,6 +38,14 @@ std::vector<bdd> BddPtstoSet::fddCache_;
 
 std::vector<ValueMap::Id> BddPtstoSet::uglyBddVec_;
 
+std::list<BddPtstoSet::GepCacheEntry> BddPtstoSet::gepLRU_;
+std::unordered_map<uint64_t,
+  std::list<BddPtstoSet::GepCacheEntry>::iterator> BddPtstoSet::gepCache_;
+size_t BddPtstoSet::gepHits_ = 0;
+size_t BddPtstoSet::gepMisses_ = 0;
+size_t BddPtstoSet::gepEvictions_ = 0;
+size_t BddPtstoSet::gepNodes_ = 0;
+
 std::map<uint32_t, std::pair<bool,
   std::shared_ptr<std::vector<ValueMap::Id>>>>
     BddPtstoSet::vecCache_;
@@ -45,7 +63,8 @@ void BddPtstoSet::bddInit(const Cg &cg) {
   llvm::dbgs() << "bdd domain size is: " << domain_size << "\n";
 
   // In lib/BddSet.cpp
-  bdd_init_once(2);
+  bdd_init_once(2, cg.constraints().size() +
+      static_cast<size_t>(cg.vals().getMaxAlloc()));
 
   // We expand the domain to encompass our realm of possible object values
   fdd_extdomain(domain, 2);
@@ -63,6 +82,54 @@ void BddPtstoSet::bddInit(const Cg &cg) {
   updateGeps(cg);
 }
 
+static uint64_t gepKey(const bdd &src, int32_t offs) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(src.id())) << 32) |
+    static_cast<uint32_t>(offs);
+}
+
+bdd BddPtstoSet::applyOffs(const bdd &src, int32_t offs) {
+  auto do_offs = [&src, offs] {
+    return bdd_replace(bdd_relprod(src, geps_[offs], ptsDom_), gepToPts_);
+  };
+
+  if (gep_cache_nodes <= 0) {
+    return do_offs();
+  }
+
+  auto key = gepKey(src, offs);
+  auto it = gepCache_.find(key);
+  if (it != std::end(gepCache_)) {
+    gepHits_++;
+    gepLRU_.splice(std::begin(gepLRU_), gepLRU_, it->second);
+    return it->second->result;
+  }
+
+  gepMisses_++;
+  auto ret = do_offs();
+
+  // Entries may share nodes, so this over-counts what we pin
+  auto nodes = static_cast<size_t>(bdd_nodecount(src)) +
+    static_cast<size_t>(bdd_nodecount(ret));
+  auto max_nodes = static_cast<size_t>(gep_cache_nodes);
+  if (nodes > max_nodes) {
+    return ret;
+  }
+
+  while (gepNodes_ + nodes > max_nodes) {
+    auto &old = gepLRU_.back();
+    gepNodes_ -= old.nodes;
+    gepCache_.erase(gepKey(old.src, old.offs));
+    gepLRU_.pop_back();
+    gepEvictions_++;
+  }
+
+  gepLRU_.emplace_front(src, offs, ret, nodes);
+  gepCache_.emplace(key, std::begin(gepLRU_));
+  gepNodes_ += nodes;
+
+  return ret;
+}
+
 void BddPtstoSet::updateConstraints(const Cg &cg) {
   consStartPos_ = cg.constraints().size();
 }
@@ -192,6 +259,11 @@ void BddPtstoSet::updateGeps(const Cg &cg) {
     geps_[offs] |= f & off_mask;
   }
   // llvm::dbgs() << "geps_ loop done\n";
+
+  // Cached offsets were computed from the old geps_
+  gepCache_.clear();
+  gepLRU_.clear();
+  gepNodes_ = 0;
 }
 
 //}}}
@@ -9,8 +9,6 @@
 
 #include "include/SpecAnders.h"
 
-#include <gperftools/profiler.h>
-
 #include <execinfo.h>
 
 #include <algorithm>
@@ -110,6 +108,26 @@ static llvm::cl::opt<bool>
       llvm::cl::desc(
         "if set specanders will print the ptsto sets for each value"));
 
+static llvm::cl::opt<unsigned>
+  alias_cache_size("anders-alias-cache-size", llvm::cl::init(1 << 20),
+      llvm::cl::value_desc("unsigned"),
+      llvm::cl::desc(
+        "Max number of memoized alias() pairs, 0 disables the cache"));
+
+static llvm::cl::opt<bool>
+  build_rev_ptsto("anders-rev-ptsto", llvm::cl::init(false),
+      llvm::cl::value_desc("bool"),
+      llvm::cl::desc(
+        "Builds the object -> pointers index right after solving, instead "
+        "of on first use"));
+
+static llvm::cl::opt<unsigned>
+  rev_ptsto_threads("anders-rev-ptsto-threads", llvm::cl::init(0),
+      llvm::cl::value_desc("unsigned"),
+      llvm::cl::desc(
+        "Threads to build the object -> pointers index on, 0 uses one per "
+        "core"));
+
 static llvm::cl::opt<bool>
   do_spec_dyn_debug("anders-do-check-dyn", llvm::cl::init(false),
       llvm::cl::value_desc("bool"),
@@ -143,39 +161,58 @@ llvm::AliasResult SpecAndersAAResult::alias(const llvm::MemoryLocation &L1,
     return llvm::AliasResult::NoAlias;
   }
 
-  auto pv1_pts = anders_.ptsCacheGet(v1);
-  auto pv2_pts = anders_.ptsCacheGet(v2);
-
-  if (pv1_pts == nullptr) {
-    /*
-    llvm::dbgs() << "Anders couldn't find node: " << obj_id1 <<
-      << " " << FullValPrint(obj_id1, omap_) << "\n";
-    */
-    return llvm::AAResultBase<SpecAndersAAResult>::alias(L1, L2);
+  // Values are memoized by their class of solver reps, so repeated queries
+  //   skip both the points-to lookup and the intersection
+  auto &cache = *anders_.aliasCache_;
+  AliasCache::ClassId cls1 = 0;
+  AliasCache::ClassId cls2 = 0;
+  bool intersects = false;
+  bool cached = false;
+  if (cache.enabled()) {
+    auto get_reps = [this] (const llvm::Value *val) {
+      return anders_.getRepClass(val);
+    };
+    cls1 = cache.getClass(v1, get_reps);
+    cls2 = cache.getClass(v2, get_reps);
+    cached = cache.lookup(cls1, cls2, intersects);
   }
 
-  if (pv2_pts == nullptr) {
-    /*
-    llvm::dbgs() << "Anders couldn't find node: " << obj_id2 <<
-      << " " << FullValPrint(obj_id2, omap_) << "\n";
-    */
-    return llvm::AAResultBase<SpecAndersAAResult>::alias(L1, L2);
-  }
+  if (!cached) {
+    auto pv1_pts = anders_.ptsCacheGet(v1);
+    auto pv2_pts = anders_.ptsCacheGet(v2);
+
+    if (pv1_pts == nullptr) {
+      /*
+      llvm::dbgs() << "Anders couldn't find node: " << obj_id1 <<
+        << " " << FullValPrint(obj_id1, omap_) << "\n";
+      */
+      return llvm::AAResultBase<SpecAndersAAResult>::alias(L1, L2);
+    }
+
+    if (pv2_pts == nullptr) {
+      /*
+      llvm::dbgs() << "Anders couldn't find node: " << obj_id2 <<
+        << " " << FullValPrint(obj_id2, omap_) << "\n";
+      */
+      return llvm::AAResultBase<SpecAndersAAResult>::alias(L1, L2);
+    }
 
-  auto &pts1 = *pv1_pts;
-  auto &pts2 = *pv2_pts;
+    auto &pts1 = *pv1_pts;
+    auto &pts2 = *pv2_pts;
 
-  // llvm::dbgs() << "Anders Alias Check\n";
+    // llvm::dbgs() << "Anders Alias Check\n";
 
-  // If either of the sets point to nothing, no alias
-  if (pts1.empty() || pts2.empty()) {
-    return llvm::AliasResult::NoAlias;
+    // If either of the sets point to nothing, no alias
+    // Otherwise, they don't alias if their points-to sets do not intersect.
+    intersects = !pts1.empty() && !pts2.empty() &&
+      pts1.intersectsIgnoring(pts2, ValueMap::NullValue);
+
+    if (cache.enabled()) {
+      cache.insert(cls1, cls2, intersects);
+    }
   }
 
-  // Check to see if the two pointers are known to not alias.  They don't alias
-  // if their points-to sets do not intersect.
-  if (!pts1.intersectsIgnoring(pts2,
-        ValueMap::NullValue)) {
+  if (!intersects) {
     return llvm::AliasResult::NoAlias;
   }
 
@@ -216,6 +253,10 @@ bool SpecAndersWrapperPass::runOnModule(llvm::Module &m) {
   return false;
 }
 
+void SpecAndersWrapperPass::releaseMemory() {
+  anders_.printAliasCacheStats(llvm::dbgs());
+}
+
 void SpecAndersWrapperPass::getAnalysisUsage(
     llvm::AnalysisUsage &usage) const {
   // Because we're an AliasAnalysis
@@ -286,13 +327,11 @@ void SpecAndersAnalysis::run(llvm::Module &m,
   mainCg_->lowerAllocs();
   BddPtstoSet::PtstoSetInit(*mainCg_);
 
-  // ProfilerStart("anders_opt.prof");
   if (!anders_no_opt) {
     util::PerfTimerPrinter hvn_timer(llvm::dbgs(), "HVN");
     // llvm::dbgs() << "FIXME: Opt broken?\n";
      mainCg_->optimize();
   }
-  // ProfilerStop();
   llvm::dbgs() << "SparseBitmap =='s: " << Bitmap::numEq() << "\n";
   llvm::dbgs() << "SparseBitmap hash's: " << Bitmap::numHash() << "\n";
 
@@ -326,12 +365,19 @@ void SpecAndersAnalysis::run(llvm::Module &m,
   }
 
   {
-    // ProfilerStart("anders_solve.prof");
     util::PerfTimerPrinter solve_timer(llvm::dbgs(), "AndersSolve");
     if (solve()) {
       error("Solve failure!");
     }
-    // ProfilerStop();
+  }
+  BddPtstoSet::printBddStats(llvm::dbgs());
+
+  // A new solution, so nothing memoized for an old one still holds
+  ptsCache_.clear();
+  aliasCache_ = std14::make_unique<AliasCache>(alias_cache_size);
+  revPtsto_ = RevPtstoIndex();
+  if (build_rev_ptsto) {
+    getRevPtsto();
   }
 
   for (auto &fcn_name : fcn_names) {
@@ -504,3 +550,26 @@ PtstoSet *SpecAndersAnalysis::ptsCacheGet(const llvm::Value *val) {
   return &rc.first->second;
 }
 
+std::vector<ValueMap::Id> SpecAndersAnalysis::getRepClass(
+    const llvm::Value *val) {
+  std::vector<ValueMap::Id> ret;
+  for (auto val_id : graph_.cg().vals().getIds(val)) {
+    ret.push_back(graph_.getRep(getRep(val_id)));
+  }
+
+  std::sort(std::begin(ret), std::end(ret));
+  ret.erase(std::unique(std::begin(ret), std::end(ret)), std::end(ret));
+
+  return ret;
+}
+
+const RevPtstoIndex &SpecAndersAnalysis::getRevPtsto() {
+  if (!revPtsto_.built()) {
+    util::PerfTimerPrinter rev_timer(llvm::dbgs(), "RevPtstoIndex");
+    revPtsto_.build(graph_, rev_ptsto_threads);
+    revPtsto_.printStats(llvm::dbgs());
+  }
+
+  return revPtsto_;
+}
+
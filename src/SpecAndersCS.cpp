@@ -9,8 +9,6 @@
 
 #include "include/SpecAndersCS.h"
 
-#include <gperftools/profiler.h>
-
 #include <execinfo.h>
 
 #include <algorithm>
@@ -109,6 +107,26 @@ static llvm::cl::opt<bool>
       llvm::cl::desc(
         "if set specanders will print the ptsto sets for each value"));
 
+static llvm::cl::opt<unsigned>
+  alias_cache_size("asc-alias-cache-size", llvm::cl::init(1 << 20),
+      llvm::cl::value_desc("unsigned"),
+      llvm::cl::desc(
+        "Max number of memoized alias() pairs, 0 disables the cache"));
+
+static llvm::cl::opt<bool>
+  build_rev_ptsto("asc-rev-ptsto", llvm::cl::init(false),
+      llvm::cl::value_desc("bool"),
+      llvm::cl::desc(
+        "Builds the object -> pointers index right after solving, instead "
+        "of on first use"));
+
+static llvm::cl::opt<unsigned>
+  rev_ptsto_threads("asc-rev-ptsto-threads", llvm::cl::init(0),
+      llvm::cl::value_desc("unsigned"),
+      llvm::cl::desc(
+        "Threads to build the object -> pointers index on, 0 uses one per "
+        "core"));
+
 static llvm::cl::opt<bool>
   do_spec_dyn_debug("asc-do-check-dyn", llvm::cl::init(false),
       llvm::cl::value_desc("bool"),
@@ -126,6 +144,12 @@ namespace llvm {
   // RegisterAnalysisGroup<AliasAnalysis> CSSpecAndersRAG(SpecAndersCSRP);
 }  // namespace llvm
 
+void SpecAndersCS::releaseMemory() {
+  if (aliasCache_ != nullptr) {
+    aliasCache_->printStats(llvm::dbgs());
+  }
+}
+
 void SpecAndersCS::getAnalysisUsage(llvm::AnalysisUsage &usage) const {
   // Because we're an AliasAnalysis
   // AliasAnalysis::getAnalysisUsage(usage);
@@ -196,6 +220,8 @@ bool SpecAndersCS::runOnModule(llvm::Module &m) {
 
     mainCg_->addGlobalConstraints(m);
     mainCg_->resolveCalls(*cgCache_, *callCgCache_);
+    callCgCache_->printSummaryStats(llvm::dbgs());
+    callCgCache_->releaseSummaries(0);
   }
 
 
@@ -213,9 +239,7 @@ bool SpecAndersCS::runOnModule(llvm::Module &m) {
   {
     util::PerfTimerPrinter pre_setup_timer(llvm::dbgs(), "pre-setup timer");
     mainCg_->lowerAllocs();
-    // ProfilerStart("pts_init.prof");
     BddPtstoSet::PtstoSetInit(*mainCg_);
-    // ProfilerStop();
   }
 
   // Now that we have the constraints, lets optimize a bit
@@ -223,10 +247,8 @@ bool SpecAndersCS::runOnModule(llvm::Module &m) {
   if (!anders_no_opt) {
     util::PerfTimerPrinter hvn_timer(llvm::dbgs(), "optimize");
     // Runs HVN HRU and HCD
-    // ProfilerStart("csa_opt.prof");
     // llvm::dbgs() << "FIXME: Opt broken?\n";
     mainCg_->optimize();
-    // ProfilerStop();
   }
   llvm::dbgs() << "SparseBitmap =='s: " << Bitmap::numEq() << "\n";
   llvm::dbgs() << "SparseBitmap hash's: " << Bitmap::numHash() << "\n";
@@ -245,12 +267,18 @@ bool SpecAndersCS::runOnModule(llvm::Module &m) {
 
   // Solve!
   {
-    // ProfilerStart("csa_solve.prof");
     util::PerfTimerPrinter solve_timer(llvm::dbgs(), "AndersSolve");
     if (solve()) {
       error("Solve failure!");
     }
-    // ProfilerStop();
+  }
+
+  // A new solution, so nothing memoized for an old one still holds
+  ptsCache_.clear();
+  aliasCache_ = std14::make_unique<AliasCache>(alias_cache_size);
+  revPtsto_ = RevPtstoIndex();
+  if (build_rev_ptsto) {
+    getRevPtsto();
   }
 
   // debug stuffs
@@ -862,45 +890,84 @@ PtstoSet *SpecAndersCS::ptsCacheGet(const llvm::Value *val) {
   return &rc.first->second;
 }
 
+std::vector<ValueMap::Id> SpecAndersCS::getRepClass(const llvm::Value *val) {
+  std::vector<ValueMap::Id> ret;
+  for (auto val_id : graph_.cg().vals().getIds(val)) {
+    ret.push_back(graph_.getRep(getRep(val_id)));
+  }
+
+  std::sort(std::begin(ret), std::end(ret));
+  ret.erase(std::unique(std::begin(ret), std::end(ret)), std::end(ret));
+
+  return ret;
+}
+
+const RevPtstoIndex &SpecAndersCS::getRevPtsto() {
+  if (!revPtsto_.built()) {
+    util::PerfTimerPrinter rev_timer(llvm::dbgs(), "RevPtstoIndex");
+    revPtsto_.build(graph_, rev_ptsto_threads);
+    revPtsto_.printStats(llvm::dbgs());
+  }
+
+  return revPtsto_;
+}
+
 llvm::AliasResult SpecAndersCS::alias(const llvm::MemoryLocation &L1,
                                             const llvm::MemoryLocation &L2) {
   auto v1 = L1.Ptr;
   auto v2 = L2.Ptr;
 
-  auto pv1_pts = ptsCacheGet(v1);
-  auto pv2_pts = ptsCacheGet(v2);
-
-  if (pv1_pts == nullptr) {
-    /*
-    llvm::dbgs() << "Anders couldn't find node: " << obj_id1 <<
-      << " " << FullValPrint(obj_id1, omap_) << "\n";
-    */
-    return llvm::AAResultBase<SpecAndersCS>::alias(L1, L2);
+  // Values are memoized by their class of solver reps, so repeated queries
+  //   skip both the points-to lookup and the intersection
+  AliasCache::ClassId cls1 = 0;
+  AliasCache::ClassId cls2 = 0;
+  bool intersects = false;
+  bool cached = false;
+  if (aliasCache_->enabled()) {
+    auto get_reps = [this] (const llvm::Value *val) {
+      return getRepClass(val);
+    };
+    cls1 = aliasCache_->getClass(v1, get_reps);
+    cls2 = aliasCache_->getClass(v2, get_reps);
+    cached = aliasCache_->lookup(cls1, cls2, intersects);
   }
 
-  if (pv2_pts == nullptr) {
-    /*
-    llvm::dbgs() << "Anders couldn't find node: " << obj_id2 <<
-      << " " << FullValPrint(obj_id2, omap_) << "\n";
-    */
-    return llvm::AAResultBase<SpecAndersCS>::alias(L1, L2);
-  }
+  if (!cached) {
+    auto pv1_pts = ptsCacheGet(v1);
+    auto pv2_pts = ptsCacheGet(v2);
 
+    if (pv1_pts == nullptr) {
+      /*
+      llvm::dbgs() << "Anders couldn't find node: " << obj_id1 <<
+        << " " << FullValPrint(obj_id1, omap_) << "\n";
+      */
+      return llvm::AAResultBase<SpecAndersCS>::alias(L1, L2);
+    }
+
+    if (pv2_pts == nullptr) {
+      /*
+      llvm::dbgs() << "Anders couldn't find node: " << obj_id2 <<
+        << " " << FullValPrint(obj_id2, omap_) << "\n";
+      */
+      return llvm::AAResultBase<SpecAndersCS>::alias(L1, L2);
+    }
 
-  auto &pts1 = *pv1_pts;
-  auto &pts2 = *pv2_pts;
+    auto &pts1 = *pv1_pts;
+    auto &pts2 = *pv2_pts;
 
-  // llvm::dbgs() << "Anders Alias Check\n";
+    // llvm::dbgs() << "Anders Alias Check\n";
 
-  // If either of the sets point to nothing, no alias
-  if (pts1.empty() || pts2.empty()) {
-    return llvm::NoAlias;
+    // If either of the sets point to nothing, no alias
+    // Otherwise, they don't alias if their points-to sets do not intersect.
+    intersects = !pts1.empty() && !pts2.empty() &&
+      pts1.intersectsIgnoring(pts2, ValueMap::NullValue);
+
+    if (aliasCache_->enabled()) {
+      aliasCache_->insert(cls1, cls2, intersects);
+    }
   }
 
-  // Check to see if the two pointers are known to not alias.  They don't alias
-  // if their points-to sets do not intersect.
-  if (!pts1.intersectsIgnoring(pts2,
-        ValueMap::NullValue)) {
+  if (!intersects) {
     return llvm::NoAlias;
   }
 
@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include "include/Telemetry.h"
+
+#include <gperftools/profiler.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+std::string telemetry::detail::Path;
+std::string telemetry::detail::ProfilePhase;
+
+static llvm::cl::opt<std::string, true>
+  telemetry_path("anders-telemetry",
+      llvm::cl::location(telemetry::detail::Path),
+      llvm::cl::value_desc("filename"),
+      llvm::cl::desc("Writes phase timers, counters, histograms and stats to "
+        "this file at exit"));
+
+static llvm::cl::opt<std::string>
+  telemetry_format("anders-telemetry-format", llvm::cl::init("json"),
+      llvm::cl::value_desc("json|csv"),
+      llvm::cl::desc("Format -anders-telemetry is written in"));
+
+static llvm::cl::opt<std::string, true>
+  profile_phase("anders-profile-phase",
+      llvm::cl::location(telemetry::detail::ProfilePhase),
+      llvm::cl::value_desc("phase name"),
+      llvm::cl::desc("Runs the gperftools profiler over the named phase, "
+        "writing <phase name>.prof"));
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct PhaseStats {
+  std::string name;
+  size_t depth = 0;
+  size_t count = 0;
+  double wallSecs = 0;
+  double cpuSecs = 0;
+  int64_t peakRssKb = 0;
+};
+
+struct Histogram {
+  int64_t count = 0;
+  int64_t sum = 0;
+  int64_t min = std::numeric_limits<int64_t>::max();
+  int64_t max = std::numeric_limits<int64_t>::min();
+  // Bucket b holds values in [2^(b-1), 2^b), bucket 0 holds values <= 0
+  std::map<int32_t, int64_t> buckets;
+};
+
+struct OpenPhase {
+  std::string name;
+  std::string path;
+  Clock::time_point wallStart;
+  double cpuStart;
+  bool profiling;
+};
+
+class Recorder;
+void write_recorder(const Recorder &rec);
+
+class Recorder {
+ public:
+  // Writes everything at exit.  This must not go through recorder(), which
+  //   is being destroyed
+  ~Recorder() {
+    write_recorder(*this);
+  }
+
+  mutable std::mutex lock;
+
+  // Keyed by the path of nested phase names, in the order first seen
+  std::vector<std::string> phaseOrder;
+  std::map<std::string, PhaseStats> phases;
+
+  std::map<std::string, int64_t> counters;
+  std::map<std::string, Histogram> histograms;
+  std::map<std::string, double> stats;
+
+  bool profiling = false;
+};
+
+Recorder &recorder() {
+  static Recorder rec;
+  return rec;
+}
+
+// Construct the recorder during static initialization, so its destructor
+//   writes the file at exit even if nothing was ever recorded
+const Recorder &exit_recorder = recorder();
+
+thread_local std::vector<OpenPhase> open_phases;
+
+// User + system time of the whole process
+double cpu_secs() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int64_t peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// The smallest value bucket |bucket| of a Histogram holds
+int64_t bucket_low(int32_t bucket) {
+  return (bucket == 0) ? 0 : (int64_t(1) << (bucket - 1));
+}
+
+std::string json_str(const std::string &str) {
+  std::string ret = "\"";
+  for (auto c : str) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+    }
+    ret += c;
+  }
+  ret += "\"";
+  return ret;
+}
+
+std::string csv_str(const std::string &str) {
+  if (str.find_first_of(",\"") == std::string::npos) {
+    return str;
+  }
+
+  std::string ret = "\"";
+  for (auto c : str) {
+    if (c == '"') {
+      ret += '"';
+    }
+    ret += c;
+  }
+  ret += "\"";
+  return ret;
+}
+
+// Doubles are written with enough digits to round trip, so large stats
+//   (e.g. BDD node counts) come out exact instead of as 1.67772e+07
+void write_json(std::ostream &o, const Recorder &rec) {
+  o.precision(std::numeric_limits<double>::max_digits10);
+  o << "{\n  \"phases\": [";
+  bool first = true;
+  for (auto &path : rec.phaseOrder) {
+    auto &ps = rec.phases.at(path);
+    o << (first ? "\n" : ",\n") << "    {\"path\": " << json_str(path) <<
+      ", \"name\": " << json_str(ps.name) <<
+      ", \"depth\": " << ps.depth <<
+      ", \"count\": " << ps.count <<
+      ", \"wall_secs\": " << ps.wallSecs <<
+      ", \"cpu_secs\": " << ps.cpuSecs <<
+      ", \"peak_rss_kb\": " << ps.peakRssKb << "}";
+    first = false;
+  }
+  o << "\n  ],\n  \"counters\": {";
+
+  first = true;
+  for (auto &pr : rec.counters) {
+    o << (first ? "\n" : ",\n") << "    " << json_str(pr.first) << ": " <<
+      pr.second;
+    first = false;
+  }
+  o << "\n  },\n  \"histograms\": {";
+
+  first = true;
+  for (auto &pr : rec.histograms) {
+    auto &hist = pr.second;
+    o << (first ? "\n" : ",\n") << "    " << json_str(pr.first) <<
+      ": {\"count\": " << hist.count << ", \"sum\": " << hist.sum <<
+      ", \"min\": " << hist.min << ", \"max\": " << hist.max <<
+      ", \"buckets\": {";
+    bool first_bucket = true;
+    for (auto &bucket : hist.buckets) {
+      o << (first_bucket ? "" : ", ") << "\"" <<
+        bucket_low(bucket.first) << "\": " << bucket.second;
+      first_bucket = false;
+    }
+    o << "}}";
+    first = false;
+  }
+  o << "\n  },\n  \"stats\": {";
+
+  first = true;
+  for (auto &pr : rec.stats) {
+    o << (first ? "\n" : ",\n") << "    " << json_str(pr.first) << ": " <<
+      pr.second;
+    first = false;
+  }
+  o << "\n  }\n}\n";
+}
+
+// One "kind,name,field,value" row per value
+void write_csv(std::ostream &o, const Recorder &rec) {
+  o.precision(std::numeric_limits<double>::max_digits10);
+  o << "kind,name,field,value\n";
+  for (auto &path : rec.phaseOrder) {
+    auto &ps = rec.phases.at(path);
+    auto name = csv_str(path);
+    o << "phase," << name << ",count," << ps.count << "\n";
+    o << "phase," << name << ",wall_secs," << ps.wallSecs << "\n";
+    o << "phase," << name << ",cpu_secs," << ps.cpuSecs << "\n";
+    o << "phase," << name << ",peak_rss_kb," << ps.peakRssKb << "\n";
+  }
+
+  for (auto &pr : rec.counters) {
+    o << "counter," << csv_str(pr.first) << ",value," << pr.second << "\n";
+  }
+
+  for (auto &pr : rec.histograms) {
+    auto name = csv_str(pr.first);
+    auto &hist = pr.second;
+    o << "histogram," << name << ",count," << hist.count << "\n";
+    o << "histogram," << name << ",sum," << hist.sum << "\n";
+    o << "histogram," << name << ",min," << hist.min << "\n";
+    o << "histogram," << name << ",max," << hist.max << "\n";
+    for (auto &bucket : hist.buckets) {
+      o << "histogram," << name << ",bucket_" << bucket_low(bucket.first) <<
+        "," << bucket.second << "\n";
+    }
+  }
+
+  for (auto &pr : rec.stats) {
+    o << "stat," << csv_str(pr.first) << ",value," << pr.second << "\n";
+  }
+}
+
+void write_recorder(const Recorder &rec) {
+  if (!telemetry::enabled()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(rec.lock);
+
+  std::ofstream out(telemetry::detail::Path);
+  if (!out) {
+    llvm::errs() << "WARNING: Couldn't open telemetry file: " <<
+      telemetry::detail::Path << "\n";
+    return;
+  }
+
+  if (telemetry_format == "csv") {
+    write_csv(out, rec);
+  } else {
+    if (telemetry_format != "json") {
+      llvm::errs() << "WARNING: Unknown telemetry format: " <<
+        telemetry_format << ", writing json\n";
+    }
+    write_json(out, rec);
+  }
+}
+
+}  // namespace
+
+void telemetry::detail::beginPhase(const std::string &name) {
+  OpenPhase phase;
+  phase.name = name;
+  phase.path = open_phases.empty() ? name :
+    open_phases.back().path + "/" + name;
+  phase.profiling = false;
+
+  auto &rec = recorder();
+  {
+    std::lock_guard<std::mutex> guard(rec.lock);
+    if (name == ProfilePhase && !rec.profiling) {
+      ProfilerStart((name + ".prof").c_str());
+      rec.profiling = true;
+      phase.profiling = true;
+    }
+
+    // Phases are listed in the order they start, so parents come first
+    if (enabled()) {
+      auto rc = rec.phases.emplace(phase.path, PhaseStats());
+      if (rc.second) {
+        rec.phaseOrder.push_back(phase.path);
+        rc.first->second.name = name;
+        rc.first->second.depth = open_phases.size();
+      }
+    }
+  }
+
+  phase.cpuStart = cpu_secs();
+  phase.wallStart = Clock::now();
+  open_phases.emplace_back(std::move(phase));
+}
+
+void telemetry::detail::endPhase() {
+  auto wall_end = Clock::now();
+  auto cpu_end = cpu_secs();
+
+  auto phase = std::move(open_phases.back());
+  open_phases.pop_back();
+
+  auto &rec = recorder();
+  std::lock_guard<std::mutex> guard(rec.lock);
+  if (phase.profiling) {
+    ProfilerStop();
+    rec.profiling = false;
+  }
+
+  if (!enabled()) {
+    return;
+  }
+
+  auto &ps = rec.phases.at(phase.path);
+  ps.count++;
+  ps.wallSecs +=
+    std::chrono::duration<double>(wall_end - phase.wallStart).count();
+  ps.cpuSecs += cpu_end - phase.cpuStart;
+  ps.peakRssKb = std::max(ps.peakRssKb, peak_rss_kb());
+}
+
+void telemetry::detail::addCount(const char *name, int64_t delta) {
+  auto &rec = recorder();
+  std::lock_guard<std::mutex> guard(rec.lock);
+  rec.counters[name] += delta;
+}
+
+void telemetry::detail::addSample(const char *name, int64_t value) {
+  int32_t bucket = 0;
+  for (auto val = value; val > 0; val >>= 1) {
+    bucket++;
+  }
+
+  auto &rec = recorder();
+  std::lock_guard<std::mutex> guard(rec.lock);
+  auto &hist = rec.histograms[name];
+  hist.count++;
+  hist.sum += value;
+  hist.min = std::min(hist.min, value);
+  hist.max = std::max(hist.max, value);
+  hist.buckets[bucket]++;
+}
+
+void telemetry::detail::setStat(const char *name, double value) {
+  auto &rec = recorder();
+  std::lock_guard<std::mutex> guard(rec.lock);
+  rec.stats[name] = value;
+}
+
+void telemetry::write() {
+  write_recorder(recorder());
+}
@@ -7,8 +7,10 @@
 #include <cassert>
 
 #include <algorithm>
+#include <memory>
 #include <set>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "include/util.h"
@@ -121,10 +123,28 @@ util::ObjectRemap<Id> ValueMap::import(const ValueMap &rhs) {
     }
   }
 
-  // Now, update revMap_ and allocRevMap_
-  for (auto &pr : rhs.revMap_) {
-    revMap_.emplace(pr.first, remap[pr.second]);
+  // Now, layer rhs's reverse mappings under ours.  rhs's own layers are
+  //   re-targeted through the new remap, but their entries are still shared
+  auto rhs_remap = std::make_shared<std::vector<Id>>(rhs.map_.size());
+  for (Id rhs_id(0); rhs_id < Id(rhs.map_.size()); ++rhs_id) {
+    (*rhs_remap)[static_cast<size_t>(rhs_id)] = remap[rhs_id];
+  }
+  if (!rhs.revMap_->empty()) {
+    revLayers_.push_back(RevLayer{rhs.revMap_, rhs_remap});
+  }
+
+  for (auto &layer : rhs.revLayers_) {
+    auto layer_remap = std::make_shared<std::vector<Id>>(*layer.remap);
+    for (auto &id : *layer_remap) {
+      if (id != Id::invalid()) {
+        id = (*rhs_remap)[static_cast<size_t>(id)];
+      }
+    }
+    revLayers_.push_back(RevLayer{layer.rev, std::move(layer_remap)});
   }
+  revIndexValid_ = false;
+
+  // And allocRevMap_
 
   for (auto &pr : rhs.allocRevMap_) {
     auto &lhs_vec = allocRevMap_[pr.first];
@@ -147,6 +167,59 @@ util::ObjectRemap<Id> ValueMap::import(const ValueMap &rhs) {
   return remap;
 }
 
+const std::vector<std::pair<const llvm::Value *, Id>> &
+ValueMap::getRevIndex() const {
+  if (!revIndexValid_) {
+    revIndex_.clear();
+    for (auto &layer : revLayers_) {
+      for (auto &pr : *layer.rev) {
+        auto id = (*layer.remap)[static_cast<size_t>(pr.second)];
+        assert(id != Id::invalid());
+        revIndex_.emplace_back(pr.first, id);
+      }
+    }
+    std::sort(std::begin(revIndex_), std::end(revIndex_));
+    revIndexValid_ = true;
+  }
+
+  return revIndex_;
+}
+
+std::vector<std::pair<size_t, size_t>> ValueMap::allocBlocks() const {
+  std::vector<std::pair<size_t, size_t>> ret;
+
+  // The first field of an allocation has the largest max offset, and the
+  //   last has a max offset of 0
+  size_t i = 0;
+  while (i < allocs_.size()) {
+    size_t size = allocs_[i].second + 1;
+    assert(i + size <= allocs_.size());
+    ret.emplace_back(i, size);
+    i += size;
+  }
+
+  return ret;
+}
+
+void ValueMap::reorderAllocs(const std::vector<size_t> &order) {
+  // Once lowered, allocation ids are fixed
+  assert(maxAllocId_ == Id::invalid());
+  auto blocks = allocBlocks();
+  assert(order.size() == blocks.size());
+
+  std::vector<std::pair<Id, uint32_t>> new_allocs;
+  new_allocs.reserve(allocs_.size());
+  for (auto block_idx : order) {
+    auto &block = blocks[block_idx];
+    new_allocs.insert(std::end(new_allocs),
+        std::next(std::begin(allocs_), block.first),
+        std::next(std::begin(allocs_), block.first + block.second));
+  }
+  assert(new_allocs.size() == allocs_.size());
+
+  allocs_ = std::move(new_allocs);
+}
+
 util::ObjectRemap<Id> ValueMap::lowerAllocs() {
   util::ObjectRemap<Id> remap(map_.size() + AllocReserveCount);
 
@@ -222,9 +295,19 @@ util::ObjectRemap<Id> ValueMap::lowerAllocs() {
     pr.second = remap[pr.second];
   }
   // revMap
-  for (auto &pr : revMap_) {
+  for (auto &pr : ownRevMap()) {
     pr.second = remap[pr.second];
   }
+  for (auto &layer : revLayers_) {
+    auto layer_remap = std::make_shared<std::vector<Id>>(*layer.remap);
+    for (auto &id : *layer_remap) {
+      if (id != Id::invalid()) {
+        id = remap[id];
+      }
+    }
+    layer.remap = std::move(layer_remap);
+  }
+  revIndexValid_ = false;
   // allocRevMap
   for (auto &pr : allocRevMap_) {
     for (auto &id : pr.second) {
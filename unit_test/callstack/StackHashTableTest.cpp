@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "include/CallStack.h"
+
+static void test_assert(bool check, std::string msg) {
+  if (!check) {
+    std::cerr << "ERROR: " << msg << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Builds a table for |keys| as InsertSpecAssumptions does, and checks it the
+//   way the runtime will
+static void test_table(const std::vector<uint64_t> &keys,
+    std::mt19937_64 &rng) {
+  uint64_t num_buckets = std::max<uint64_t>(1, keys.size() / 2);
+  uint64_t num_slots;
+  std::vector<uint64_t> disps;
+  std::vector<uint64_t> slots;
+  StackHashTable::build(keys, num_buckets, &num_slots, &disps, &slots);
+
+  test_assert(disps.size() == num_buckets, "Wrong number of displacements");
+  test_assert(slots.size() == keys.size(), "Wrong number of key slots");
+  test_assert(num_slots >= keys.size(), "Fewer slots than keys");
+
+  // The keys as the instrumenter lays them out, empty slots hold 0
+  std::vector<uint64_t> table(num_slots, 0);
+  std::set<uint64_t> used;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    test_assert(slots[i] < num_slots, "Slot out of range");
+    test_assert(used.insert(slots[i]).second, "Two keys share a slot");
+    table[slots[i]] = keys[i];
+  }
+
+  // Every key must find itself (and only itself) in its slot
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto key = keys[i];
+    auto bucket = StackHashTable::bucket(key, num_buckets);
+    test_assert(bucket < num_buckets, "Bucket out of range");
+    auto slot = StackHashTable::slot(key, disps[bucket], num_slots);
+    test_assert(slot == slots[i], "Lookup disagrees with the built slot");
+    test_assert(table[slot] == key, "Key doesn't match in its own slot");
+  }
+
+  // Any other (non-zero) hash may land anywhere, but never matches
+  std::set<uint64_t> key_set(std::begin(keys), std::end(keys));
+  for (size_t i = 0; i < 4 * keys.size() + 16; ++i) {
+    auto probe = rng();
+    if (probe == 0 || key_set.count(probe) != 0) {
+      continue;
+    }
+    auto bucket = StackHashTable::bucket(probe, num_buckets);
+    auto slot = StackHashTable::slot(probe, disps[bucket], num_slots);
+    test_assert(slot < num_slots, "Probe slot out of range");
+    test_assert(table[slot] != probe, "Non-key matched a slot");
+  }
+}
+
+int main(void) {
+  std::mt19937_64 rng(0x5eed);
+
+  // A single stack, and small sites
+  for (size_t num_keys = 1; num_keys < 64; ++num_keys) {
+    std::set<uint64_t> keys;
+    while (keys.size() < num_keys) {
+      keys.insert(rng());
+    }
+    test_table(std::vector<uint64_t>(std::begin(keys), std::end(keys)), rng);
+  }
+
+  // Sites with hundreds (and thousands) of forbidden stacks
+  for (size_t num_keys : {200, 513, 4096}) {
+    std::set<uint64_t> keys;
+    while (keys.size() < num_keys) {
+      keys.insert(rng());
+    }
+    test_table(std::vector<uint64_t>(std::begin(keys), std::end(keys)), rng);
+  }
+
+  // Hashes a bit flip apart, half of them share a bucket
+  {
+    std::vector<uint64_t> keys;
+    uint64_t base = rng();
+    for (uint64_t i = 0; i < 64; ++i) {
+      keys.push_back(base ^ (1ULL << i));
+    }
+    test_table(keys, rng);
+  }
+
+  return EXIT_SUCCESS;
+}
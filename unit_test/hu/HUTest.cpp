@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "include/CgOpt.h"
+
+// RunTarjans.h expects the solver to define this
+size_t check_val = std::numeric_limits<size_t>::max();
+
+static void test_assert(bool check, std::string msg) {
+  if (!check) {
+    std::cerr << "ERROR: " << msg << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// The constraints HU sees for one node
+struct NodeSpec {
+  bool indirect = false;
+  std::vector<size_t> preds;
+  std::vector<size_t> implicitPreds;
+  // GEPs of (src, offs) into this node
+  std::vector<std::pair<size_t, int32_t>> geps;
+};
+
+static void add_random_edge(std::mt19937 &rng, std::vector<NodeSpec> &spec,
+    size_t idx) {
+  std::uniform_int_distribution<size_t> node_dist(0, spec.size() - 1);
+  std::uniform_int_distribution<int32_t> offs_dist(1, 3);
+  std::uniform_int_distribution<int> kind_dist(0, 9);
+
+  auto &node = spec[idx];
+  auto kind = kind_dist(rng);
+  if (kind < 7) {
+    node.preds.push_back(node_dist(rng));
+  } else if (kind < 9) {
+    node.implicitPreds.push_back(node_dist(rng));
+  } else {
+    node.geps.emplace_back(node_dist(rng), offs_dist(rng));
+  }
+}
+
+static std::vector<NodeSpec> random_spec(std::mt19937 &rng, size_t num_nodes,
+    size_t num_edges) {
+  std::vector<NodeSpec> ret(num_nodes);
+  std::uniform_int_distribution<size_t> node_dist(0, num_nodes - 1);
+  std::bernoulli_distribution indir_dist(0.1);
+
+  for (auto &node : ret) {
+    node.indirect = indir_dist(rng);
+  }
+
+  for (size_t i = 0; i < num_edges; ++i) {
+    add_random_edge(rng, ret, node_dist(rng));
+  }
+
+  return ret;
+}
+
+// Changes a few nodes' inputs, and adds a few nodes, as a round of HRU would
+static void mutate_spec(std::mt19937 &rng, std::vector<NodeSpec> &spec) {
+  std::uniform_int_distribution<int> kind_dist(0, 3);
+  std::uniform_int_distribution<size_t> count_dist(1, 8);
+
+  auto num_new = count_dist(rng) / 4;
+  spec.resize(spec.size() + num_new);
+
+  std::uniform_int_distribution<size_t> node_dist(0, spec.size() - 1);
+  auto num_changes = count_dist(rng);
+  for (size_t i = 0; i < num_changes; ++i) {
+    auto &node = spec[node_dist(rng)];
+    switch (kind_dist(rng)) {
+      case 0:
+        node.indirect = !node.indirect;
+        break;
+      case 1:
+        node.preds.clear();
+        break;
+      case 2:
+        node.geps.clear();
+        break;
+      default:
+        add_random_edge(rng, spec, node_dist(rng));
+        break;
+    }
+  }
+}
+
+static void build_graph(const std::vector<NodeSpec> &spec, HUState &state,
+    OptGraph &graph, std::vector<size_t> &node_key) {
+  for (size_t i = 0; i < spec.size(); ++i) {
+    graph.addNode();
+    node_key.push_back(HUState::nodeKey(GraphId(i)));
+  }
+
+  for (size_t i = 0; i < spec.size(); ++i) {
+    auto &node = graph.getNode(GraphId(i));
+    if (spec[i].indirect) {
+      node.setIndirect();
+    }
+    for (auto pred : spec[i].preds) {
+      node.addPred(GraphId(pred));
+    }
+    for (auto pred : spec[i].implicitPreds) {
+      node.addImplicitPred(GraphId(pred));
+    }
+    for (auto &pr : spec[i].geps) {
+      node.addPtsTo(state.getGEPPE(GraphId(pr.first), pr.second));
+    }
+  }
+}
+
+// Labels |spec| with |state|, and returns the graph's node partition: the rep
+//   of each node, or invalid for non-pointers
+static std::vector<GraphId> run_hu(const std::vector<NodeSpec> &spec,
+    HUState &state, size_t num_threads, HUState::Stats &stats) {
+  OptGraph graph;
+  std::vector<size_t> node_key;
+  build_graph(spec, state, graph, node_key);
+
+  stats = state.label(graph, node_key, num_threads);
+
+  std::vector<GraphId> ret;
+  for (size_t i = 0; i < spec.size(); ++i) {
+    auto rep_id = graph.getRep(GraphId(i));
+    if (graph.getNode(rep_id).isNonPtr()) {
+      ret.push_back(GraphId::invalid());
+    } else {
+      ret.push_back(rep_id);
+    }
+  }
+
+  state.saveLabels(graph, node_key);
+  return ret;
+}
+
+// The labels are numbered differently, but must split the nodes the same way
+static void check_same_partition(const std::vector<GraphId> &incr,
+    const std::vector<GraphId> &full, const std::string &name) {
+  test_assert(incr.size() == full.size(), name + ": size mismatch");
+
+  std::unordered_map<GraphId, GraphId> incr_to_full;
+  std::unordered_map<GraphId, GraphId> full_to_incr;
+  for (size_t i = 0; i < incr.size(); ++i) {
+    auto msg = name + ": node " + std::to_string(i);
+    test_assert((incr[i] == GraphId::invalid()) ==
+        (full[i] == GraphId::invalid()), msg + " non-ptr mismatch");
+    if (incr[i] == GraphId::invalid()) {
+      continue;
+    }
+
+    auto rc = incr_to_full.emplace(incr[i], full[i]);
+    test_assert(rc.first->second == full[i],
+        msg + " merged incrementally, but not by full HU");
+    rc = full_to_incr.emplace(full[i], incr[i]);
+    test_assert(rc.first->second == incr[i],
+        msg + " merged by full HU, but not incrementally");
+  }
+}
+
+static void test_rounds(uint32_t seed, size_t num_nodes, size_t num_edges,
+    size_t num_rounds, size_t num_threads) {
+  auto name = "seed " + std::to_string(seed) + ", " +
+    std::to_string(num_threads) + " threads";
+  std::mt19937 rng(seed);
+  auto spec = random_spec(rng, num_nodes, num_edges);
+
+  HUState incr_state;
+  size_t num_reused = 0;
+  for (size_t round = 0; round < num_rounds; ++round) {
+    auto round_name = name + ", round " + std::to_string(round);
+
+    HUState::Stats incr_stats;
+    auto incr = run_hu(spec, incr_state, num_threads, incr_stats);
+
+    HUState full_state;
+    HUState::Stats full_stats;
+    auto full = run_hu(spec, full_state, num_threads, full_stats);
+    test_assert(full_stats.numRelabeled == full_stats.numSccs,
+        round_name + ": fresh state reused a label");
+
+    check_same_partition(incr, full, round_name);
+
+    num_reused += incr_stats.numSccs - incr_stats.numRelabeled;
+    mutate_spec(rng, spec);
+  }
+
+  test_assert(num_reused > 0, name + ": no labels were reused");
+}
+
+int main(void) {
+  // Small graphs, many cycles
+  for (uint32_t seed = 0; seed < 40; ++seed) {
+    test_rounds(seed, 60, 90, 12, 1);
+  }
+
+  // Sparser graphs, deeper DAGs
+  for (uint32_t seed = 100; seed < 120; ++seed) {
+    test_rounds(seed, 400, 350, 12, 1);
+  }
+
+  // Wide enough levels to label in parallel
+  {
+    std::mt19937 rng(7);
+    auto spec = random_spec(rng, 20000, 8000);
+    HUState state;
+    HUState::Stats stats;
+    run_hu(spec, state, 4, stats);
+    test_assert(stats.numParallel > 0, "wide graph wasn't labeled in parallel");
+  }
+  for (uint32_t seed = 200; seed < 203; ++seed) {
+    test_rounds(seed, 20000, 8000, 4, 4);
+  }
+
+  // Parallel labels must match serial ones
+  {
+    std::mt19937 rng(11);
+    auto spec = random_spec(rng, 20000, 8000);
+    HUState serial_state;
+    HUState parallel_state;
+    HUState::Stats stats;
+    auto serial = run_hu(spec, serial_state, 1, stats);
+    auto parallel = run_hu(spec, parallel_state, 4, stats);
+    check_same_partition(serial, parallel, "serial vs. parallel");
+  }
+
+  return EXIT_SUCCESS;
+}
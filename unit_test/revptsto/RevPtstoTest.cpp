@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 David Devecsery
+ */
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "include/RevPtstoIndex.h"
+
+typedef RevPtstoIndex::Id Id;
+
+static void test_assert(bool check, std::string msg) {
+  if (!check) {
+    std::cerr << "ERROR: " << msg << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// A points-to relation: reps[i] points to the objects in ptsto[i]
+struct Relation {
+  std::vector<Id> reps;
+  std::vector<std::vector<Id>> ptsto;
+};
+
+static Relation random_relation(std::mt19937 &rng, size_t num_reps,
+    size_t num_objs, size_t max_pts) {
+  Relation ret;
+  std::uniform_int_distribution<size_t> obj_dist(0, num_objs - 1);
+  std::uniform_int_distribution<size_t> size_dist(0, max_pts);
+  std::uniform_int_distribution<size_t> gap_dist(1, 3);
+
+  size_t rep = 0;
+  for (size_t i = 0; i < num_reps; ++i) {
+    // Reps aren't dense, some nodes were merged away
+    rep += gap_dist(rng);
+    ret.reps.emplace_back(rep);
+
+    std::vector<Id> pts;
+    auto size = size_dist(rng);
+    for (size_t j = 0; j < size; ++j) {
+      pts.emplace_back(obj_dist(rng));
+    }
+    std::sort(std::begin(pts), std::end(pts));
+    pts.erase(std::unique(std::begin(pts), std::end(pts)), std::end(pts));
+    ret.ptsto.emplace_back(std::move(pts));
+  }
+
+  return ret;
+}
+
+// The index must be exactly the transpose of |rel|: each object is pointed
+//   to by precisely the reps whose sets hold it, in increasing order
+static void test_transpose(const Relation &rel, size_t num_threads) {
+  std::vector<size_t> offsets(1, 0);
+  std::vector<Id> objs;
+  size_t num_objs = 0;
+  for (auto &pts : rel.ptsto) {
+    objs.insert(std::end(objs), std::begin(pts), std::end(pts));
+    offsets.push_back(objs.size());
+    for (auto obj_id : pts) {
+      num_objs = std::max(num_objs, static_cast<size_t>(obj_id.val()) + 1);
+    }
+  }
+
+  RevPtstoIndex index;
+  index.build(rel.reps, offsets, objs, num_threads);
+  test_assert(index.built(), "Index not built");
+
+  std::vector<std::vector<Id>> expected(num_objs);
+  for (size_t i = 0; i < rel.reps.size(); ++i) {
+    for (auto obj_id : rel.ptsto[i]) {
+      expected[static_cast<size_t>(obj_id.val())].push_back(rel.reps[i]);
+    }
+  }
+
+  size_t num_edges = 0;
+  for (size_t i = 0; i < num_objs; ++i) {
+    auto pr = index.pointedToBy(Id(i));
+    std::vector<Id> got(pr.first, pr.second);
+    test_assert(got == expected[i], "Wrong reps for object " +
+        std::to_string(i) + " on " + std::to_string(num_threads) +
+        " threads");
+    test_assert(index.numPointedToBy(Id(i)) == expected[i].size(),
+        "Wrong count for object " + std::to_string(i));
+    num_edges += got.size();
+  }
+  test_assert(num_edges == objs.size(), "Index has a different edge count");
+
+  // Objects past the largest pointed to object are pointed to by nothing
+  for (size_t i = num_objs; i < num_objs + 4; ++i) {
+    test_assert(index.numPointedToBy(Id(i)) == 0,
+        "Unknown object " + std::to_string(i) + " is pointed to");
+  }
+}
+
+int main(void) {
+  std::mt19937 rng(0x5eed);
+
+  // Nothing points to anything
+  test_transpose(Relation(), 1);
+  test_transpose(Relation(), 4);
+
+  // One rep pointing to one object
+  {
+    Relation rel;
+    rel.reps.emplace_back(7);
+    rel.ptsto.push_back({ Id(3) });
+    test_transpose(rel, 1);
+    test_transpose(rel, 8);
+  }
+
+  // Random relations, on as many thread counts, including more threads than
+  //   objects
+  for (size_t num_threads : {1, 2, 3, 8, 64}) {
+    test_transpose(random_relation(rng, 10, 4, 4), num_threads);
+    test_transpose(random_relation(rng, 500, 100, 20), num_threads);
+    test_transpose(random_relation(rng, 2000, 5000, 200), num_threads);
+  }
+
+  return EXIT_SUCCESS;
+}